@@ -0,0 +1,109 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <Wire.h>
+
+// Minimal driver for the ADS1115: single shot conversions with +/-6.144V and 860 samples/s.
+// Unlike the Adafruit-library, it works on any I2C bus, not only on the global Wire.
+class Ads1115 {
+  public:
+    enum class Mux : uint16_t {
+      Differential01 = 0x0000,
+      Differential23 = 0x3000,
+      Single0        = 0x4000,
+      Single1        = 0x5000,
+      Single2        = 0x6000,
+      Single3        = 0x7000
+    };
+
+    Ads1115( uint8_t address = 0x48 ) : address( address ) {}
+
+    void begin( TwoWire& wire ) {
+      this->wire = &wire;
+    }
+
+    // starts a conversion and waits for the result, returns false on a bus error or a timeout
+    bool read( Mux mux, int16_t& value ) {
+      if( !writeRegister( RegisterConfig, ConfigStart | ( uint16_t )mux | ConfigSettings ) ) {
+        return false;
+      }
+
+      // a conversion takes 1.2ms at 860 samples/s
+      delay( 2 );
+
+      for( uint8_t i = 0; i < 3; ++i ) {
+        uint16_t config;
+
+        if( !readRegister( RegisterConfig, config ) ) {
+          return false;
+        }
+
+        if( config & ConfigStart ) {
+          uint16_t conversion;
+
+          if( !readRegister( RegisterConversion, conversion ) ) {
+            return false;
+          }
+
+          value = ( int16_t )conversion;
+          return true;
+        }
+
+        delay( 1 );
+      }
+
+      return false;
+    }
+
+  private:
+    static constexpr uint8_t RegisterConversion = 0x00;
+    static constexpr uint8_t RegisterConfig = 0x01;
+
+    // writing: start a single conversion, reading: no conversion is running
+    static constexpr uint16_t ConfigStart = 0x8000;
+    // PGA +/-6.144V, single shot mode, 860 samples/s, comparator disabled
+    static constexpr uint16_t ConfigSettings = 0x0000 | 0x0100 | 0x00E0 | 0x0003;
+
+    bool writeRegister( uint8_t reg, uint16_t value ) {
+      uint8_t data[3] = { reg, ( uint8_t )( value >> 8 ), ( uint8_t )value };
+      return wire->writeTransmission( address, data, sizeof( data ) ) == I2C_ERROR_OK;
+    }
+
+    bool readRegister( uint8_t reg, uint16_t& value ) {
+      uint8_t data[2];
+
+      if( wire->writeTransmission( address, &reg, 1 ) != I2C_ERROR_OK ||
+          wire->readTransmission( address, data, sizeof( data ) ) != I2C_ERROR_OK ) {
+        return false;
+      }
+
+      value = ( data[0] << 8 ) | data[1];
+      return true;
+    }
+
+    TwoWire* wire = &Wire;
+    uint8_t address;
+};
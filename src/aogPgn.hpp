@@ -0,0 +1,108 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Table-driven decoder for the PGNs of AgOpenGPS (see pgn.xlsx in
+// https://github.com/farmerbriantee/AgOpenGPS/tree/master/AgOpenGPS_Dev). All PGNs start with 0x7F, the
+// second byte selects the entry with a lookup table. A packet is only passed to the handler of an entry
+// if it is at least as long as the entry requires, so the handlers can index the data without checks.
+// Doesn't depend on the framework, so it can be compiled on a host.
+class AogPgnDecoder {
+  public:
+    typedef void ( *Handler )( const uint8_t* data, size_t len );
+
+    struct Entry {
+      uint16_t pgn;
+      // minimal length of the packet, including the PGN
+      uint8_t length;
+      Handler handler;
+    };
+
+    static constexpr uint8_t MaxEntries = 8;
+
+    // the entries are not copied, so they have to outlive the decoder
+    AogPgnDecoder( const Entry* entries, uint8_t count )
+      : entries( entries ), count( count < MaxEntries ? count : MaxEntries ) {
+      for( uint8_t& index : lookup ) {
+        index = NoEntry;
+      }
+
+      for( uint8_t i = 0; i < this->count; ++i ) {
+        if( ( entries[i].pgn >> 8 ) == PgnHighByte ) {
+          lookup[entries[i].pgn & 0xFF] = i;
+        }
+      }
+    }
+
+    // returns true if the packet was passed to a handler
+    bool decode( const uint8_t* data, size_t len ) {
+      if( data == nullptr || len < 2 || data[0] != PgnHighByte ) {
+        ++malformed;
+        return false;
+      }
+
+      uint8_t index = lookup[data[1]];
+
+      if( index == NoEntry ) {
+        ++unknown;
+        return false;
+      }
+
+      const Entry& entry = entries[index];
+
+      if( len < entry.length ) {
+        ++tooShort;
+        return false;
+      }
+
+      entry.handler( data, len );
+      ++decoded[index];
+      return true;
+    }
+
+    uint8_t size() const {
+      return count;
+    }
+
+    uint16_t pgn( uint8_t index ) const {
+      return entries[index].pgn;
+    }
+
+    // only written by decode(), so they can be read from another task without locking
+    uint32_t decoded[MaxEntries] = {};
+    uint32_t unknown = 0;
+    uint32_t tooShort = 0;
+    uint32_t malformed = 0;
+
+  private:
+    static constexpr uint8_t PgnHighByte = 0x7F;
+    static constexpr uint8_t NoEntry = 0xFF;
+
+    const Entry* entries;
+    uint8_t count;
+    uint8_t lookup[256];
+};
@@ -0,0 +1,48 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include "aogPgn.hpp"
+
+// The PGNs handled by the autosteer, shared with test/fuzz_aogPgn.cpp. The handlers are defined in
+// autosteer.cpp (or by the fuzzer) and can index the data up to the length given in the table.
+void decodeAogSteerData( const uint8_t* data, size_t len );
+void decodeAogSteerSettings( const uint8_t* data, size_t len );
+void decodeAogMachineControl( const uint8_t* data, size_t len );
+void decodeAogRoll( const uint8_t* data, size_t len );
+
+// sent by AgOpenGPS
+static const AogPgnDecoder::Entry aogLocalPgns[] = {
+  // pgn    length  handler
+  { 0x7FFE, 8,      decodeAogSteerData },
+  { 0x7FFC, 10,     decodeAogSteerSettings },
+  { 0x7FF6, 6,      decodeAogMachineControl }
+};
+
+// sent by other modules
+static const AogPgnDecoder::Entry aogRemotePgns[] = {
+  // pgn    length  handler
+  { 0x7FFD, 8,      decodeAogRoll },
+  { 0x7FEE, 8,      decodeAogRoll }
+};
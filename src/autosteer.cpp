@@ -27,79 +27,323 @@
 
 #include "main.hpp"
 #include "jsonFunctions.hpp"
+#include "aogPgnTable.hpp"
 
 #include <string>       // std::string
 #include <sstream>      // std::stringstream
 
 #include <ESPUI.h>
 
-SteerSettings steerSettings;
-SteerSetpoints steerSetpoints;
+SeqLock<SteerSettings> steerSettings;
+SeqLock<SteerSetpoints> steerSetpoints;
 SteerMachineControl steerMachineControl;
 
 AsyncUDP udpSendFrom;
 AsyncUDP udpLocalPort;
 AsyncUDP udpRemotePort;
 
+// AutoPID works with pointers, so the values are copied out of steerSetpoints before each run
+double pidInput = 0;
+double pidSetpoint = 0;
 double pidOutput = 0;
 AutoPID pid(
-        &( steerSetpoints.actualSteerAngle ),
-        &( steerSetpoints.requestedSteerAngle ),
+        &( pidInput ),
+        &( pidSetpoint ),
         &( pidOutput ),
         -255, 255,
         steerConfig.steeringPidKp, steerConfig.steeringPidKi, steerConfig.steeringPidKd );
 
 JsonQueueSelector jsonQueueSelector;
 
+// a packet of QOG, decoded in the UDP-callback, so the autosteer-worker doesn't touch the heap
+struct QogMessage {
+  uint16_t channelId;
+  bool hasState;
+  bool state;
+  bool hasNumber;
+  double number;
+};
+constexpr uint8_t QogQueueSize = 16;
+static QueueHandle_t qogQueue = nullptr;
+
 constexpr time_t Timeout = 1000;
 
+// work- and steerswitch, as sent to AOG/QOG
+static volatile bool workswitchState = false;
+static volatile bool steerswitchState = false;
+
+// the PGNs received from AOG, see pgn.xlsx in https://github.com/farmerbriantee/AgOpenGPS/tree/master/AgOpenGPS_Dev
+void decodeAogSteerData( const uint8_t* data, size_t len ) {
+  steerSetpoints.update( [data]( SteerSetpoints & setpoints ) {
+    setpoints.relais = data[2];
+    setpoints.speed = ( float )data[3] / 4;
+    setpoints.distanceFromLine = data[5] + ( data[4] << 8 );
+    setpoints.requestedSteerAngle = ( int16_t )( data[7] + ( data[6] << 8 ) ) / 100;
+
+    setpoints.lastPacketReceived = millis();
+  } );
+}
+
+void decodeAogSteerSettings( const uint8_t* data, size_t len ) {
+  SteerSettings settings;
+  settings.Kp = ( float )data[2] * 1.0; // read Kp from AgOpenGPS
+  settings.Ki = ( float )data[3] * 0.001; // read Ki from AgOpenGPS
+  settings.Kd = ( float )data[4] * 1.0; // read Kd from AgOpenGPS
+  settings.Ko = ( float )data[5] * 0.1; // read Ko from AgOpenGPS
+  settings.wheelAnglePositionZero = ( int8_t )data[6]; //read steering zero offset
+  settings.minPWMValue = data[7]; //read the minimum amount of PWM for instant on
+  settings.maxIntegralValue = data[8] * 0.1; //
+  settings.wheelAngleCountsPerDegree = data[9]; //sent as 10 times the setting displayed in AOG
+
+  settings.lastPacketReceived = millis();
+  steerSettings.write( settings );
+}
+
+void decodeAogMachineControl( const uint8_t* data, size_t len ) {
+  steerMachineControl.pedalControl = data[2];
+  steerMachineControl.speed = ( float )data[3] / 4;
+  steerMachineControl.relais = data[4];
+  steerMachineControl.youTurn = data[5];
+
+  steerMachineControl.lastPacketReceived = millis();
+}
+
+// the roll of another module (0x7FFD: "from autosteer", 0x7FEE: IMU), in 1/16°, 9999 if it has none
+void decodeAogRoll( const uint8_t* data, size_t len ) {
+  uint16_t rollInteger = data[7] + ( data[6] << 8 );
+
+  if( rollInteger != 9999 ) {
+    steerSetpoints.update( [rollInteger]( SteerSetpoints & setpoints ) {
+      setpoints.receivedRoll = ( float )( int16_t )rollInteger / 16;
+    } );
+  }
+}
+
+static AogPgnDecoder aogLocalDecoder( aogLocalPgns, sizeof( aogLocalPgns ) / sizeof( aogLocalPgns[0] ) );
+static AogPgnDecoder aogRemoteDecoder( aogRemotePgns, sizeof( aogRemotePgns ) / sizeof( aogRemotePgns[0] ) );
+
+static void addAogDecoderStatistics( String& str, const AogPgnDecoder& decoder ) {
+  for( uint8_t i = 0; i < decoder.size(); ++i ) {
+    char pgn[8];
+    snprintf( pgn, sizeof( pgn ), "0x%04X", decoder.pgn( i ) );
+
+    str += "<tr><td style='text-align:left; padding: 0px 5px;'>";
+    str += pgn;
+    str += ":</td><td style='text-align:left; padding: 0px 5px;'>";
+    str += decoder.decoded[i];
+    str += "</td></tr>";
+  }
+
+  str += "<tr><td style='text-align:left; padding: 0px 5px;'>Unknown/too short/malformed:</td><td style='text-align:left; padding: 0px 5px;'>";
+  str += decoder.unknown;
+  str += " / ";
+  str += decoder.tooShort;
+  str += " / ";
+  str += decoder.malformed;
+  str += "</td></tr>";
+}
+
+static void updateAogStatusLabel() {
+  WebUiLock lock( 0 );
+  Control* handle = lock ? ESPUI.getControl( labelStatusAog ) : nullptr;
+
+  if( handle == nullptr ) {
+    return;
+  }
+
+  // the buffer is reserved when the WebUI is built
+  String& str = handle->value;
+
+  str = "<table style='margin:auto;'>";
+  addAogDecoderStatistics( str, aogLocalDecoder );
+
+  if( initialisation.inclinoType == SteerConfig::InclinoType::None ) {
+    addAogDecoderStatistics( str, aogRemoteDecoder );
+  }
+
+  str += "</table>";
+
+  handle->color = aogLocalDecoder.decoded[0] ? ControlColor::Emerald : ControlColor::Turquoise;
+  ESPUI.updateControlAsync( handle );
+}
+
+// the "from autosteer"-packet to AOG without the switches
+static void fillAogSteerData( uint8_t* data ) {
+  SteerImuInclinometerData imuInclinometerData = steerImuInclinometerData.read();
+
+  data[0] = 0x7F;
+  data[1] = 0xFD;
+
+  {
+    int16_t steerAngle = steerSetpoints.read().actualSteerAngle * 100;
+    data[2] = ( uint16_t )steerAngle >> 8;
+    data[3] = ( uint16_t )steerAngle;
+  }
+
+  {
+    uint16_t heading;
+
+    if( initialisation.imuType != SteerConfig::ImuType::None ) {
+      heading = ( float )imuInclinometerData.heading * 16;
+    } else {
+      heading = 9999;
+    }
+
+    data[4] = heading >> 8;
+    data[5] = heading;
+  }
+
+  {
+    int16_t roll;
+
+    if( initialisation.inclinoType != SteerConfig::InclinoType::None ) {
+      roll = imuInclinometerData.roll * 16;
+
+      if( steerConfig.invertRoll ) {
+        roll = -roll;
+      }
+    } else {
+      roll = 9999;
+    }
+
+    data[6] = ( uint16_t )roll >> 8;
+    data[7] = ( uint16_t )roll;
+  }
+}
+
+// Evaluates the workswitch. The input is read by the task owning it: the GPIO by autosteerWorker100Hz,
+// the CAN-values by canWorker right after decoding them. A change is sent right away, not only with
+// the next packet sent at 10Hz, so section control reacts without delay.
+void updateWorkswitch( bool fromCan ) {
+  if( steerConfig.workswitchType == SteerConfig::WorkswitchType::None ||
+      ( steerConfig.workswitchType != SteerConfig::WorkswitchType::Gpio ) != fromCan ) {
+    return;
+  }
+
+  float value = 0;
+  uint16_t threshold = 0;
+  uint16_t hysteresis = 0;
+  SteerCanData canData = steerCanData.read();
+
+  switch( steerConfig.workswitchType ) {
+    case SteerConfig::WorkswitchType::Gpio:
+      value =  digitalRead( ( uint8_t )steerConfig.gpioWorkswitch ) ? 1 : 0;
+      threshold = 1;
+      hysteresis = 0;
+      break;
+
+    case SteerConfig::WorkswitchType::RearHitchPosition:
+      value = canData.rearHitchPosition;
+      threshold = steerConfig.canBusHitchThreshold;
+      hysteresis = steerConfig.canBusHitchThresholdHysteresis;
+      break;
+
+    case SteerConfig::WorkswitchType::FrontHitchPosition:
+      value = canData.frontHitchPosition;
+      threshold = steerConfig.canBusHitchThreshold;
+      hysteresis = steerConfig.canBusHitchThresholdHysteresis;
+      break;
+
+    case SteerConfig::WorkswitchType::RearPtoRpm:
+      value = canData.rearPtoRpm;
+      threshold = steerConfig.canBusRpmThreshold;
+      hysteresis = steerConfig.canBusRpmThresholdHysteresis;
+      break;
+
+    case SteerConfig::WorkswitchType::FrontPtoRpm:
+      value = canData.frontPtoRpm;
+      threshold = steerConfig.canBusRpmThreshold;
+      hysteresis = steerConfig.canBusRpmThresholdHysteresis;
+      break;
+
+    case SteerConfig::WorkswitchType::MotorRpm:
+      value = canData.motorRpm;
+      threshold = steerConfig.canBusRpmThreshold;
+      hysteresis = steerConfig.canBusRpmThresholdHysteresis;
+      break;
+
+    default:
+      break;
+  }
+
+  static bool thresholdState = false;
+
+  if( value >= threshold ) {
+    thresholdState = true;
+  }
+
+  if( value < ( ( float )threshold - hysteresis ) ) {
+    thresholdState = false;
+  }
+
+  bool state = steerConfig.workswitchActiveLow ? !thresholdState : thresholdState;
+
+  if( state != workswitchState ) {
+    workswitchState = state;
+
+    if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
+      sendStateTransmission( steerConfig.qogChannelIdWorkswitch, state );
+    }
+
+    if( steerConfig.mode == SteerConfig::Mode::AgOpenGps && initialisation.outputType != SteerConfig::OutputType::None ) {
+      uint8_t data[10] = {0};
+      fillAogSteerData( data );
+      data[8] = ( state ? 1 : 0 ) | ( steerswitchState ? 2 : 0 );
+      udpSendFrom.broadcastTo( data, sizeof( data ), initialisation.portSendTo );
+    }
+  }
+}
+
 void autosteerWorker100Hz( void* z ) {
   constexpr TickType_t xFrequency = 10;
   TickType_t xLastWakeTime = xTaskGetTickCount();
 
   pid.setTimeStep( xFrequency );
 
-  QueueHandle_t queue = xQueueCreate( 16, sizeof( json* ) );
-  jsonQueueSelector.addQueue( steerConfig.qogChannelIdAutosteerEnable, queue );
-  jsonQueueSelector.addQueue( steerConfig.qogChannelIdSetpointSteerAngle, queue );
-
   for( ;; ) {
+    taskTimingStart( TaskId::Autosteer );
+
     time_t timeoutPoint = millis() - Timeout;
 
     if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
-      while( uxQueueMessagesWaiting( queue ) ) {
-        json* j = nullptr;
-
-        if( xQueueReceive( queue, &j, 0 ) == pdTRUE ) {
-          uint16_t channelId = j->at( "channelId" );
-
-          if( channelId == steerConfig.qogChannelIdAutosteerEnable ) {
-            if( j->contains( "state" ) ) {
-              steerSetpoints.enabled = j->at( "state" );
-              steerSetpoints.lastPacketReceived = millis();
-            }
+      QogMessage message;
+
+      while( xQueueReceive( qogQueue, &message, 0 ) == pdTRUE ) {
+        if( message.channelId == steerConfig.qogChannelIdAutosteerEnable ) {
+          if( message.hasState ) {
+            bool enabled = message.state;
+            steerSetpoints.update( [enabled]( SteerSetpoints & setpoints ) {
+              setpoints.enabled = enabled;
+              setpoints.lastPacketReceived = millis();
+            } );
           }
+        }
 
-          if( channelId == steerConfig.qogChannelIdSetpointSteerAngle ) {
-            if( j->contains( "number" ) ) {
-              steerSetpoints.requestedSteerAngle = j->at( "number" );
-              steerSetpoints.lastPacketReceived = millis();
-            }
+        if( message.channelId == steerConfig.qogChannelIdSetpointSteerAngle ) {
+          if( message.hasNumber ) {
+            double requestedSteerAngle = message.number;
+            steerSetpoints.update( [requestedSteerAngle]( SteerSetpoints & setpoints ) {
+              setpoints.requestedSteerAngle = requestedSteerAngle;
+              setpoints.lastPacketReceived = millis();
+            } );
           }
-
-          delete j;
         }
       }
     }
 
+    SteerSetpoints setpoints = steerSetpoints.read();
+
     // check for timeout and data from AgOpenGPS
-    if( steerSetpoints.lastPacketReceived < timeoutPoint ||
-        ( steerConfig.mode == SteerConfig::Mode::AgOpenGps && steerSetpoints.distanceFromLine == 32020 ) ||
-        ( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance && steerSetpoints.enabled == false )/* ||
-         steerSetpoints.speed < 1*/
+    if( setpoints.lastPacketReceived < timeoutPoint ||
+        ( steerConfig.mode == SteerConfig::Mode::AgOpenGps && setpoints.distanceFromLine == 32020 ) ||
+        ( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance && setpoints.enabled == false )/* ||
+         setpoints.speed < 1*/
       ) {
       if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
-        steerSetpoints.enabled = false;
+        setpoints.enabled = false;
+        steerSetpoints.update( []( SteerSetpoints & data ) {
+          data.enabled = false;
+        } );
       }
 
       switch( initialisation.outputType ) {
@@ -109,6 +353,11 @@ void autosteerWorker100Hz( void* z ) {
         }
         break;
 
+        case SteerConfig::OutputType::IsobusGuidance: {
+          canSetGuidanceCommand( 0, false );
+        }
+        break;
+
         default: {
           ledcWrite( 0, 0 );
           ledcWrite( 1, 0 );
@@ -121,98 +370,108 @@ void autosteerWorker100Hz( void* z ) {
       }
     } else {
       if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
-        steerSetpoints.enabled = true;
+        setpoints.enabled = true;
+        steerSetpoints.update( []( SteerSetpoints & data ) {
+          data.enabled = true;
+        } );
       }
 
-      pid.setGains( steerConfig.steeringPidKp, steerConfig.steeringPidKi, steerConfig.steeringPidKd );
-
-      if( steerConfig.steeringPidAutoBangOnFactor ) {
-        pid.setBangBang( ( ( double )0xFF / steerSettings.Kp ) * steerConfig.steeringPidAutoBangOnFactor, steerConfig.steeringPidBangOff );
+      // the tractor closes the loop itself, so the requested angle is sent as curvature instead of running the PID
+      if( initialisation.outputType == SteerConfig::OutputType::IsobusGuidance ) {
+        float curvature = tan( setpoints.requestedSteerAngle * DEG_TO_RAD ) / steerConfig.wheelbase * 1000;
+        canSetGuidanceCommand( steerConfig.invertOutput ? -curvature : curvature, true );
       } else {
-        pid.setBangBang( steerConfig.steeringPidBangOn, steerConfig.steeringPidBangOff );
-      }
+        pid.setGains( steerConfig.steeringPidKp, steerConfig.steeringPidKi, steerConfig.steeringPidKd );
 
-      // here comes the magic: executing the PID loop
-      // the values are given by pointers, so the AutoPID gets them automaticaly
-      pid.run();
+        if( steerConfig.steeringPidAutoBangOnFactor ) {
+          pid.setBangBang( ( ( double )0xFF / steerSettings.read().Kp ) * steerConfig.steeringPidAutoBangOnFactor, steerConfig.steeringPidBangOff );
+        } else {
+          pid.setBangBang( steerConfig.steeringPidBangOn, steerConfig.steeringPidBangOff );
+        }
+
+        // here comes the magic: executing the PID loop
+        pidInput = setpoints.actualSteerAngle;
+        pidSetpoint = setpoints.requestedSteerAngle;
+        pid.run();
 
 //         Serial.print( "actualSteerAngle: " );
-//         Serial.print( steerSetpoints.actualSteerAngle );
+//         Serial.print( setpoints.actualSteerAngle );
 //         Serial.print( ", requestedSteerAngle: " );
-//         Serial.print( steerSetpoints.requestedSteerAngle );
+//         Serial.print( setpoints.requestedSteerAngle );
 //         Serial.print( "pidOutput: " );
 //         Serial.println( pidOutput );
 
-      if( pidOutput ) {
+        if( pidOutput ) {
 
-        double pidOutputTmp = steerConfig.invertOutput ? pidOutput : -pidOutput;
+          double pidOutputTmp = steerConfig.invertOutput ? pidOutput : -pidOutput;
 
-        if( pidOutputTmp < 0 && pidOutputTmp > -steerConfig.steeringPidMinPwm ) {
-          pidOutputTmp = -steerConfig.steeringPidMinPwm;
-        }
+          if( pidOutputTmp < 0 && pidOutputTmp > -steerConfig.steeringPidMinPwm ) {
+            pidOutputTmp = -steerConfig.steeringPidMinPwm;
+          }
 
-        if( pidOutputTmp > 0 && pidOutputTmp < steerConfig.steeringPidMinPwm ) {
-          pidOutputTmp = steerConfig.steeringPidMinPwm;
-        }
+          if( pidOutputTmp > 0 && pidOutputTmp < steerConfig.steeringPidMinPwm ) {
+            pidOutputTmp = steerConfig.steeringPidMinPwm;
+          }
 
-        switch( initialisation.outputType ) {
-          case SteerConfig::OutputType::SteeringMotorIBT2:
-          case SteerConfig::OutputType::HydraulicPwm2Coil: {
-            if( pidOutputTmp >= 0 ) {
-              ledcWrite( 0, pidOutputTmp );
-              ledcWrite( 1, 0 );
-            }
+          switch( initialisation.outputType ) {
+            case SteerConfig::OutputType::SteeringMotorIBT2:
+            case SteerConfig::OutputType::HydraulicPwm2Coil: {
+              if( pidOutputTmp >= 0 ) {
+                ledcWrite( 0, pidOutputTmp );
+                ledcWrite( 1, 0 );
+              }
 
-            if( pidOutputTmp < 0 ) {
-              ledcWrite( 0, 0 );
-              ledcWrite( 1, -pidOutputTmp );
+              if( pidOutputTmp < 0 ) {
+                ledcWrite( 0, 0 );
+                ledcWrite( 1, -pidOutputTmp );
+              }
             }
-          }
-          break;
+            break;
 
-          case SteerConfig::OutputType::SteeringMotorCytron: {
-            if( pidOutputTmp >= 0 ) {
-              ledcWrite( 1, 255 );
-            } else {
-              ledcWrite( 0, 255 );
-              pidOutputTmp = -pidOutputTmp;
-            }
+            case SteerConfig::OutputType::SteeringMotorCytron: {
+              if( pidOutputTmp >= 0 ) {
+                ledcWrite( 1, 255 );
+              } else {
+                ledcWrite( 0, 255 );
+                pidOutputTmp = -pidOutputTmp;
+              }
 
-            ledcWrite( 0, pidOutputTmp );
+              ledcWrite( 0, pidOutputTmp );
 
-            if( steerConfig.gpioEn != SteerConfig::Gpio::None ) {
-              digitalWrite( ( uint8_t )steerConfig.gpioEn, HIGH );
+              if( steerConfig.gpioEn != SteerConfig::Gpio::None ) {
+                digitalWrite( ( uint8_t )steerConfig.gpioEn, HIGH );
+              }
             }
-          }
-          break;
+            break;
 
-          case SteerConfig::OutputType::HydraulicDanfoss: {
+            case SteerConfig::OutputType::HydraulicDanfoss: {
 
-            // go from 25% on: max left, 50% on: center, 75% on: right max
-            if( pidOutputTmp >  250 ) {
-              pidOutputTmp =  250;
-            }
+              // go from 25% on: max left, 50% on: center, 75% on: right max
+              if( pidOutputTmp >  250 ) {
+                pidOutputTmp =  250;
+              }
+
+              if( pidOutputTmp < -250 ) {
+                pidOutputTmp = -250;
+              }
 
-            if( pidOutputTmp < -250 ) {
-              pidOutputTmp = -250;
+              pidOutputTmp /= 4;
+              pidOutputTmp += 128;
+              ledcWrite( 0, pidOutputTmp );
             }
+            break;
 
-            pidOutputTmp /= 4;
-            pidOutputTmp += 128;
-            ledcWrite( 0, pidOutputTmp );
+            default:
+              break;
           }
-          break;
-
-          default:
-            break;
-        }
 
-        if( steerConfig.gpioEn != SteerConfig::Gpio::None ) {
-          digitalWrite( ( uint8_t )steerConfig.gpioEn, HIGH );
+          if( steerConfig.gpioEn != SteerConfig::Gpio::None ) {
+            digitalWrite( ( uint8_t )steerConfig.gpioEn, HIGH );
+          }
+        } else {
+          ledcWrite( 0, 0 );
+          ledcWrite( 1, 0 );
         }
-      } else {
-        ledcWrite( 0, 0 );
-        ledcWrite( 1, 0 );
       }
     }
 
@@ -220,117 +479,30 @@ void autosteerWorker100Hz( void* z ) {
 
     }
 
+    updateWorkswitch( false );
+
     static uint8_t loopCounter = 0;
 
     if( ++loopCounter >= 10 ) {
       loopCounter = 0;
 
+      static uint8_t aogStatusCounter = 0;
+
+      if( steerConfig.mode == SteerConfig::Mode::AgOpenGps && ++aogStatusCounter >= 10 ) {
+        aogStatusCounter = 0;
+        updateAogStatusLabel();
+      }
+
       if( initialisation.outputType != SteerConfig::OutputType::None ) {
         uint8_t data[10] = {0};
 
         if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
-          data[0] = 0x7F;
-          data[1] = 0xFD;
-
-          {
-            int16_t steerAngle = steerSetpoints.actualSteerAngle * 100;
-            data[2] = ( uint16_t )steerAngle >> 8;
-            data[3] = ( uint16_t )steerAngle;
-          }
-
-          {
-            uint16_t heading;
-
-            if( initialisation.imuType != SteerConfig::ImuType::None ) {
-              heading = ( float )steerImuInclinometerData.heading * 16;
-            } else {
-              heading = 9999;
-            }
-
-            data[4] = heading >> 8;
-            data[5] = heading;
-          }
-
-          {
-            int16_t roll;
-
-            if( initialisation.inclinoType != SteerConfig::InclinoType::None ) {
-              roll = steerImuInclinometerData.roll * 16;
-
-              if( steerConfig.invertRoll ) {
-                roll = -roll;
-              }
-            } else {
-              roll = 9999;
-            }
-
-            data[6] = ( uint16_t )roll >> 8;
-            data[7] = ( uint16_t )roll;
-          }
+          fillAogSteerData( data );
         }
 
         // read inputs
         {
           if( steerConfig.workswitchType != SteerConfig::WorkswitchType::None ) {
-            uint16_t value = 0;
-            uint16_t threshold = 0;
-            uint16_t hysteresis = 0;
-
-            switch( steerConfig.workswitchType ) {
-              case SteerConfig::WorkswitchType::Gpio:
-                value =  digitalRead( ( uint8_t )steerConfig.gpioWorkswitch ) ? 1 : 0;
-                threshold = 1;
-                hysteresis = 0;
-                break;
-
-              case SteerConfig::WorkswitchType::RearHitchPosition:
-                value = steerCanData.rearHitchPosition;
-                threshold = steerConfig.canBusHitchThreshold;
-                hysteresis = steerConfig.canBusHitchThresholdHysteresis;
-                break;
-
-              case SteerConfig::WorkswitchType::FrontHitchPosition:
-                value = steerCanData.frontHitchPosition;
-                threshold = steerConfig.canBusHitchThreshold;
-                hysteresis = steerConfig.canBusHitchThresholdHysteresis;
-                break;
-
-              case SteerConfig::WorkswitchType::RearPtoRpm:
-                value = steerCanData.rearPtoRpm;
-                threshold = steerConfig.canBusRpmThreshold;
-                hysteresis = steerConfig.canBusRpmThresholdHysteresis;
-                break;
-
-              case SteerConfig::WorkswitchType::FrontPtoRpm:
-                value = steerCanData.frontPtoRpm;
-                threshold = steerConfig.canBusRpmThreshold;
-                hysteresis = steerConfig.canBusRpmThresholdHysteresis;
-                break;
-
-              case SteerConfig::WorkswitchType::MotorRpm:
-                value = steerCanData.motorRpm;
-                threshold = steerConfig.canBusRpmThreshold;
-                hysteresis = steerConfig.canBusRpmThresholdHysteresis;
-                break;
-
-              default:
-                break;
-            }
-
-            static bool workswitchState = false;
-
-            if( value >= threshold ) {
-              workswitchState = true;
-            }
-
-            if( value < ( threshold - hysteresis ) ) {
-              workswitchState = false;
-            }
-
-            if( steerConfig.workswitchActiveLow ) {
-              workswitchState = ! workswitchState;
-            }
-
             if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
               sendStateTransmission( steerConfig.qogChannelIdWorkswitch, workswitchState );
             }
@@ -344,28 +516,26 @@ void autosteerWorker100Hz( void* z ) {
             static time_t lastRisingEdge = 0;
             static bool lastInputState = false;
 
-            static bool steerswitchState = false;
+            static bool steerswitchToggleState = false;
 
             bool currentState = digitalRead( ( uint8_t )steerConfig.gpioSteerswitch );
 
             if( currentState != lastInputState ) {
               // rising edge
               if( currentState == true ) {
-                steerswitchState = !steerswitchState;
+                steerswitchToggleState = !steerswitchToggleState;
                 lastRisingEdge = millis();
               }
 
               // falling edge
               if( currentState == false ) {
                 if( lastRisingEdge + steerConfig.autoRecogniseSteerGpioAsSwitchOrButton < millis() ) {
-                  steerswitchState = false;
+                  steerswitchToggleState = false;
                 }
               }
             }
 
-            if( steerConfig.steerswitchActiveLow ) {
-              steerswitchState = ! steerswitchState;
-            }
+            steerswitchState = steerConfig.steerswitchActiveLow ? !steerswitchToggleState : steerswitchToggleState;
 
             if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
               sendStateTransmission( steerConfig.qogChannelIdSteerswitch, steerswitchState );
@@ -384,6 +554,7 @@ void autosteerWorker100Hz( void* z ) {
       } else {
         if( ( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) &&
             ( initialisation.inclinoType !=  SteerConfig::InclinoType::None || initialisation.imuType != SteerConfig::ImuType::None ) ) {
+          SteerImuInclinometerData imuInclinometerData = steerImuInclinometerData.read();
           uint8_t data[10] = {0};
           data[0] = 0x7F;
           data[1] = 0xEE;
@@ -392,7 +563,7 @@ void autosteerWorker100Hz( void* z ) {
             uint16_t heading;
 
             if( initialisation.imuType != SteerConfig::ImuType::None ) {
-              heading = ( float )steerImuInclinometerData.heading * 16;
+              heading = ( float )imuInclinometerData.heading * 16;
             } else {
               heading = 9999;
             }
@@ -405,7 +576,7 @@ void autosteerWorker100Hz( void* z ) {
             uint16_t roll;
 
             if( initialisation.inclinoType != SteerConfig::InclinoType::None ) {
-              roll = steerImuInclinometerData.roll * 16;
+              roll = imuInclinometerData.roll * 16;
             } else {
               roll = 9999;
             }
@@ -421,69 +592,112 @@ void autosteerWorker100Hz( void* z ) {
       {
         switch( steerConfig.outputType ) {
           case SteerConfig::OutputType::SteeringMotorIBT2: {
-            Control* labelStatusOutputHandle = ESPUI.getControl( labelStatusOutput );
-            String str;
-            str.reserve( 30 );
+            WebUiLock lock( 0 );
+            Control* labelStatusOutputHandle = lock ? ESPUI.getControl( labelStatusOutput ) : nullptr;
+
+            if( labelStatusOutputHandle == nullptr ) {
+              break;
+            }
+
+            // the buffer is reserved when the WebUI is built
+            String& str = labelStatusOutputHandle->value;
             str = "IBT2 Motor, SetPoint: ";
-            str += ( float )steerSetpoints.requestedSteerAngle;
+            str += ( float )setpoints.requestedSteerAngle;
             str += "°, timeout: ";
-            str += ( bool )( steerSetpoints.lastPacketReceived < timeoutPoint );
+            str += ( bool )( setpoints.lastPacketReceived < timeoutPoint );
             str += ", enabled: ";
-            str += ( bool )steerSetpoints.enabled;
-            labelStatusOutputHandle->value = str;
+            str += ( bool )setpoints.enabled;
             labelStatusOutputHandle->color = ControlColor::Emerald;
             ESPUI.updateControlAsync( labelStatusOutputHandle );
           }
           break;
 
           case SteerConfig::OutputType::SteeringMotorCytron: {
-            Control* labelStatusOutputHandle = ESPUI.getControl( labelStatusOutput );
-            String str;
-            str.reserve( 30 );
+            WebUiLock lock( 0 );
+            Control* labelStatusOutputHandle = lock ? ESPUI.getControl( labelStatusOutput ) : nullptr;
+
+            if( labelStatusOutputHandle == nullptr ) {
+              break;
+            }
+
+            // the buffer is reserved when the WebUI is built
+            String& str = labelStatusOutputHandle->value;
             str = "Cytron Motor, SetPoint: ";
-            str += ( float )steerSetpoints.requestedSteerAngle;
+            str += ( float )setpoints.requestedSteerAngle;
             str += "°, timeout: ";
-            str += ( bool )( steerSetpoints.lastPacketReceived < timeoutPoint );
+            str += ( bool )( setpoints.lastPacketReceived < timeoutPoint );
             str += ", enabled: ";
-            str += ( bool )steerSetpoints.enabled;
-            labelStatusOutputHandle->value = str;
+            str += ( bool )setpoints.enabled;
             labelStatusOutputHandle->color = ControlColor::Emerald;
             ESPUI.updateControlAsync( labelStatusOutputHandle );
           }
           break;
 
           case SteerConfig::OutputType::HydraulicPwm2Coil: {
-            Control* labelStatusOutputHandle = ESPUI.getControl( labelStatusOutput );
-            String str;
-            str.reserve( 30 );
+            WebUiLock lock( 0 );
+            Control* labelStatusOutputHandle = lock ? ESPUI.getControl( labelStatusOutput ) : nullptr;
+
+            if( labelStatusOutputHandle == nullptr ) {
+              break;
+            }
+
+            // the buffer is reserved when the WebUI is built
+            String& str = labelStatusOutputHandle->value;
             str = "IBT2 Hydraulic PWM 2 Coil, SetPoint: ";
-            str += ( float )steerSetpoints.requestedSteerAngle;
+            str += ( float )setpoints.requestedSteerAngle;
             str += "°, timeout: ";
-            str += ( bool )( steerSetpoints.lastPacketReceived < timeoutPoint );
+            str += ( bool )( setpoints.lastPacketReceived < timeoutPoint );
             str += ", enabled: ";
-            str += ( bool )steerSetpoints.enabled;
-            labelStatusOutputHandle->value = str;
+            str += ( bool )setpoints.enabled;
             labelStatusOutputHandle->color = ControlColor::Emerald;
             ESPUI.updateControlAsync( labelStatusOutputHandle );
           }
           break;
 
           case SteerConfig::OutputType::HydraulicDanfoss: {
-            Control* labelStatusOutputHandle = ESPUI.getControl( labelStatusOutput );
-            String str;
-            str.reserve( 30 );
+            WebUiLock lock( 0 );
+            Control* labelStatusOutputHandle = lock ? ESPUI.getControl( labelStatusOutput ) : nullptr;
+
+            if( labelStatusOutputHandle == nullptr ) {
+              break;
+            }
+
+            // the buffer is reserved when the WebUI is built
+            String& str = labelStatusOutputHandle->value;
             str = "IBT2 Hydraulic Danfoss, SetPoint: ";
-            str += ( float )steerSetpoints.requestedSteerAngle;
+            str += ( float )setpoints.requestedSteerAngle;
             str += "°, timeout: ";
-            str += ( bool )( steerSetpoints.lastPacketReceived < timeoutPoint );
+            str += ( bool )( setpoints.lastPacketReceived < timeoutPoint );
             str += ", enabled: ";
-            str += ( bool )steerSetpoints.enabled;
-            labelStatusOutputHandle->value = str;
+            str += ( bool )setpoints.enabled;
             labelStatusOutputHandle->color = ControlColor::Emerald;
             ESPUI.updateControlAsync( labelStatusOutputHandle );
           }
           break;
 
+          case SteerConfig::OutputType::IsobusGuidance: {
+            WebUiLock lock( 0 );
+            Control* labelStatusOutputHandle = lock ? ESPUI.getControl( labelStatusOutput ) : nullptr;
+
+            if( labelStatusOutputHandle == nullptr ) {
+              break;
+            }
+
+            // the buffer is reserved when the WebUI is built
+            String& str = labelStatusOutputHandle->value;
+            str = "ISOBUS Guidance, SetPoint: ";
+            str += ( float )setpoints.requestedSteerAngle;
+            str += "°, timeout: ";
+            str += ( bool )( setpoints.lastPacketReceived < timeoutPoint );
+            str += ", enabled: ";
+            str += ( bool )setpoints.enabled;
+            str += ", tractor ready: ";
+            str += ( bool )( steerCanData.read().guidanceReadiness == 1 );
+            labelStatusOutputHandle->color = canTransmitReady() ? ControlColor::Emerald : ControlColor::Carrot;
+            ESPUI.updateControlAsync( labelStatusOutputHandle );
+          }
+          break;
+
           default:
             break;
 
@@ -491,6 +705,8 @@ void autosteerWorker100Hz( void* z ) {
       }
     }
 
+    taskTimingStop( TaskId::Autosteer );
+
     vTaskDelayUntil( &xLastWakeTime, xFrequency );
   }
 }
@@ -505,30 +721,41 @@ void initAutosteer() {
       initialisation.portSendTo = steerConfig.qogPortSendTo;
     }
 
+    {
+      static StaticQueue_t qogQueueBuffer;
+      static uint8_t qogQueueStorage[QogQueueSize * sizeof( QogMessage )];
+      qogQueue = xQueueCreateStatic( QogQueueSize, sizeof( QogMessage ), qogQueueStorage, &qogQueueBuffer );
+      jsonQueueSelector.addQueue( steerConfig.qogChannelIdAutosteerEnable, qogQueue );
+      jsonQueueSelector.addQueue( steerConfig.qogChannelIdSetpointSteerAngle, qogQueue );
+    }
+
     if( udpLocalPort.listen( initialisation.portListenTo ) ) {
       udpLocalPort.onPacket( []( AsyncUDPPacket packet ) {
-        std::vector<uint8_t> v;
-        v.reserve( packet.length() );
-
-        for( uint16_t i = 0; i < packet.length(); ++i ) {
-          v.push_back( packet.data()[i] );
-        }
-
-        json* j = new json;
-
         try {
-          *j = json::from_cbor( v );
+          json j = json::from_cbor( packet.data(), packet.data() + packet.length() );
 
-          if( j->is_object() ) {
-            if( j->contains( "channelId" ) ) {
+          if( j.is_object() ) {
+            if( j.contains( "channelId" ) ) {
               // valid data -> reset timeout
-              steerSetpoints.lastPacketReceived = millis();
+              steerSetpoints.update( []( SteerSetpoints & setpoints ) {
+                setpoints.lastPacketReceived = millis();
+              } );
+
+              QogMessage message = {};
+              message.channelId = j.at( "channelId" );
+
+              if( jsonQueueSelector.isValidChannelId( message.channelId ) ) {
+                if( j.contains( "state" ) ) {
+                  message.hasState = true;
+                  message.state = j.at( "state" );
+                }
 
-              uint16_t channelId = j->at( "channelId" );
+                if( j.contains( "number" ) ) {
+                  message.hasNumber = true;
+                  message.number = j.at( "number" );
+                }
 
-              if( jsonQueueSelector.isValidChannelId( channelId ) ) {
-                xQueueSend( jsonQueueSelector.getQueue( channelId ), &j, 0 );
-                return;
+                xQueueSend( jsonQueueSelector.getQueue( message.channelId ), &message, 0 );
               }
             }
           }
@@ -540,11 +767,9 @@ void initAutosteer() {
           Serial.print( e.id );
           Serial.print( ", packet.length(): " );
           Serial.println( packet.length() );
-          Serial.write( v.data(), v.size() );
+          Serial.write( packet.data(), packet.length() );
           Serial.println();
         }
-
-        delete j;
       } );
     }
   }
@@ -566,48 +791,7 @@ void initAutosteer() {
 
     if( udpLocalPort.listen( initialisation.portListenTo ) ) {
       udpLocalPort.onPacket( []( AsyncUDPPacket packet ) {
-        uint8_t* data = packet.data();
-        uint16_t pgn = data[1] + ( data[0] << 8 );
-
-        // see pgn.xlsx in https://github.com/farmerbriantee/AgOpenGPS/tree/master/AgOpenGPS_Dev
-        switch( pgn ) {
-          case 0x7FFE: {
-            steerSetpoints.relais = data[2];
-            steerSetpoints.speed = ( float )data[3] / 4;
-            steerSetpoints.distanceFromLine = data[5] + ( data[4] << 8 );
-            steerSetpoints.requestedSteerAngle = ( int16_t )( data[7] + ( data[6] << 8 ) ) / 100;
-
-            steerSetpoints.lastPacketReceived = millis();
-          }
-          break;
-
-          case 0x7FFC: {
-            steerSettings.Kp = ( float )data[2] * 1.0; // read Kp from AgOpenGPS
-            steerSettings.Ki = ( float )data[3] * 0.001; // read Ki from AgOpenGPS
-            steerSettings.Kd = ( float )data[4] * 1.0; // read Kd from AgOpenGPS
-            steerSettings.Ko = ( float )data[5] * 0.1; // read Ko from AgOpenGPS
-            steerSettings.wheelAnglePositionZero = ( int8_t )data[6]; //read steering zero offset
-            steerSettings.minPWMValue = data[7]; //read the minimum amount of PWM for instant on
-            steerSettings.maxIntegralValue = data[8] * 0.1; //
-            steerSettings.wheelAngleCountsPerDegree = data[9]; //sent as 10 times the setting displayed in AOG
-
-            steerSettings.lastPacketReceived = millis();
-          }
-          break;
-
-          case 0x7FF6: {
-            steerMachineControl.pedalControl = data[2];
-            steerMachineControl.speed = ( float )data[3] / 4;
-            steerMachineControl.relais = data[4];
-            steerMachineControl.youTurn = data[5];
-
-            steerMachineControl.lastPacketReceived = millis();
-          }
-          break;
-
-          default:
-            break;
-        }
+        aogLocalDecoder.decode( packet.data(), packet.length() );
       } );
     }
 
@@ -615,32 +799,7 @@ void initAutosteer() {
     if( initialisation.inclinoType == SteerConfig::InclinoType::None ) {
       if( udpRemotePort.listen( initialisation.portSendTo ) ) {
         udpRemotePort.onPacket( []( AsyncUDPPacket packet ) {
-          uint8_t* data = packet.data();
-          uint16_t pgn = data[1] + ( data[0] << 8 );
-
-          // see pgn.xlsx in https://github.com/farmerbriantee/AgOpenGPS/tree/master/AgOpenGPS_Dev
-          switch( pgn ) {
-            case 0x7FFD: {
-              uint16_t rollInteger = data[7] + ( data[6 << 8] );
-
-              if( rollInteger != 9999 ) {
-                steerSetpoints.receivedRoll = ( float )rollInteger / 16;
-              }
-            }
-            break;
-
-            case 0x7FEE: {
-              uint16_t rollInteger = data[7] + ( data[6 << 8] );
-
-              if( rollInteger != 9999 ) {
-                steerSetpoints.receivedRoll = ( float )rollInteger / 16;
-              }
-            }
-            break;
-
-            default:
-              break;
-          }
+          aogRemoteDecoder.decode( packet.data(), packet.length() );
         } );
       }
     }
@@ -669,81 +828,70 @@ void initAutosteer() {
 
     switch( steerConfig.outputType ) {
       case SteerConfig::OutputType::SteeringMotorIBT2: {
-        Control* labelStatusOutputHandle = ESPUI.getControl( labelStatusOutput );
-
         if( steerConfig.gpioPwm != SteerConfig::Gpio::None &&
             steerConfig.gpioDir != SteerConfig::Gpio::None &&
             steerConfig.gpioEn  != SteerConfig::Gpio::None ) {
-          labelStatusOutputHandle->value = "Output configured";
-          labelStatusOutputHandle->color = ControlColor::Emerald;
-          ESPUI.updateControlAsync( labelStatusOutputHandle );
+          updateStatusLabel( labelStatusOutput, "Output configured", ControlColor::Emerald );
 
           initialisation.outputType = SteerConfig::OutputType::SteeringMotorIBT2;
         } else {
           {
-            labelStatusOutputHandle->value = "GPIOs not correctly defined";
-            labelStatusOutputHandle->color = ControlColor::Carrot;
-            ESPUI.updateControlAsync( labelStatusOutputHandle );
+            updateStatusLabel( labelStatusOutput, "GPIOs not correctly defined", ControlColor::Carrot );
           }
         }
       }
       break;
 
       case SteerConfig::OutputType::SteeringMotorCytron: {
-        Control* labelStatusOutputHandle = ESPUI.getControl( labelStatusOutput );
-
         if( steerConfig.gpioPwm != SteerConfig::Gpio::None &&
             steerConfig.gpioDir != SteerConfig::Gpio::None ) {
-          labelStatusOutputHandle->value = "Output configured";
-          labelStatusOutputHandle->color = ControlColor::Emerald;
-          ESPUI.updateControlAsync( labelStatusOutputHandle );
+          updateStatusLabel( labelStatusOutput, "Output configured", ControlColor::Emerald );
 
           initialisation.outputType = SteerConfig::OutputType::SteeringMotorCytron;
         } else {
           {
-            labelStatusOutputHandle->value = "GPIOs not correctly defined";
-            labelStatusOutputHandle->color = ControlColor::Carrot;
-            ESPUI.updateControlAsync( labelStatusOutputHandle );
+            updateStatusLabel( labelStatusOutput, "GPIOs not correctly defined", ControlColor::Carrot );
           }
         }
       }
       break;
 
       case SteerConfig::OutputType::HydraulicPwm2Coil: {
-        Control* labelStatusOutputHandle = ESPUI.getControl( labelStatusOutput );
-
         if( steerConfig.gpioPwm != SteerConfig::Gpio::None &&
             steerConfig.gpioDir != SteerConfig::Gpio::None ) {
-          labelStatusOutputHandle->value = "Output configured";
-          labelStatusOutputHandle->color = ControlColor::Emerald;
-          ESPUI.updateControlAsync( labelStatusOutputHandle );
+          updateStatusLabel( labelStatusOutput, "Output configured", ControlColor::Emerald );
 
           initialisation.outputType = SteerConfig::OutputType::HydraulicPwm2Coil;
         } else {
           {
-            labelStatusOutputHandle->value = "GPIOs not correctly defined";
-            labelStatusOutputHandle->color = ControlColor::Carrot;
-            ESPUI.updateControlAsync( labelStatusOutputHandle );
+            updateStatusLabel( labelStatusOutput, "GPIOs not correctly defined", ControlColor::Carrot );
           }
         }
       }
       break;
 
       case SteerConfig::OutputType::HydraulicDanfoss: {
-        Control* labelStatusOutputHandle = ESPUI.getControl( labelStatusOutput );
-
         if( steerConfig.gpioPwm != SteerConfig::Gpio::None &&
             steerConfig.gpioDir != SteerConfig::Gpio::None ) {
-          labelStatusOutputHandle->value = "Output configured";
-          labelStatusOutputHandle->color = ControlColor::Emerald;
-          ESPUI.updateControlAsync( labelStatusOutputHandle );
+          updateStatusLabel( labelStatusOutput, "Output configured", ControlColor::Emerald );
 
           initialisation.outputType = SteerConfig::OutputType::HydraulicDanfoss;
         } else {
           {
-            labelStatusOutputHandle->value = "GPIOs not correctly defined";
-            labelStatusOutputHandle->color = ControlColor::Carrot;
-            ESPUI.updateControlAsync( labelStatusOutputHandle );
+            updateStatusLabel( labelStatusOutput, "GPIOs not correctly defined", ControlColor::Carrot );
+          }
+        }
+      }
+      break;
+
+      case SteerConfig::OutputType::IsobusGuidance: {
+        if( steerConfig.canBusEnabled && steerConfig.wheelbase > 0 ) {
+          updateStatusLabel( labelStatusOutput, "Output configured", ControlColor::Emerald );
+
+          initialisation.outputType = SteerConfig::OutputType::IsobusGuidance;
+        } else {
+          {
+            updateStatusLabel( labelStatusOutput, "CAN BUS not enabled or no wheelbase set", ControlColor::Carrot );
           }
         }
       }
@@ -763,6 +911,6 @@ void initAutosteer() {
     pinMode( ( uint8_t )steerConfig.gpioSteerswitch, INPUT_PULLUP );
   }
 
-  xTaskCreate( autosteerWorker100Hz, "autosteerWorker", 3096, NULL, 3, NULL );
+  createTask( TaskId::Autosteer, autosteerWorker100Hz );
 }
 
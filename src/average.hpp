@@ -28,50 +28,206 @@
 #pragma once
 
 #include <stdint.h>
-#include <string.h>
 #include <stddef.h>
 
+#include <type_traits>
+
+// Moving average over the last Size values, the sum is kept up to date with every new value, so
+// reading the average doesn't depend on Size. Like before, the buffer starts filled with zeros.
+// The sum of floating point values drifts with the rounding errors, so it is recalculated every
+// time the buffer wraps around.
 template <class T, class Tcalc, size_t Size>
 class Average {
-
-  private:
-    // Pointer zum Puffer
-    T* Buffer;
-
-    // Lese- und Schreibe-Pointer
-    T* writePointer;
+    static_assert( Size != 0, "an Average needs at least one value" );
 
   public:
-
     Average() {
-      writePointer = Buffer = new T[Size];
       flush();
     }
 
-    ~Average() {
-      delete Buffer;
+    void operator+=( const T c ) {
+      sum += ( Tcalc )c - ( Tcalc )buffer[index];
+      buffer[index] = c;
+
+      // Überlauf
+      if( ++index >= Size ) {
+        index = 0;
+
+        if( std::is_floating_point<Tcalc>::value ) {
+          recalculateSum();
+        }
+      }
+    }
+
+    operator T() const {
+      return sum / ( Tcalc )Size;
+    }
+
+    void flush() {
+      for( size_t i = 0; i < Size; ++i ) {
+        buffer[i] = 0;
+      }
+
+      index = 0;
+      sum = 0;
+    }
+
+  private:
+    void recalculateSum() {
+      sum = 0;
+
+      for( size_t i = 0; i < Size; ++i ) {
+        sum += buffer[i];
+      }
+    }
+
+    T buffer[Size];
+    size_t index;
+    Tcalc sum;
+};
+
+// Statistics over the last Size values: mean, variance, minimum and maximum, all of them in O(1).
+// Unlike Average, only the values added since the last flush() are counted.
+// The minimum and maximum are kept in monotonic queues: a new value removes all the values which
+// can't become the minimum/maximum anymore, so the front of the queue is always the result.
+template <class T, class Tcalc, size_t Size>
+class MovingStatistics {
+    static_assert( Size != 0, "MovingStatistics need at least one value" );
+
+  public:
+    MovingStatistics() {
+      flush();
     }
 
     void operator+=( const T c ) {
-      *writePointer++ = c;
+      if( count == Size ) {
+        Tcalc oldest = buffer[index];
+        sum -= oldest;
+        sumOfSquares -= oldest * oldest;
+      } else {
+        ++count;
+      }
 
-      // Überlauf
-      if( writePointer >= &( Buffer[Size] ) ) {
-        writePointer = Buffer;
+      buffer[index] = c;
+      sum += c;
+      sumOfSquares += ( Tcalc )c * ( Tcalc )c;
+
+      minimums.add( c, sequence );
+      maximums.add( c, sequence );
+      ++sequence;
+
+      if( ++index >= Size ) {
+        index = 0;
+
+        if( std::is_floating_point<Tcalc>::value ) {
+          recalculateSums();
+        }
       }
     }
 
-    operator T() {
-      Tcalc avg = 0;
+    size_t size() const {
+      return count;
+    }
+
+    bool isEmpty() const {
+      return count == 0;
+    }
 
-      for( T* ptr = Buffer; ptr <= &( Buffer[Size - 1] ); ptr++ ) {
-        avg += *ptr;
+    Tcalc mean() const {
+      return count ? sum / ( Tcalc )count : 0;
+    }
+
+    // variance of the population
+    Tcalc variance() const {
+      if( count == 0 ) {
+        return 0;
       }
 
-      return avg / Size;
+      Tcalc average = mean();
+      Tcalc variance = sumOfSquares / ( Tcalc )count - average * average;
+
+      // can get slightly negative with the rounding errors
+      return variance > 0 ? variance : 0;
+    }
+
+    T min() const {
+      return minimums.front();
+    }
+
+    T max() const {
+      return maximums.front();
     }
 
     void flush() {
-      memset( Buffer, 0, Size * sizeof( T ) );
+      count = 0;
+      index = 0;
+      sequence = 0;
+      sum = 0;
+      sumOfSquares = 0;
+      minimums.flush();
+      maximums.flush();
     }
+
+  private:
+    // Greater == false: the front is the minimum, true: the maximum
+    template<bool Greater>
+    class MonotonicQueue {
+      public:
+        void add( const T c, uint32_t sequence ) {
+          // the values at the back, which are worse than the new one, are never the result again
+          while( length && ( Greater ? !( values[back()] > c ) : !( values[back()] < c ) ) ) {
+            --length;
+          }
+
+          // the value at the front drops out of the window
+          if( length && sequence - sequences[head] >= Size ) {
+            head = ( head + 1 ) % Size;
+            --length;
+          }
+
+          size_t position = ( head + length ) % Size;
+          values[position] = c;
+          sequences[position] = sequence;
+          ++length;
+        }
+
+        T front() const {
+          return length ? values[head] : 0;
+        }
+
+        void flush() {
+          head = 0;
+          length = 0;
+        }
+
+      private:
+        size_t back() const {
+          return ( head + length - 1 ) % Size;
+        }
+
+        T values[Size];
+        uint32_t sequences[Size];
+        size_t head;
+        size_t length;
+    };
+
+    void recalculateSums() {
+      sum = 0;
+      sumOfSquares = 0;
+
+      for( size_t i = 0; i < count; ++i ) {
+        sum += buffer[i];
+        sumOfSquares += ( Tcalc )buffer[i] * ( Tcalc )buffer[i];
+      }
+    }
+
+    T buffer[Size];
+    size_t count;
+    size_t index;
+    uint32_t sequence;
+    Tcalc sum;
+    Tcalc sumOfSquares;
+
+    MonotonicQueue<false> minimums;
+    MonotonicQueue<true> maximums;
 };
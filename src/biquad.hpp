@@ -0,0 +1,167 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stddef.h>
+#include <math.h>
+
+// Coefficients of one second order section, normalised to a0 = 1. The Butterworth-sections are
+// designed with the bilinear transform (prewarped), so they follow the sample rate given at runtime.
+struct BiquadCoefficients {
+  float b0 = 1;
+  float b1 = 0;
+  float b2 = 0;
+  float a1 = 0;
+  float a2 = 0;
+
+  static BiquadCoefficients lowPass( float cutoff, float sampleRate, float q = M_SQRT1_2 ) {
+    BiquadCoefficients c;
+    float k = tanf( M_PI * cutoff / sampleRate );
+    float norm = 1 / ( 1 + k / q + k * k );
+    c.b0 = k * k * norm;
+    c.b1 = 2 * c.b0;
+    c.b2 = c.b0;
+    c.a1 = 2 * ( k * k - 1 ) * norm;
+    c.a2 = ( 1 - k / q + k * k ) * norm;
+    return c;
+  }
+
+  static BiquadCoefficients highPass( float cutoff, float sampleRate, float q = M_SQRT1_2 ) {
+    BiquadCoefficients c;
+    float k = tanf( M_PI * cutoff / sampleRate );
+    float norm = 1 / ( 1 + k / q + k * k );
+    c.b0 = norm;
+    c.b1 = -2 * norm;
+    c.b2 = norm;
+    c.a1 = 2 * ( k * k - 1 ) * norm;
+    c.a2 = ( 1 - k / q + k * k ) * norm;
+    return c;
+  }
+
+  // first order, the second half of the section is unused
+  static BiquadCoefficients lowPassFirstOrder( float cutoff, float sampleRate ) {
+    BiquadCoefficients c;
+    float k = tanf( M_PI * cutoff / sampleRate );
+    float norm = 1 / ( 1 + k );
+    c.b0 = k * norm;
+    c.b1 = c.b0;
+    c.a1 = ( k - 1 ) * norm;
+    return c;
+  }
+
+  static BiquadCoefficients highPassFirstOrder( float cutoff, float sampleRate ) {
+    BiquadCoefficients c;
+    float k = tanf( M_PI * cutoff / sampleRate );
+    float norm = 1 / ( 1 + k );
+    c.b0 = norm;
+    c.b1 = -norm;
+    c.a1 = ( k - 1 ) * norm;
+    return c;
+  }
+};
+
+// Cascade of second order sections in transposed direct form II, for Channels values sharing the same
+// coefficients (e.g. the three axes of a sensor). A Butterworth-filter of order 2 * Sections is built with
+// butterworthLowPass()/butterworthHighPass(); until then, the filter passes the values unchanged.
+template<size_t Sections, size_t Channels = 1>
+class BiquadCascade {
+  public:
+    BiquadCascade() {
+      reset();
+    }
+
+    void setCoefficients( size_t section, const BiquadCoefficients& coefficients ) {
+      this->coefficients[section] = coefficients;
+    }
+
+    void butterworthLowPass( float cutoff, float sampleRate ) {
+      for( size_t i = 0; i < Sections; ++i ) {
+        coefficients[i] = BiquadCoefficients::lowPass( cutoff, sampleRate, butterworthQ( i ) );
+      }
+    }
+
+    void butterworthHighPass( float cutoff, float sampleRate ) {
+      for( size_t i = 0; i < Sections; ++i ) {
+        coefficients[i] = BiquadCoefficients::highPass( cutoff, sampleRate, butterworthQ( i ) );
+      }
+    }
+
+    // sets the state as if the value had been applied forever, avoids the transient at the start
+    void reset( float value = 0 ) {
+      for( size_t channel = 0; channel < Channels; ++channel ) {
+        float x = value;
+
+        for( size_t i = 0; i < Sections; ++i ) {
+          const BiquadCoefficients& c = coefficients[i];
+          float y = x * ( c.b0 + c.b1 + c.b2 ) / ( 1 + c.a1 + c.a2 );
+          z2[i][channel] = c.b2 * x - c.a2 * y;
+          z1[i][channel] = y - c.b0 * x;
+          x = y;
+        }
+      }
+    }
+
+    // for a single channel
+    float step( float x ) {
+      static_assert( Channels == 1, "use step( float* ) for more than one channel" );
+      step( &x );
+      return x;
+    }
+
+    // filters all the channels in place
+    void step( float* values ) {
+      for( size_t i = 0; i < Sections; ++i ) {
+        const BiquadCoefficients& c = coefficients[i];
+
+        for( size_t channel = 0; channel < Channels; ++channel ) {
+          float x = values[channel];
+          float y = c.b0 * x + z1[i][channel];
+          z1[i][channel] = c.b1 * x - c.a1 * y + z2[i][channel];
+          z2[i][channel] = c.b2 * x - c.a2 * y;
+          values[channel] = y;
+        }
+      }
+    }
+
+    void step( float& x, float& y, float& z ) {
+      static_assert( Channels == 3, "only for three channels" );
+      float values[3] = { x, y, z };
+      step( values );
+      x = values[0];
+      y = values[1];
+      z = values[2];
+    }
+
+  private:
+    // the poles of a Butterworth-filter of order 2 * Sections, split into pairs
+    static float butterworthQ( size_t section ) {
+      return 1 / ( 2 * cosf( M_PI * ( 2 * section + 1 ) / ( 4 * Sections ) ) );
+    }
+
+    BiquadCoefficients coefficients[Sections];
+    float z1[Sections][Channels];
+    float z2[Sections][Channels];
+};
+
+template<size_t Sections>
+using BiquadCascade3 = BiquadCascade<Sections, 3>;
@@ -23,6 +23,11 @@
 #include <ESPUI.h>
 #include <ESP32CAN.h>
 #include <CAN_config.h>
+#include <can_regdef.h>
+
+#include <esp_timer.h>
+
+#include <atomic>
 
 #include "main.hpp"
 #include "jsonFunctions.hpp"
@@ -36,7 +41,9 @@ constexpr uint8_t  IsobusPgPos   = 8;
 constexpr uint32_t IsobusPgnMask = 0x03FFFF;
 
 constexpr uint16_t j1939PgnEEC1 = 61444;
+constexpr uint16_t j1939PgnEEC2 = 61443;
 constexpr uint16_t j1939PgnWBSD = 65096;
+constexpr uint16_t j1939PgnGBSD = 65097;
 
 constexpr uint16_t j1939PgnPHS = 65093;
 constexpr uint16_t j1939PgnFHS = 65094;
@@ -44,110 +51,898 @@ constexpr uint16_t j1939PgnFHS = 65094;
 constexpr uint16_t j1939PgnRPTO = 65091;
 constexpr uint16_t j1939PgnFPTO = 65092;
 
+constexpr uint16_t j1939PgnAddressClaimed = 60928;
+constexpr uint16_t j1939PgnRequest = 59904;
+
+// ISO 11783-7: Guidance Machine Info is sent by the tractor, Guidance System Command by the guidance system
+constexpr uint16_t isobusPgnGuidanceMachineInfo = 44032;
+constexpr uint16_t isobusPgnGuidanceSystemCommand = 44288;
+
+// J1939: "null address" of an ECU which couldn't claim an address, and the global address
+constexpr uint8_t j1939AddressNull = 254;
+constexpr uint8_t j1939AddressGlobal = 255;
+
+// PDU1-format (PDU format < 240): the PDU specific field is the destination address, not part of the PGN
+static uint32_t j1939Pgn( uint32_t id ) {
+  uint32_t pgn = ( id >> IsobusPgPos ) & IsobusPgnMask;
+
+  if( ( ( pgn >> 8 ) & 0xFF ) < 0xF0 ) {
+    pgn &= ~0xFFUL;
+  }
+
+  return pgn;
+}
+
 // see https://gurtam.com/files/ftp/CAN/ (especialy J1939.zip)
 
-void canWorker10Hz( void* z ) {
-  constexpr TickType_t xFrequency = 100;
+// Signal database: every signal is described by its PGN, the position in the data of the frame
+// and the scaling. J1939 transmits little endian, the start bit counts from the LSB of the first byte.
+struct CanSignal {
+  uint32_t pgn;
+  uint8_t startBit;
+  uint8_t length;
+  float scale;
+  float offset;
+  float SteerCanData::* destination;
+  // channel to send the value to in QtOpenGuidance, nullptr if not sent
+  uint16_t SteerConfig::* qogChannel;
+};
+
+static constexpr CanSignal canSignals[] = {
+  // Electronic Engine Controller 2: Engine Percent Load At Current Speed
+  { j1939PgnEEC2, 16, 8, 1, 0, &SteerCanData::engineLoad, nullptr },
+  // Electronic Engine Controller 1: Engine Speed
+  { j1939PgnEEC1, 24, 16, 0.125f, 0, &SteerCanData::motorRpm, &SteerConfig::qogChannelIdCanMotorRpm },
+  // Primary or Rear Power Take off Output Shaft: Output Shaft Speed
+  { j1939PgnRPTO, 0, 16, 0.125f, 0, &SteerCanData::rearPtoRpm, &SteerConfig::qogChannelIdCanRearPtoRpm },
+  // Secondary or Front Power Take off Output Shaft: Output Shaft Speed
+  { j1939PgnFPTO, 0, 16, 0.125f, 0, &SteerCanData::frontPtoRpm, &SteerConfig::qogChannelIdCanFrontPtoRpm },
+  // Primary or Rear Hitch Status: Hitch Position, raw (0.4%/bit), the thresholds are configured in this unit
+  { j1939PgnPHS, 0, 8, 1, 0, &SteerCanData::rearHitchPosition, &SteerConfig::qogChannelIdCanRearHitch },
+  // Secondary or Front Hitch Status: Hitch Position, raw (0.4%/bit)
+  { j1939PgnFHS, 0, 8, 1, 0, &SteerCanData::frontHitchPosition, &SteerConfig::qogChannelIdCanFrontHitch },
+  // Wheel-based Speed and Distance: Wheel-based Machine Speed, 0.001 m/s per bit, in km/h
+  { j1939PgnWBSD, 0, 16, 0.001f * 3.6f, 0, &SteerCanData::speed, &SteerConfig::qogChannelIdCanWheelbasedSpeed },
+  // Ground-based Speed and Distance: Ground-based Machine Speed, 0.001 m/s per bit, in km/h
+  { j1939PgnGBSD, 0, 16, 0.001f * 3.6f, 0, &SteerCanData::groundSpeed, nullptr },
+  // Guidance Machine Info: Estimated Curvature, 0.25 1/km per bit
+  { isobusPgnGuidanceMachineInfo, 0, 16, 0.25f, -8032, &SteerCanData::guidanceCurvature, nullptr },
+  // Guidance Machine Info: Mechanical System Lockout, bits 0-1 of byte 2
+  { isobusPgnGuidanceMachineInfo, 16, 2, 1, 0, &SteerCanData::guidanceLockout, nullptr },
+  // Guidance Machine Info: Guidance Steering System Readiness State, bits 2-3 of byte 2; 4-5 and 6-7 are
+  // the Steering Input Position Status and the Request Reset Command Status
+  { isobusPgnGuidanceMachineInfo, 18, 2, 1, 0, &SteerCanData::guidanceReadiness, nullptr }
+};
+
+constexpr uint8_t canSignalsCount = sizeof( canSignals ) / sizeof( canSignals[0] );
+
+// the distinct PGNs of canSignals plus the network management, the acceptance filter of the controller is calculated from them
+constexpr uint8_t canPgnsMax = canSignalsCount + 2;
+static uint32_t canPgns[canPgnsMax];
+static uint8_t canPgnsCount = 0;
+
+// frames passed the acceptance filter and were decoded or discarded
+static uint32_t canFramesDecoded = 0;
+static uint32_t canFramesDiscarded = 0;
+
+// Transmit queue, ordered by the J1939-priority (0 is the most important) and FIFO within the same priority.
+// The other tasks only queue the frames, canTxWorker writes them into the transmit buffer of the controller.
+constexpr uint8_t CanTxQueueSize = 8;
+static CAN_frame_t canTxQueue[CanTxQueueSize];
+static uint8_t canTxQueueCount = 0;
+static SemaphoreHandle_t canTxMutex = nullptr;
+
+static uint32_t canFramesSent = 0;
+static uint32_t canFramesTxDropped = 0;
+
+static uint8_t j1939Priority( const CAN_frame_t& canFrame ) {
+  return ( canFrame.MsgID >> 26 ) & 0x07;
+}
+
+// a full queue drops the least important frame
+static bool queueCanFrame( const CAN_frame_t& canFrame ) {
+  uint8_t priority = j1939Priority( canFrame );
+  bool queued = false;
+
+  xSemaphoreTake( canTxMutex, portMAX_DELAY );
+
+  if( canTxQueueCount == CanTxQueueSize ) {
+    if( j1939Priority( canTxQueue[CanTxQueueSize - 1] ) > priority ) {
+      --canTxQueueCount;
+    }
+
+    ++canFramesTxDropped;
+  }
+
+  if( canTxQueueCount < CanTxQueueSize ) {
+    uint8_t position = canTxQueueCount;
+
+    while( position > 0 && j1939Priority( canTxQueue[position - 1] ) > priority ) {
+      canTxQueue[position] = canTxQueue[position - 1];
+      --position;
+    }
+
+    canTxQueue[position] = canFrame;
+    ++canTxQueueCount;
+    queued = true;
+  }
+
+  xSemaphoreGive( canTxMutex );
+
+  return queued;
+}
+
+static bool dequeueCanFrame( CAN_frame_t& canFrame ) {
+  bool dequeued = false;
+
+  xSemaphoreTake( canTxMutex, portMAX_DELAY );
+
+  if( canTxQueueCount ) {
+    canFrame = canTxQueue[0];
+    --canTxQueueCount;
+    memmove( &canTxQueue[0], &canTxQueue[1], canTxQueueCount * sizeof( CAN_frame_t ) );
+    dequeued = true;
+  }
+
+  xSemaphoreGive( canTxMutex );
 
+  return dequeued;
+}
+
+// extended frame with 8 bytes, the unused ones are "not available" (0xFF)
+static void buildJ1939Frame( CAN_frame_t& canFrame, uint8_t priority, uint32_t pgn, uint8_t destination, uint8_t source ) {
+  uint32_t id = ( ( uint32_t )priority << 26 ) | ( pgn << IsobusPgPos ) | source;
+
+  if( ( ( pgn >> 8 ) & 0xFF ) < 0xF0 ) {
+    id |= ( uint32_t )destination << 8;
+  }
+
+  canFrame.FIR.U = 0;
+  canFrame.FIR.B.FF = CAN_frame_ext;
+  canFrame.FIR.B.DLC = 8;
+  canFrame.MsgID = id;
+  canFrame.data.u64 = UINT64_MAX;
+}
+
+// Address claiming (ISO 11783-5) with a fixed address: the ECU with the lower NAME keeps the address,
+// the other one announces that it can't claim one and stays silent.
+enum class CanAddressState : uint8_t {
+  None = 0,
+  Claimed,
+  Lost
+};
+static volatile CanAddressState canAddressState = CanAddressState::None;
+static uint32_t canAddressClaimTime = 0;
+
+// other messages may be sent 250ms after the claim at the earliest
+constexpr uint32_t CanAddressClaimDelay = 250;
+
+// NAME: identity number from the MAC, function 130 and vehicle system 1 in the agricultural industry group (2),
+// not arbitrary address capable
+constexpr uint64_t CanNameFunction = 130;
+constexpr uint64_t CanNameVehicleSystem = 1;
+constexpr uint64_t CanNameIndustryGroup = 2;
+static uint64_t canOwnName = 0;
+
+static void sendAddressClaim( uint8_t address ) {
   CAN_frame_t canFrame;
+  buildJ1939Frame( canFrame, 6, j1939PgnAddressClaimed, j1939AddressGlobal, address );
+  canFrame.data.u64 = canOwnName;
+  queueCanFrame( canFrame );
+}
 
-  while( 1 ) {
-    if( xQueueReceive( CAN_cfg.rx_queue, &canFrame, xFrequency ) == pdTRUE ) {
-      if( canFrame.FIR.B.FF == CAN_frame_ext ) {
+// another ECU claimed the own address
+static void handleOwnAddressClaimed( uint64_t name ) {
+  if( canAddressState != CanAddressState::Claimed ) {
+    return;
+  }
+
+  if( name < canOwnName ) {
+    canAddressState = CanAddressState::Lost;
+    sendAddressClaim( j1939AddressNull );
+  } else {
+    sendAddressClaim( steerConfig.canBusSourceAddress );
+  }
+}
 
-        uint16_t pgn = ( canFrame.MsgID >> IsobusPgPos ) & IsobusPgnMask;
+// Request: only the one for the Address Claimed is answered
+static void handleRequest( const CAN_frame_t& canFrame ) {
+  uint8_t destination = ( canFrame.MsgID >> 8 ) & 0xFF;
 
-        switch( pgn ) {
+  if( canAddressState == CanAddressState::None || canFrame.FIR.B.DLC < 3 ||
+      ( destination != j1939AddressGlobal && destination != steerConfig.canBusSourceAddress ) ) {
+    return;
+  }
 
-          // Electronic Engine Controller 1
-          case j1939PgnEEC1: {
-            steerCanData.motorRpm = ( canFrame.data.u8[4] << 8 | canFrame.data.u8[3] ) / 8;
+  uint32_t pgn = canFrame.data.u8[0] | ( canFrame.data.u8[1] << 8 ) | ( ( uint32_t )canFrame.data.u8[2] << 16 );
 
-            if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
-              sendNumberTransmission( steerConfig.qogChannelIdCanMotorRpm, steerCanData.motorRpm );
-            }
-          }
-          break;
+  if( pgn == j1939PgnAddressClaimed ) {
+    sendAddressClaim( canAddressState == CanAddressState::Claimed ? steerConfig.canBusSourceAddress : j1939AddressNull );
+  }
+}
 
-          // Wheel-based Speed and Distance
-          case j1939PgnWBSD: {
-            steerCanData.speed = ( canFrame.data.u8[1] << 8 | canFrame.data.u8[0] ) / 1000 * 3.6;
+bool canTransmitReady() {
+  return canAddressState == CanAddressState::Claimed && ( millis() - canAddressClaimTime ) >= CanAddressClaimDelay;
+}
 
-            if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
-              sendNumberTransmission( steerConfig.qogChannelIdCanWheelbasedSpeed, steerCanData.speed );
-            }
-          }
-          break;
+// Guidance System Command, packed so it can be set from the autosteer-task without locking:
+// curvature in the bits 0..15, the command status in 16..17 and bit 31 set, if it is to be sent at all
+static std::atomic<uint32_t> canGuidanceCommand( 0 );
+constexpr uint32_t CanGuidanceCommandValid = 1UL << 31;
 
-          // Primary or Rear Hitch Status
-          case j1939PgnPHS: {
-            steerCanData.rearHitchPosition = canFrame.data.u8[0];
+void canSetGuidanceCommand( float curvature, bool intendedToSteer ) {
+  // 0.25 1/km per bit, offset -8032 1/km, the highest values are reserved
+  float raw = ( curvature + 8032 ) * 4;
+  raw = constrain( raw, 0, 0xFAFF );
 
-            if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
-              sendNumberTransmission( steerConfig.qogChannelIdCanRearHitch, steerCanData.rearHitchPosition );
-            }
-          }
+  canGuidanceCommand = CanGuidanceCommandValid | ( intendedToSteer ? ( 1UL << 16 ) : 0 ) | ( uint16_t )raw;
+}
 
-          break;
+static bool fillGuidanceSystemCommand( CAN_frame_t& canFrame ) {
+  uint32_t command = canGuidanceCommand;
 
-          // Secondary or Front Hitch Status
-          case j1939PgnFHS: {
-            steerCanData.frontHitchPosition = canFrame.data.u8[0];
+  if( !( command & CanGuidanceCommandValid ) ) {
+    return false;
+  }
 
-            if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
-              sendNumberTransmission( steerConfig.qogChannelIdCanFrontHitch, steerCanData.frontHitchPosition );
-            }
-          }
-          break;
+  buildJ1939Frame( canFrame, 3, isobusPgnGuidanceSystemCommand, j1939AddressGlobal, steerConfig.canBusSourceAddress );
+  canFrame.data.u8[0] = command;
+  canFrame.data.u8[1] = command >> 8;
+  // Curvature Command Status in the lowest two bits, the rest is reserved
+  canFrame.data.u8[2] = 0xFC | ( ( command >> 16 ) & 0x03 );
 
-          // Primary or Rear Power Take off Output Shaft
-          case j1939PgnRPTO: {
-            steerCanData.rearPtoRpm = canFrame.data.u8[1] << 8 | canFrame.data.u8[0];
+  return true;
+}
 
-            if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
-              sendNumberTransmission( steerConfig.qogChannelIdCanRearPtoRpm, steerCanData.rearPtoRpm );
-            }
-          }
-          break;
+// Periodically sent messages: the function fills in the frame, and returns false if there is nothing to send
+struct CanTxPeriodic {
+  uint32_t interval;
+  bool ( *fill )( CAN_frame_t& canFrame );
+};
+
+static const CanTxPeriodic canTxPeriodic[] = {
+  { 100, fillGuidanceSystemCommand }
+};
+
+constexpr uint8_t canTxPeriodicCount = sizeof( canTxPeriodic ) / sizeof( canTxPeriodic[0] );
+
+void canTxWorker( void* z ) {
+  constexpr TickType_t xFrequency = 5;
+  TickType_t xLastWakeTime = xTaskGetTickCount();
+
+  uint32_t nextTransmission[canTxPeriodicCount] = { 0 };
+  CAN_frame_t canFrame;
+
+  while( 1 ) {
+    taskTimingStart( TaskId::CanTx );
+
+    uint32_t now = millis();
 
-          // Secondary or Front Power Take off Output Shaft
-          case j1939PgnFPTO: {
-            steerCanData.frontPtoRpm = canFrame.data.u8[1] << 8 | canFrame.data.u8[0];
+    if( canTransmitReady() ) {
+      for( uint8_t i = 0; i < canTxPeriodicCount; ++i ) {
+        if( ( int32_t )( now - nextTransmission[i] ) >= 0 ) {
+          // keep the period without drift, but don't send a burst after a pause
+          nextTransmission[i] += canTxPeriodic[i].interval;
+
+          if( ( int32_t )( now - nextTransmission[i] ) >= 0 ) {
+            nextTransmission[i] = now + canTxPeriodic[i].interval;
+          }
 
-            if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
-              sendNumberTransmission( steerConfig.qogChannelIdCanFrontPtoRpm, steerCanData.frontPtoRpm );
-            }
+          if( canTxPeriodic[i].fill( canFrame ) ) {
+            queueCanFrame( canFrame );
           }
-          break;
         }
       }
     }
 
+    // the controller has only one transmit buffer; nothing is sent while it is bus-off
+    if( MODULE_CAN->SR.B.TBS && !MODULE_CAN->SR.B.BS && dequeueCanFrame( canFrame ) ) {
+      ESP32Can.CANWriteFrame( &canFrame );
+      ++canFramesSent;
+    }
+
+    taskTimingStop( TaskId::CanTx );
+
+    vTaskDelayUntil( &xLastWakeTime, xFrequency );
+  }
+}
+
+// The ECUs seen on the bus, with the NAME they claimed their address with.
+// canSourceIndex maps the source address to the slot, so the lookup is O(1).
+struct CanSource {
+  uint8_t address;
+  bool claimed;
+  uint64_t name;
+  uint32_t frames;
+  uint32_t lastSeen;
+};
+
+constexpr uint8_t CanSourcesMax = 16;
+constexpr uint8_t CanSourceUnknown = 0xFF;
+static CanSource canSources[CanSourcesMax];
+static uint8_t canSourcesCount = 0;
+static uint8_t canSourceIndex[256];
+
+// the source address each signal is taken from; it changes only if that source is silent for this long
+constexpr uint32_t CanSourceTimeout = 1000;
+static uint8_t canSignalSource[canSignalsCount];
+static uint32_t canSignalLastUpdate[canSignalsCount];
+
+static CanSource* getCanSource( uint8_t address ) {
+  uint8_t index = canSourceIndex[address];
+
+  if( index == CanSourceUnknown ) {
+    if( canSourcesCount >= CanSourcesMax ) {
+      return nullptr;
+    }
+
+    index = canSourcesCount++;
+    canSourceIndex[address] = index;
+
+    CanSource& source = canSources[index];
+    source.address = address;
+    source.claimed = false;
+    source.name = 0;
+    source.frames = 0;
+  }
+
+  return &canSources[index];
+}
+
+// Address Claimed: the NAME is in the data, the claimed address is the source address
+static void handleAddressClaim( const CAN_frame_t& canFrame, uint8_t address ) {
+  if( address == j1939AddressNull || address == j1939AddressGlobal || canFrame.FIR.B.DLC < 8 ) {
+    return;
+  }
+
+  uint64_t name = canFrame.data.u64;
+
+  if( address == steerConfig.canBusSourceAddress ) {
+    handleOwnAddressClaimed( name );
+  }
+
+  // the ECU moved to another address, so forget the old one
+  for( uint8_t i = 0; i < canSourcesCount; ++i ) {
+    if( canSources[i].claimed && canSources[i].name == name && canSources[i].address != address ) {
+      canSources[i].claimed = false;
+    }
+  }
+
+  CanSource* source = getCanSource( address );
+
+  if( source != nullptr ) {
+    source->claimed = true;
+    source->name = name;
+  }
+}
+
+// take the signal from the preferred source, or stick to the first one sending it
+static bool acceptCanSignalSource( uint8_t signalIndex, uint8_t address, uint32_t now ) {
+  if( steerConfig.canBusPreferredSourceAddress != j1939AddressGlobal ) {
+    return address == steerConfig.canBusPreferredSourceAddress;
+  }
+
+  if( canSignalSource[signalIndex] == address ||
+      canSignalSource[signalIndex] == CanSourceUnknown ||
+      ( now - canSignalLastUpdate[signalIndex] ) > CanSourceTimeout ) {
+    canSignalSource[signalIndex] = address;
+    return true;
+  }
+
+  return false;
+}
+
+// J1939 reserves the highest values of a parameter for "error" and "not available"
+static bool canSignalValid( uint32_t raw, uint8_t length ) {
+  uint32_t max = ( length < 32 ) ? ( ( 1UL << length ) - 1 ) : UINT32_MAX;
+
+  if( length < 8 ) {
+    return raw <= ( max - 2 );
+  }
+
+  return raw <= ( max - ( 5UL << ( length - 8 ) ) );
+}
+
+// decode all signals of the frame, returns false if none is in the database
+static bool decodeCanFrame( const CAN_frame_t& canFrame ) {
+  uint32_t pgn = j1939Pgn( canFrame.MsgID );
+  uint8_t address = canFrame.MsgID & 0xFF;
+  uint8_t bitsInFrame = canFrame.FIR.B.DLC * 8;
+  uint32_t now = millis();
+  bool found = false;
+
+  {
+    CanSource* source = getCanSource( address );
+
+    if( source != nullptr ) {
+      ++source->frames;
+      source->lastSeen = now;
+    }
+  }
+
+  if( pgn == j1939PgnAddressClaimed ) {
+    handleAddressClaim( canFrame, address );
+    return true;
+  }
+
+  if( pgn == j1939PgnRequest ) {
+    handleRequest( canFrame );
+    return true;
+  }
+
+  for( uint8_t i = 0; i < canSignalsCount; ++i ) {
+    const CanSignal& signal = canSignals[i];
+
+    if( signal.pgn != pgn ) {
+      continue;
+    }
+
+    found = true;
+
+    if( ( signal.startBit + signal.length ) > bitsInFrame ) {
+      continue;
+    }
+
+    if( !acceptCanSignalSource( i, address, now ) ) {
+      continue;
+    }
+
+    canSignalLastUpdate[i] = now;
+
+    uint32_t raw = ( canFrame.data.u64 >> signal.startBit ) & ( ( 1ULL << signal.length ) - 1 );
+
+    if( !canSignalValid( raw, signal.length ) ) {
+      continue;
+    }
+
+    float value = raw * signal.scale + signal.offset;
+    steerCanData.update( [&signal, value]( SteerCanData & data ) {
+      data.*signal.destination = value;
+    } );
+
+    if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance && signal.qogChannel != nullptr ) {
+      sendNumberTransmission( steerConfig.*signal.qogChannel, value );
+    }
+  }
+
+  return found;
+}
+
+// J1939-identifier: priority (3 bits), reserved, data page, PDU format, PDU specific, source address
+constexpr uint32_t j1939IdPriorityMask = 0x1C000000;
+constexpr uint32_t j1939IdPduSpecificMask = 0x0000FF00;
+constexpr uint32_t j1939IdSourceAddressMask = 0x000000FF;
+constexpr uint32_t j1939IdPgnMask = IsobusPgnMask << IsobusPgPos;
+
+// in the dual filter mode, the SJA1000 compares only the bits 28..13 of an extended identifier
+constexpr uint32_t sja1000DualFilterUncomparedMask = 0x00001FFF;
+
+// code and mask (set bits are don't care) of an acceptance filter for the identifier
+struct CanIdFilter {
+  uint32_t code;
+  uint32_t mask;
+
+  // the number of PGNs passing the filter
+  uint32_t volume() const {
+    return 1 << __builtin_popcount( mask & j1939IdPgnMask );
+  }
+};
+
+// calculate a filter, which accepts the PGNs with the bit in selection set
+static CanIdFilter canIdFilterForPgns( uint32_t selection, uint32_t uncomparedMask ) {
+  CanIdFilter filter = { 0, j1939IdPriorityMask | j1939IdSourceAddressMask | uncomparedMask };
+  bool first = true;
+
+  for( uint8_t i = 0; i < canPgnsCount; ++i ) {
+    if( selection & ( 1 << i ) ) {
+      uint32_t id = canPgns[i] << IsobusPgPos;
+
+      // PDU1-format: the PDU specific field is the destination address
+      if( ( ( id >> 16 ) & 0xFF ) < 0xF0 ) {
+        filter.mask |= j1939IdPduSpecificMask;
+      }
+
+      if( first ) {
+        filter.code = id;
+        first = false;
+      } else {
+        filter.mask |= filter.code ^ id;
+      }
+    }
+  }
+
+  filter.code &= ~filter.mask;
+
+  return filter;
+}
+
+// Choose between one filter over the whole identifier and two filters over the upper bits of it (dual filter mode),
+// whichever lets less PGNs through. For the dual filter mode, all partitions of the PGNs into two groups are tried.
+static void configureCanAcceptanceFilter() {
+  canPgns[canPgnsCount++] = j1939PgnAddressClaimed;
+  canPgns[canPgnsCount++] = j1939PgnRequest;
+
+  for( const auto& signal : canSignals ) {
+    bool known = false;
+
+    for( uint8_t i = 0; i < canPgnsCount; ++i ) {
+      if( canPgns[i] == signal.pgn ) {
+        known = true;
+      }
+    }
+
+    if( !known ) {
+      canPgns[canPgnsCount++] = signal.pgn;
+    }
+  }
+
+  const uint32_t all = ( 1 << canPgnsCount ) - 1;
+
+  CanIdFilter single = canIdFilterForPgns( all, 0 );
+
+  CanIdFilter dual[2] = { single, single };
+  uint32_t dualVolume = UINT32_MAX;
+
+  // the first PGN is always in the first group, the second group must not be empty
+  for( uint32_t selection = 1; selection < all; selection += 2 ) {
+    CanIdFilter first = canIdFilterForPgns( selection, sja1000DualFilterUncomparedMask );
+    CanIdFilter second = canIdFilterForPgns( all & ~selection, sja1000DualFilterUncomparedMask );
+
+    if( ( first.volume() + second.volume() ) < dualVolume ) {
+      dualVolume = first.volume() + second.volume();
+      dual[0] = first;
+      dual[1] = second;
+    }
+  }
+
+  CAN_filter_t filter;
+
+  if( single.volume() <= dualVolume ) {
+    // ID28..ID0 in ACR0..ACR3, the lowest three bits (RTR and unused) are don't care
+    uint32_t code = single.code << 3;
+    uint32_t mask = ( single.mask << 3 ) | 0x07;
+
+    filter.FM = Single_Mode;
+    filter.ACR0 = code >> 24;
+    filter.ACR1 = code >> 16;
+    filter.ACR2 = code >> 8;
+    filter.ACR3 = code;
+    filter.AMR0 = mask >> 24;
+    filter.AMR1 = mask >> 16;
+    filter.AMR2 = mask >> 8;
+    filter.AMR3 = mask;
+  } else {
+    // ID28..ID13 in ACR0/ACR1 for the first and ACR2/ACR3 for the second filter
+    filter.FM = Dual_Mode;
+    filter.ACR0 = dual[0].code >> 21;
+    filter.ACR1 = dual[0].code >> 13;
+    filter.ACR2 = dual[1].code >> 21;
+    filter.ACR3 = dual[1].code >> 13;
+    filter.AMR0 = dual[0].mask >> 21;
+    filter.AMR1 = dual[0].mask >> 13;
+    filter.AMR2 = dual[1].mask >> 21;
+    filter.AMR3 = dual[1].mask >> 13;
+  }
+
+  ESP32Can.CANConfigFilter( &filter );
+}
+
+// Trace of the last frames, written only by canWorker10Hz and read by the webserver without locking:
+// each entry carries the position it was written for, which is set last; the reader drops entries
+// which were overwritten while it copied them.
+struct CanTraceEntry {
+  std::atomic<uint32_t> position;
+  int64_t timestamp;
+  uint32_t id;
+  uint8_t flags;
+  uint8_t length;
+  uint8_t data[8];
+
+  CanTraceEntry() : position( UINT32_MAX ) {}
+};
+
+constexpr uint32_t CanTraceSize = 256;
+static_assert( ( CanTraceSize & ( CanTraceSize - 1 ) ) == 0, "CanTraceSize must be a power of two" );
+static CanTraceEntry canTrace[CanTraceSize];
+static std::atomic<uint32_t> canTraceHead( 0 );
+
+static void addToCanTrace( const CAN_frame_t& canFrame ) {
+  uint32_t position = canTraceHead.load( std::memory_order_relaxed );
+  CanTraceEntry& entry = canTrace[position & ( CanTraceSize - 1 )];
+
+  entry.position.store( UINT32_MAX, std::memory_order_release );
+  entry.timestamp = esp_timer_get_time();
+  entry.id = canFrame.MsgID;
+  entry.flags = ( canFrame.FIR.B.FF == CAN_frame_ext ? 1 : 0 ) | ( canFrame.FIR.B.RTR == CAN_RTR ? 2 : 0 );
+  entry.length = canFrame.FIR.B.DLC > 8 ? 8 : canFrame.FIR.B.DLC;
+  memcpy( entry.data, canFrame.data.u8, 8 );
+  entry.position.store( position, std::memory_order_release );
+
+  canTraceHead.store( position + 1, std::memory_order_release );
+}
+
+// the position of the oldest and after the newest entry at the time of calling
+void canTraceRange( uint32_t& begin, uint32_t& end ) {
+  end = canTraceHead.load( std::memory_order_acquire );
+  begin = end > CanTraceSize ? end - CanTraceSize : 0;
+}
+
+// prints the trace from position up to end in the format of "candump -l" into buffer, returns the length
+size_t canTraceRead( uint32_t& position, uint32_t end, uint8_t* buffer, size_t maxLen ) {
+  // "(1234567890.123456) can0 12345678#0011223344556677\n"
+  constexpr size_t maxLineLength = 56;
+  size_t length = 0;
+
+  while( ( maxLen - length ) > maxLineLength && ( int32_t )( end - position ) > 0 ) {
+    CanTraceEntry& entry = canTrace[position & ( CanTraceSize - 1 )];
+
+    int64_t timestamp = entry.timestamp;
+    uint32_t id = entry.id;
+    uint8_t flags = entry.flags;
+    uint8_t dataLength = entry.length;
+    uint8_t data[8];
+    memcpy( data, entry.data, 8 );
+
+    // overwritten while copying, or not written yet
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+    if( entry.position.load( std::memory_order_acquire ) != position ) {
+      ++position;
+      continue;
+    }
+
+    char* line = ( char* )&buffer[length];
+    int c;
+
+    if( flags & 1 ) {
+      c = sprintf( line, "(%u.%06u) can0 %08X#", ( uint32_t )( timestamp / 1000000 ), ( uint32_t )( timestamp % 1000000 ), id & 0x1FFFFFFF );
+    } else {
+      c = sprintf( line, "(%u.%06u) can0 %03X#", ( uint32_t )( timestamp / 1000000 ), ( uint32_t )( timestamp % 1000000 ), id & 0x7FF );
+    }
+
+    if( flags & 2 ) {
+      line[c++] = 'R';
+    } else {
+      for( uint8_t i = 0; i < dataLength; ++i ) {
+        c += sprintf( &line[c], "%02X", data[i] );
+      }
+    }
+
+    line[c++] = '\n';
+    length += c;
+    ++position;
+  }
+
+  return length;
+}
+
+// statistics of the bus, a snapshot is calculated every second
+static uint32_t canPgnFrames[canPgnsMax];
+static uint32_t canPgnFramesPerSecond[canPgnsMax];
+static uint32_t canOtherFrames = 0;
+static uint32_t canBitsReceived = 0;
+static uint8_t canBusLoad = 0;
+static uint32_t canFramesPerSecond = 0;
+static uint32_t canDataOverruns = 0;
+static uint32_t canRxQueueFull = 0;
+
+static void countCanFrame( const CAN_frame_t& canFrame ) {
+  // frame length without bit stuffing: 67 (extended) or 47 (standard) bits plus the data
+  canBitsReceived += ( canFrame.FIR.B.FF == CAN_frame_ext ? 67 : 47 ) + canFrame.FIR.B.DLC * 8;
+
+  if( canFrame.FIR.B.FF == CAN_frame_ext ) {
+    uint32_t pgn = j1939Pgn( canFrame.MsgID );
+
+    for( uint8_t i = 0; i < canPgnsCount; ++i ) {
+      if( canPgns[i] == pgn ) {
+        ++canPgnFrames[i];
+        return;
+      }
+    }
+  }
+
+  ++canOtherFrames;
+}
+
+static void updateCanStatistics( uint32_t elapsed ) {
+  static uint32_t lastPgnFrames[canPgnsMax];
+  static uint32_t lastFrames = 0;
+
+  uint32_t frames = canOtherFrames;
+
+  for( uint8_t i = 0; i < canPgnsCount; ++i ) {
+    frames += canPgnFrames[i];
+    canPgnFramesPerSecond[i] = ( canPgnFrames[i] - lastPgnFrames[i] ) * 1000 / elapsed;
+    lastPgnFrames[i] = canPgnFrames[i];
+  }
+
+  canFramesPerSecond = ( frames - lastFrames ) * 1000 / elapsed;
+  lastFrames = frames;
+
+  canBusLoad = ( uint64_t )canBitsReceived * 100 / ( ( uint32_t )steerConfig.canBusSpeed * elapsed );
+  canBitsReceived = 0;
+}
+
+static void updateCanStatisticsLabel() {
+  WebUiLock lock( 0 );
+  Control* handle = lock ? ESPUI.getControl( labelCanStatistics ) : nullptr;
+
+  if( handle == nullptr ) {
+    return;
+  }
+
+  String& str = handle->value;
+  str.reserve( 800 );
+
+  str = "<table style='margin:auto;'><tr><td style='text-align:left; padding: 0px 5px;'>Bus Load";
+
+  if( !steerConfig.canBusAcceptAllFrames ) {
+    str += " (accepted frames)";
+  }
+
+  str += ":</td><td style='text-align:left; padding: 0px 5px;'>";
+  str += canBusLoad;
+  str += "%, ";
+  str += canFramesPerSecond;
+  str += " frames/s</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Errors RX/TX:</td><td style='text-align:left; padding: 0px 5px;'>";
+  str += MODULE_CAN->RXERR.U & 0xFF;
+  str += " / ";
+  str += MODULE_CAN->TXERR.U & 0xFF;
+
+  if( MODULE_CAN->SR.B.BS ) {
+    str += ", bus off";
+  } else if( MODULE_CAN->SR.B.ES ) {
+    str += ", error warning";
+  }
+
+  str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Controller Overruns:</td><td style='text-align:left; padding: 0px 5px;'>";
+  str += canDataOverruns;
+  str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Receive Queue Full:</td><td style='text-align:left; padding: 0px 5px;'>";
+  str += canRxQueueFull;
+
+  for( uint8_t i = 0; i < canPgnsCount; ++i ) {
+    str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>PGN ";
+    str += canPgns[i];
+    str += ":</td><td style='text-align:left; padding: 0px 5px;'>";
+    str += canPgnFrames[i];
+    str += " (";
+    str += canPgnFramesPerSecond[i];
+    str += "/s)";
+  }
+
+  str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Other:</td><td style='text-align:left; padding: 0px 5px;'>";
+  str += canOtherFrames;
+  str += "</td></tr></table>";
+
+  ESPUI.updateControlAsync( handle );
+}
+
+void canWorker10Hz( void* z ) {
+  constexpr TickType_t xFrequency = 100;
+
+  CAN_frame_t canFrame;
+
+  uint32_t lastStatistics = millis();
+
+  while( 1 ) {
+    // the driver drops the frames silently, if the queue is full
+    if( uxQueueMessagesWaiting( CAN_cfg.rx_queue ) >= rxQueueSize ) {
+      ++canRxQueueFull;
+    }
+
+    if( xQueueReceive( CAN_cfg.rx_queue, &canFrame, xFrequency ) == pdTRUE ) {
+      addToCanTrace( canFrame );
+      countCanFrame( canFrame );
+
+      if( canFrame.FIR.B.FF == CAN_frame_ext && decodeCanFrame( canFrame ) ) {
+        ++canFramesDecoded;
+
+        // the workswitch can depend on the decoded values, so a change is sent without waiting
+        updateWorkswitch( true );
+      } else {
+        ++canFramesDiscarded;
+      }
+    }
+
+    // the driver doesn't handle an overrun of the receive FIFO, so poll and clear it here
+    if( MODULE_CAN->SR.B.DOS ) {
+      ++canDataOverruns;
+      MODULE_CAN->CMR.B.CDO = 1;
+    }
+
+    {
+      uint32_t elapsed = millis() - lastStatistics;
+
+      if( elapsed >= 1000 ) {
+        lastStatistics = millis();
+        updateCanStatistics( elapsed );
+        updateCanStatisticsLabel();
+      }
+    }
+
     {
-      static uint8_t loopTimeToWaitTo = 0;
+      static uint32_t loopTimeToWaitTo = 0;
 
       if( loopTimeToWaitTo < millis() ) {
 
-        Control* handle = ESPUI.getControl( labelStatusCan );
-        String str;
-        str.reserve( 200 );
+        SteerCanData canData = steerCanData.read();
+        // static, so the buffer is only allocated once
+        static String str;
+        str.reserve( 900 );
 
         str = "<table style='margin:auto;'><tr><td style='text-align:left; padding: 0px 5px;'>Wheel-based Speed:</td><td style='text-align:left; padding: 0px 5px;'>";
-        str += String( steerCanData.speed );
+        str += canData.speed;
         str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Motor RPM:</td><td style='text-align:left; padding: 0px 5px;'>";
-        str += String( steerCanData.motorRpm );
+        str += canData.motorRpm;
         str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Front Hitch Position:</td><td style='text-align:left; padding: 0px 5px;'>";
-        str += String( steerCanData.frontHitchPosition );
+        str += canData.frontHitchPosition;
         str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Rear Hitch Position:</td><td style='text-align:left; padding: 0px 5px;'>";
-        str += String( steerCanData.rearHitchPosition );
+        str += canData.rearHitchPosition;
         str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Front PTO RPM:</td><td style='text-align:left; padding: 0px 5px;'>";
-        str += String( steerCanData.frontPtoRpm );
+        str += canData.frontPtoRpm;
         str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Rear PTO RPM:</td><td style='text-align:left; padding: 0px 5px;'>";
-        str += String( steerCanData.rearPtoRpm );
+        str += canData.rearPtoRpm;
+        str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Engine Load:</td><td style='text-align:left; padding: 0px 5px;'>";
+        str += canData.engineLoad;
+        str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Ground-based Speed:</td><td style='text-align:left; padding: 0px 5px;'>";
+        str += canData.groundSpeed;
+        str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Frames decoded/discarded:</td><td style='text-align:left; padding: 0px 5px;'>";
+        str += canFramesDecoded;
+        str += " / ";
+        str += canFramesDiscarded;
+
+        if( canAddressState != CanAddressState::None ) {
+          str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Guidance Curvature/Readiness/Lockout:</td><td style='text-align:left; padding: 0px 5px;'>";
+          str += canData.guidanceCurvature;
+          str += "/km, ";
+          str += canData.guidanceReadiness;
+          str += ", ";
+          str += canData.guidanceLockout;
+          str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Address ";
+          str += steerConfig.canBusSourceAddress;
+          str += ":</td><td style='text-align:left; padding: 0px 5px;'>";
+          str += canAddressState == CanAddressState::Claimed ? "claimed" : "lost to another ECU";
+          str += ", ";
+          str += canFramesSent;
+          str += " frames sent, ";
+          str += canFramesTxDropped;
+          str += " dropped";
+        }
+
+        for( uint8_t i = 0; i < canSourcesCount; ++i ) {
+          const CanSource& source = canSources[i];
+
+          str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Source ";
+          str += source.address;
+
+          if( source.address == steerConfig.canBusPreferredSourceAddress ) {
+            str += " (preferred)";
+          }
+
+          str += ":</td><td style='text-align:left; padding: 0px 5px;'>";
+
+          if( source.claimed ) {
+            char name[20];
+            snprintf( name, sizeof( name ), "NAME %08X%08X", ( uint32_t )( source.name >> 32 ), ( uint32_t )source.name );
+            str += name;
+            str += ", ";
+          }
+
+          str += source.frames;
+          str += " frames";
+        }
+
         str += "</td></tr></table>";
 
-        handle->value = str;
-        ESPUI.updateControlAsync( handle );
+        {
+          WebUiLock lock( 0 );
+          Control* handle = lock ? ESPUI.getControl( labelStatusCan ) : nullptr;
+
+          if( handle != nullptr ) {
+            handle->value = str;
+            ESPUI.updateControlAsync( handle );
+          }
+        }
 
         loopTimeToWaitTo = millis() + xFrequency;
       }
@@ -161,10 +956,38 @@ void initCan() {
     CAN_cfg.speed = ( CAN_speed_t )steerConfig.canBusSpeed;
     CAN_cfg.tx_pin_id = ( gpio_num_t )steerConfig.canBusRx;
     CAN_cfg.rx_pin_id = ( gpio_num_t )steerConfig.canBusTx;
-    CAN_cfg.rx_queue = xQueueCreate( rxQueueSize, sizeof( CAN_frame_t ) );
+    static StaticQueue_t rxQueueBuffer;
+    static uint8_t rxQueueStorage[rxQueueSize * sizeof( CAN_frame_t )];
+    CAN_cfg.rx_queue = xQueueCreateStatic( rxQueueSize, sizeof( CAN_frame_t ), rxQueueStorage, &rxQueueBuffer );
+    memset( canSourceIndex, CanSourceUnknown, sizeof( canSourceIndex ) );
+    memset( canSignalSource, CanSourceUnknown, sizeof( canSignalSource ) );
+
+    // only let the frames through, which are decoded
+    configureCanAcceptanceFilter();
+
+    if( steerConfig.canBusAcceptAllFrames ) {
+      CAN_filter_t filter = { Single_Mode, 0, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF };
+      ESP32Can.CANConfigFilter( &filter );
+    }
     // Init CAN Module
     ESP32Can.CANInit();
 
-    xTaskCreate( canWorker10Hz, "canWorker", 2048, NULL, 5, NULL );
+    createTask( TaskId::CanRx, canWorker10Hz );
+
+    // only transmit, if the steering is done over the bus
+    if( steerConfig.outputType == SteerConfig::OutputType::IsobusGuidance ) {
+      canTxMutex = xSemaphoreCreateMutex();
+
+      canOwnName = ( ESP.getEfuseMac() & 0x1FFFFF ) |
+                   ( CanNameFunction << 40 ) |
+                   ( CanNameVehicleSystem << 49 ) |
+                   ( CanNameIndustryGroup << 60 );
+
+      sendAddressClaim( steerConfig.canBusSourceAddress );
+      canAddressClaimTime = millis();
+      canAddressState = CanAddressState::Claimed;
+
+      createTask( TaskId::CanTx, canTxWorker );
+    }
   }
 }
@@ -0,0 +1,92 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Writes the small, fixed CBOR maps of the QOG transmissions into a buffer of the caller, byte for byte
+// like json::to_cbor() of the bundled nlohmann::json 3.7.3 does: keys in sorted order, unsigned integers
+// in the shortest form, floating point numbers always as double. Nothing is allocated, so it can be used
+// by the control tasks. Maps and keys are limited to 23 entries/characters, the caller sizes the buffer.
+class CborWriter {
+  public:
+    CborWriter( uint8_t* buffer ) : buffer( buffer ) {}
+
+    void map( uint8_t entries ) {
+      put( 0xA0 | entries );
+    }
+
+    void key( const char* str ) {
+      size_t length = strlen( str );
+      put( 0x60 | length );
+      memcpy( buffer + position, str, length );
+      position += length;
+    }
+
+    void unsignedInteger( uint32_t value ) {
+      if( value <= 0x17 ) {
+        put( value );
+      } else if( value <= 0xFF ) {
+        put( 0x18 );
+        put( value );
+      } else if( value <= 0xFFFF ) {
+        put( 0x19 );
+        putBigEndian( value, 2 );
+      } else {
+        put( 0x1A );
+        putBigEndian( value, 4 );
+      }
+    }
+
+    void boolean( bool value ) {
+      put( value ? 0xF5 : 0xF4 );
+    }
+
+    void number( double value ) {
+      uint64_t bits;
+      memcpy( &bits, &value, sizeof( bits ) );
+
+      put( 0xFB );
+      putBigEndian( bits, 8 );
+    }
+
+    size_t size() const {
+      return position;
+    }
+
+  private:
+    void put( uint8_t byte ) {
+      buffer[position++] = byte;
+    }
+
+    void putBigEndian( uint64_t value, uint8_t bytes ) {
+      while( bytes-- ) {
+        put( value >> ( bytes * 8 ) );
+      }
+    }
+
+    uint8_t* buffer;
+    size_t position = 0;
+};
@@ -0,0 +1,92 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <type_traits>
+
+#include <Preferences.h>
+#include <rom/crc.h>
+
+#include "main.hpp"
+
+// SteerConfig is stored as a binary copy in NVS, so the boot doesn't have to parse the JSON-file.
+// The JSON-file is only used to import and export the config and to carry it over to a firmware with
+// a different layout of SteerConfig.
+
+// bump this, if the layout of SteerConfig changes without changing its size (reordered fields, a type
+// change of the same size...); a change of the size is detected by itself
+constexpr uint32_t SteerConfigSchemaVersion = 3;
+constexpr uint32_t SteerConfigSchema = ( SteerConfigSchemaVersion << 16 ) ^ sizeof( SteerConfig );
+
+static_assert( std::is_trivially_copyable<SteerConfig>::value, "SteerConfig is stored as a binary copy" );
+
+struct ConfigBlob {
+  uint32_t schema;
+  uint32_t crc;
+  SteerConfig config;
+};
+
+static const char* const ConfigNamespace = "esp32-aog";
+static const char* const ConfigKey = "steerConfig";
+
+// static, to keep it off the stacks of the callers (setup() and the callbacks of the webserver)
+static ConfigBlob configBlob;
+
+bool loadConfigBlob( SteerConfig& config ) {
+  Preferences preferences;
+
+  if( !preferences.begin( ConfigNamespace, true ) ) {
+    return false;
+  }
+
+  bool valid = preferences.getBytesLength( ConfigKey ) == sizeof( ConfigBlob ) &&
+               preferences.getBytes( ConfigKey, &configBlob, sizeof( ConfigBlob ) ) == sizeof( ConfigBlob ) &&
+               configBlob.schema == SteerConfigSchema &&
+               configBlob.crc == crc32_le( 0, ( const uint8_t* )&configBlob.config, sizeof( SteerConfig ) );
+  preferences.end();
+
+  if( valid ) {
+    config = configBlob.config;
+  } else {
+    Serial.println( "No valid binary config found" );
+  }
+
+  return valid;
+}
+
+void saveConfigBlob( const SteerConfig& config ) {
+  Preferences preferences;
+
+  if( !preferences.begin( ConfigNamespace, false ) ) {
+    Serial.println( "Could not open NVS for writing the config" );
+    return;
+  }
+
+  configBlob.schema = SteerConfigSchema;
+  configBlob.config = config;
+  configBlob.crc = crc32_le( 0, ( const uint8_t* )&configBlob.config, sizeof( SteerConfig ) );
+
+  if( preferences.putBytes( ConfigKey, &configBlob, sizeof( ConfigBlob ) ) != sizeof( ConfigBlob ) ) {
+    Serial.println( "Could not write the config to NVS" );
+  }
+
+  preferences.end();
+}
@@ -0,0 +1,248 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <freertos/xtensa_context.h>
+#include <rom/crc.h>
+
+#include "main.hpp"
+#include "jsonFunctions.hpp"
+
+// The panic handler of the framework is wrapped by the linker (see the build flags in platformio.ini),
+// so the context of a crash is stored in RTC memory, which survives the reboot. On the next start, it is
+// written to /crash.json, which is served by the webserver and can be symbolized on a host with
+// tools/symbolize-crash.py and the ELF of the same build.
+
+constexpr uint32_t CrashReportMagic = 0x43524153;
+constexpr uint8_t CrashReportBacktraceDepth = 24;
+
+struct CrashReport {
+  uint32_t magic;
+  uint32_t crc;
+
+  uint32_t exceptionCause;
+  uint32_t exceptionAddress;
+  uint32_t uptime;
+  uint32_t timestamp;
+  uint8_t core;
+  char taskName[16];
+
+  uint8_t backtraceDepth;
+  uint32_t backtrace[CrashReportBacktraceDepth];
+  uint32_t stackPointer[CrashReportBacktraceDepth];
+
+  // start of the last loop of every task, in µs (micros())
+  uint32_t lastLoopStart[( uint8_t )TaskId::Count];
+  uint32_t loops[( uint8_t )TaskId::Count];
+
+  // sampled every second by the IdleStats-worker; the heap can't be inspected in the panic handler
+  uint32_t heapFree;
+  uint32_t heapMinimumFree;
+  uint32_t heapLargestFreeBlock;
+};
+
+static RTC_NOINIT_ATTR CrashReport crashReport;
+
+static uint32_t IRAM_ATTR crashReportCrc() {
+  return crc32_le( 0, ( const uint8_t* )&crashReport.exceptionCause,
+                   sizeof( CrashReport ) - offsetof( CrashReport, exceptionCause ) );
+}
+
+void crashReportSampleHeap( uint32_t free, uint32_t minimumFree, uint32_t largestFreeBlock ) {
+  crashReport.heapFree = free;
+  crashReport.heapMinimumFree = minimumFree;
+  crashReport.heapLargestFreeBlock = largestFreeBlock;
+}
+
+// the same walk as the backtrace printed by the framework: the caller of every windowed frame is found in
+// the base save area below its stack pointer
+static bool IRAM_ATTR stackPointerIsSane( uint32_t sp ) {
+  return sp > 0x3ffae010 && sp < 0x40000000 && ( sp & 0xf ) == 0;
+}
+
+static uint32_t IRAM_ATTR stackPcToAddress( uint32_t pc ) {
+  // the upper two bits are the window increment of the call
+  if( pc & 0x80000000 ) {
+    pc = ( pc & 0x3fffffff ) | 0x40000000;
+  }
+
+  return pc;
+}
+
+static void IRAM_ATTR storeCrashReport( XtExcFrame* frame ) {
+  crashReport.exceptionCause = frame->exccause;
+  crashReport.exceptionAddress = frame->excvaddr;
+  crashReport.uptime = xTaskGetTickCount() * portTICK_PERIOD_MS;
+  crashReport.timestamp = micros();
+  crashReport.core = xPortGetCoreID();
+
+  {
+    const char* name = pcTaskGetTaskName( nullptr );
+    strncpy( crashReport.taskName, name != nullptr ? name : "?", sizeof( crashReport.taskName ) - 1 );
+    crashReport.taskName[sizeof( crashReport.taskName ) - 1] = '\0';
+  }
+
+  {
+    uint32_t pc = frame->pc;
+    uint32_t sp = frame->a1;
+    uint32_t nextPc = frame->a0;
+    uint8_t depth = 0;
+
+    // the first pc isn't checked, it can be smashed
+    crashReport.backtrace[depth] = pc;
+    crashReport.stackPointer[depth++] = sp;
+
+    while( depth < CrashReportBacktraceDepth && stackPointerIsSane( sp ) ) {
+      uint32_t baseSave = sp;
+
+      pc = stackPcToAddress( nextPc );
+
+      if( pc < 0x40000000 ) {
+        break;
+      }
+
+      sp = *( ( uint32_t* )( baseSave - 12 ) );
+      nextPc = *( ( uint32_t* )( baseSave - 16 ) );
+
+      // the return address points after the call, go back to the call itself
+      crashReport.backtrace[depth] = pc - 3;
+      crashReport.stackPointer[depth++] = sp;
+    }
+
+    crashReport.backtraceDepth = depth;
+  }
+
+  for( uint8_t i = 0; i < ( uint8_t )TaskId::Count; ++i ) {
+    crashReport.lastLoopStart[i] = taskTimings[i].lastStart;
+    crashReport.loops[i] = taskTimings[i].loops;
+  }
+
+  crashReport.crc = crashReportCrc();
+  crashReport.magic = CrashReportMagic;
+}
+
+extern "C" {
+  void __real_panicHandler( XtExcFrame* frame );
+  void __real_xt_unhandled_exception( XtExcFrame* frame );
+
+  // exceptions in the panic- and debug-vectors: aborts, watchdogs, asserts...
+  void IRAM_ATTR __wrap_panicHandler( XtExcFrame* frame ) {
+    storeCrashReport( frame );
+    __real_panicHandler( frame );
+  }
+
+  // all the other exceptions: illegal instructions, load/store errors...
+  void IRAM_ATTR __wrap_xt_unhandled_exception( XtExcFrame* frame ) {
+    storeCrashReport( frame );
+    __real_xt_unhandled_exception( frame );
+  }
+}
+
+static const char* resetReasonName( esp_reset_reason_t reason ) {
+  switch( reason ) {
+    case ESP_RST_POWERON:
+      return "power on";
+
+    case ESP_RST_SW:
+      return "software";
+
+    case ESP_RST_PANIC:
+      return "panic";
+
+    case ESP_RST_INT_WDT:
+      return "interrupt watchdog";
+
+    case ESP_RST_TASK_WDT:
+      return "task watchdog";
+
+    case ESP_RST_WDT:
+      return "other watchdog";
+
+    case ESP_RST_BROWNOUT:
+      return "brownout";
+
+    case ESP_RST_DEEPSLEEP:
+      return "deep sleep";
+
+    default:
+      return "unknown";
+  }
+}
+
+static String toHex( uint32_t value ) {
+  char str[11];
+  snprintf( str, sizeof( str ), "0x%08x", value );
+  return String( str );
+}
+
+void initCrashReport() {
+  esp_reset_reason_t reason = esp_reset_reason();
+
+  if( crashReport.magic == CrashReportMagic && crashReport.crc == crashReportCrc() ) {
+    json j;
+
+    j["build"] = __DATE__ " " __TIME__;
+    j["resetReason"] = resetReasonName( reason );
+    j["uptime"] = crashReport.uptime;
+    j["core"] = crashReport.core;
+    j["task"] = crashReport.taskName;
+    j["exception"]["cause"] = crashReport.exceptionCause;
+    j["exception"]["address"] = toHex( crashReport.exceptionAddress ).c_str();
+
+    for( uint8_t i = 0; i < crashReport.backtraceDepth && i < CrashReportBacktraceDepth; ++i ) {
+      j["backtrace"].push_back( { toHex( crashReport.backtrace[i] ).c_str(), toHex( crashReport.stackPointer[i] ).c_str() } );
+    }
+
+    for( uint8_t i = 0; i < ( uint8_t )TaskId::Count; ++i ) {
+      if( crashReport.loops[i] ) {
+        json task;
+        task["name"] = taskLayout[i].name;
+        task["loops"] = crashReport.loops[i];
+        // time since the start of the last loop, in µs
+        task["lastLoop"] = crashReport.timestamp - crashReport.lastLoopStart[i];
+        j["tasks"].push_back( task );
+      }
+    }
+
+    j["heap"]["free"] = crashReport.heapFree;
+    j["heap"]["minimumFree"] = crashReport.heapMinimumFree;
+    j["heap"]["largestFreeBlock"] = crashReport.heapLargestFreeBlock;
+
+    saveJsonToFile( j, "/crash.json" );
+
+    Serial.print( "Crash in task " );
+    Serial.print( crashReport.taskName );
+    Serial.println( " before the last reset, stored in /crash.json" );
+  } else if( reason != ESP_RST_POWERON && reason != ESP_RST_SW && reason != ESP_RST_DEEPSLEEP ) {
+    // pe a brownout, there is no context for these
+    Serial.print( "Reset by " );
+    Serial.println( resetReasonName( reason ) );
+  }
+
+  // RTC_NOINIT is random after a power on
+  memset( &crashReport, 0, sizeof( crashReport ) );
+}
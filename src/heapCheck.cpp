@@ -0,0 +1,93 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <Arduino.h>
+
+#include "main.hpp"
+
+// Debug aid for a heap-free steady state: built with the env featheresp32-heapcheck, malloc(), calloc()
+// and realloc() are wrapped by the linker, and the allocations in the tasks on the control core after the
+// boot are counted and shown in the load label. The first one of every task is printed with its caller;
+// with HEAP_CHECK_ABORT, it aborts instead, the backtrace can then be decoded with
+// tools/EspArduinoExceptionDecoder.
+#if defined( HEAP_CHECK )
+
+#include <stdlib.h>
+#include <rom/ets_sys.h>
+
+// in ms after the start; the tasks are allowed to allocate until then, pe for their first label updates
+#ifndef HEAP_CHECK_ARM_TIME
+  #define HEAP_CHECK_ARM_TIME 10000
+#endif
+
+volatile uint32_t heapCheckAllocations[( uint8_t )TaskId::Count] = {};
+
+extern "C" {
+  void* __real_malloc( size_t size );
+  void* __real_calloc( size_t n, size_t size );
+  void* __real_realloc( void* ptr, size_t size );
+}
+
+static void checkHeapAllocation( size_t size, void* caller ) {
+  if( xPortInIsrContext() || xTaskGetTickCount() < pdMS_TO_TICKS( HEAP_CHECK_ARM_TIME ) ) {
+    return;
+  }
+
+  TaskHandle_t currentTask = xTaskGetCurrentTaskHandle();
+
+  for( uint8_t i = 0; i < ( uint8_t )TaskId::Count; ++i ) {
+    if( taskHandles[i] == currentTask && taskLayout[i].core == TASK_CORE_CONTROL ) {
+      if( heapCheckAllocations[i]++ == 0 ) {
+        // no Serial here, it could allocate itself
+        ets_printf( "\nHEAP_CHECK: %u bytes allocated by %s, caller %p\n", size, taskLayout[i].name, caller );
+
+#if defined( HEAP_CHECK_ABORT )
+        abort();
+#endif
+      }
+
+      return;
+    }
+  }
+}
+
+extern "C" void* __wrap_malloc( size_t size ) {
+  checkHeapAllocation( size, __builtin_return_address( 0 ) );
+  return __real_malloc( size );
+}
+
+extern "C" void* __wrap_calloc( size_t n, size_t size ) {
+  checkHeapAllocation( n * size, __builtin_return_address( 0 ) );
+  return __real_calloc( n, size );
+}
+
+extern "C" void* __wrap_realloc( void* ptr, size_t size ) {
+  // realloc( ptr, 0 ) frees
+  if( size ) {
+    checkHeapAllocation( size, __builtin_return_address( 0 ) );
+  }
+
+  return __real_realloc( ptr, size );
+}
+
+#endif
@@ -56,12 +56,15 @@ void idleStatsWorker( void* z ) {
   TickType_t xLastWakeTime = xTaskGetTickCount();
 
   String str;
-  str.reserve( 500 );
+  str.reserve( 3072 );
 
   multi_heap_info_t heapInfo;
 
   while( 1 ) {
+    taskTimingStart( TaskId::IdleStats );
+
     heap_caps_get_info( &heapInfo, MALLOC_CAP_8BIT );
+    crashReportSampleHeap( heapInfo.total_free_bytes, heapInfo.minimum_free_bytes, heapInfo.largest_free_block );
 
     str = "Core0: ";
     str += 1000 - idleCtrCore0;
@@ -82,19 +85,84 @@ void idleStatsWorker( void* z ) {
     str += heapInfo.minimum_free_bytes / 1024;
     str += "kB<br/>Largest free block on Heap: ";
     str += heapInfo.largest_free_block / 1024;
+    str += "kB<br/>Heap used by the WebUI: ";
+    str += webUiHeapUsage / 1024;
     str += "kB";
 
-    Control* labelLoadHandle = ESPUI.getControl( labelLoad );
-    labelLoadHandle->value = str;
-    ESPUI.updateControlAsync( labelLoadHandle );
+    // jitter and run time of the last second, per task; the stack is the lowest amount ever free
+    str += "<table style='margin:auto;'><tr><th>Task</th><th>Core/Prio</th><th>Jitter</th><th>Run</th><th>Stack free</th>";
+#if defined( HEAP_CHECK )
+    str += "<th>Heap</th>";
+#endif
+    str += "</tr>";
+
+    for( uint8_t i = 0; i < ( uint8_t )TaskId::Count; ++i ) {
+      if( taskTimings[i].loops ) {
+        str += "<tr><td style='text-align:left; padding: 0px 5px;'>";
+        str += taskLayout[i].name;
+        str += "</td><td style='text-align:left; padding: 0px 5px;'>";
+        str += taskLayout[i].core;
+        str += "/";
+        str += taskLayout[i].priority;
+        str += "</td><td style='text-align:left; padding: 0px 5px;'>";
+
+        if( taskLayout[i].period ) {
+          str += taskTimings[i].maxJitter;
+          str += "µs";
+        } else {
+          str += "-";
+        }
+
+        str += "</td><td style='text-align:left; padding: 0px 5px;'>";
+        str += taskTimings[i].maxRunTime;
+        str += "µs</td><td style='text-align:left; padding: 0px 5px;'>";
+
+        if( taskHandles[i] != nullptr ) {
+          // in bytes on the ESP32
+          str += uxTaskGetStackHighWaterMark( taskHandles[i] );
+          str += "/";
+          str += taskLayout[i].stackSize;
+        } else {
+          str += "-";
+        }
+
+#if defined( HEAP_CHECK )
+        str += "</td><td style='text-align:left; padding: 0px 5px;'>";
+        str += heapCheckAllocations[i];
+        str += " allocs";
+#endif
+
+        str += "</td></tr>";
+
+        taskTimings[i].maxJitter = 0;
+        taskTimings[i].maxRunTime = 0;
+      }
+    }
+
+    str += "</table>";
+
+    {
+      WebUiLock lock( 0 );
+
+      if( lock ) {
+        Control* labelLoadHandle = ESPUI.getControl( labelLoad );
+
+        if( labelLoadHandle != nullptr ) {
+          labelLoadHandle->value = str;
+          ESPUI.updateControlAsync( labelLoadHandle );
+        }
+
+        ESPUI.updateControlAsyncTransmit();
+      }
+    }
 
     idleCtrCore0 = 0;
     idleCtrCore1 = 0;
 
-    ESPUI.updateControlAsyncTransmit();
-
 //   heap_caps_print_heap_info(MALLOC_CAP_8BIT);
 
+    taskTimingStop( TaskId::IdleStats );
+
     vTaskDelayUntil( &xLastWakeTime, xFrequency );
   }
 }
@@ -102,5 +170,5 @@ void idleStatsWorker( void* z ) {
 void initIdleStats() {
   esp_register_freertos_idle_hook_for_cpu( core0IdleWorker, 0 );
   esp_register_freertos_idle_hook_for_cpu( core1IdleWorker, 1 );
-  xTaskCreate( idleStatsWorker, "IdleStats", 2048, NULL, 10, NULL );
+  createTask( TaskId::IdleStats, idleStatsWorker );
 }
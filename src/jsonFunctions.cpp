@@ -31,11 +31,14 @@ extern "C" {
 
 #include "main.hpp"
 #include "jsonFunctions.hpp"
+#include "cborWriter.hpp"
 
 void loadSavedConfig() {
-  {
+  // the JSON-file is only parsed, if there is no valid binary copy (first boot, changed layout of SteerConfig)
+  if( !loadConfigBlob( steerConfig ) ) {
     auto j = loadJsonFromFile( "/config.json" );
     parseJsonToSteerConfig( j, steerConfig );
+    saveConfigBlob( steerConfig );
   }
 
   {
@@ -44,8 +47,17 @@ void loadSavedConfig() {
   }
 }
 
+// set by importConfigFromFile(): the stored config is newer than steerConfig until the reboot following it
+static bool configImported = false;
+
 void saveConfig() {
-  {
+  // the running config would overwrite the imported one
+  if( configImported ) {
+    Serial.println( "Config imported, only the calibration is saved until the reboot" );
+  } else {
+    saveConfigBlob( steerConfig );
+
+    // exported for the download and as fallback for a firmware with a different layout of SteerConfig
     const auto j = parseSteerConfigToJson( steerConfig );
     saveJsonToFile( j, "/config.json" );
   }
@@ -89,6 +101,28 @@ json loadJsonFromFile( const char* fileName ) {
   return j;
 }
 
+bool importConfigFromFile( const char* fileName ) {
+  // the tasks read steerConfig without locking, so it is only replaced by the reboot; static, as the
+  // upload is handled on the small stack of AsyncTCP. Based on the defaults like on the first boot, so
+  // nothing of the running config leaks into the imported one
+  static SteerConfig importedConfig;
+  importedConfig = steerConfigDefaults;
+
+  auto j = loadJsonFromFile( fileName );
+
+  if( !j.is_object() ) {
+    // restore the export of the running config
+    saveJsonToFile( parseSteerConfigToJson( steerConfig ), "/config.json" );
+    return false;
+  }
+
+  parseJsonToSteerConfig( j, importedConfig );
+  saveConfigBlob( importedConfig );
+
+  configImported = true;
+  return true;
+}
+
 void saveJsonToFile( const json& json, const char* fileName ) {
   // pretty print with 2 spaces indentation
   auto data = json.dump( 2 );
@@ -117,6 +151,7 @@ json parseSteerConfigToJson( const SteerConfig& config ) {
 
   j["output"]["type"] = int( config.outputType );
   j["output"]["pwmFrequency"] = config.pwmFrequency;
+  j["output"]["wheelbase"] = config.wheelbase;
   j["output"]["minPWM"] = config.steeringPidMinPwm;
   j["output"]["gpioPwm"] = int( config.gpioPwm );
   j["output"]["gpioDir"] = int( config.gpioDir );
@@ -152,6 +187,9 @@ json parseSteerConfigToJson( const SteerConfig& config ) {
   j["i2c"]["sda"] = int( config.gpioSDA );
   j["i2c"]["scl"] = int( config.gpioSCL );
   j["i2c"]["speed"] = config.i2cBusSpeed;
+  j["i2c"]["sda2"] = int( config.gpioSDA2 );
+  j["i2c"]["scl2"] = int( config.gpioSCL2 );
+  j["i2c"]["speed2"] = config.i2cBusSpeed2;
 
   j["imu"]["type"] = int( config.imuType );
 
@@ -170,6 +208,9 @@ json parseSteerConfigToJson( const SteerConfig& config ) {
   j["canBus"]["hitchThresholdHysteresis"] = config.canBusHitchThresholdHysteresis;
   j["canBus"]["rpmThreshold"] = config.canBusRpmThreshold;
   j["canBus"]["rpmThresholdHysteresis"] = config.canBusRpmThresholdHysteresis;
+  j["canBus"]["preferredSourceAddress"] = config.canBusPreferredSourceAddress;
+  j["canBus"]["acceptAllFrames"] = config.canBusAcceptAllFrames;
+  j["canBus"]["sourceAddress"] = config.canBusSourceAddress;
 
   j["gps"]["correctionSource"] = int( config.rtkCorrectionType );
   j["gps"]["ntrip"]["server"] = config.rtkCorrectionServer;
@@ -177,8 +218,21 @@ json parseSteerConfigToJson( const SteerConfig& config ) {
   j["gps"]["ntrip"]["username"] = config.rtkCorrectionUsername;
   j["gps"]["ntrip"]["password"] = config.rtkCorrectionPassword;
   j["gps"]["ntrip"]["mountpoint"] = config.rtkCorrectionMountpoint;
+  j["gps"]["ntrip"]["version"] = int( config.ntripVersion );
+  j["gps"]["ntrip"]["stallTimeout"] = config.ntripStallTimeout;
+  j["gps"]["ntrip"]["warmStandby"] = config.ntripWarmStandby;
+
+  for( uint8_t i = 0; i < ( sizeof( config.rtkCorrectionFallback ) / sizeof( config.rtkCorrectionFallback[0] ) ); ++i ) {
+    j["gps"]["ntrip"]["fallback"][i]["server"] = config.rtkCorrectionFallback[i].server;
+    j["gps"]["ntrip"]["fallback"][i]["port"] = config.rtkCorrectionFallback[i].port;
+    j["gps"]["ntrip"]["fallback"][i]["username"] = config.rtkCorrectionFallback[i].username;
+    j["gps"]["ntrip"]["fallback"][i]["password"] = config.rtkCorrectionFallback[i].password;
+    j["gps"]["ntrip"]["fallback"][i]["mountpoint"] = config.rtkCorrectionFallback[i].mountpoint;
+  }
+
   j["gps"]["ntrip"]["NMEAToSend"] = config.rtkCorrectionNmeaToSend;
   j["gps"]["ntrip"]["intervalSendPosition"] = config.ntripPositionSendIntervall;
+  j["gps"]["ntrip"]["distanceSendPosition"] = config.ntripPositionSendDistance;
   j["gps"]["baudrate"] = config.rtkCorrectionBaudrate;
   j["gps"]["outputTo"] = int( config.sendNmeaDataTo );
   j["gps"]["tcpPort"] = config.sendNmeaDataTcpPort;
@@ -188,6 +242,8 @@ json parseSteerConfigToJson( const SteerConfig& config ) {
   j["connection"]["mode"] = int( config.mode );
   j["connection"]["baudrate"] = config.baudrate;
   j["connection"]["enableOTA"] = config.enableOTA;
+  j["connection"]["fastBoot"] = config.fastBoot;
+  j["connection"]["lazyWebUi"] = config.lazyWebUi;
 
   j["connection"]["aog"]["sendFrom"] = config.aogPortSendFrom;
   j["connection"]["aog"]["listenTo"] = config.aogPortListenTo;
@@ -211,26 +267,34 @@ json parseSteerConfigToJson( const SteerConfig& config ) {
   return j;
 }
 
+// strings are truncated and zero padded to the size of the field, so no tail of the previous content survives
+template<size_t N>
+static void copyJsonString( char ( &field )[N], const std::string& str ) {
+  strncpy( field, str.c_str(), N - 1 );
+  field[N - 1] = '\0';
+}
+
 void parseJsonToSteerConfig( json& j, SteerConfig& config ) {
   if( j.is_object() ) {
     try {
       {
         std::string str = j.value( "/wifi/ssid"_json_pointer, steerConfigDefaults.ssid );
-        memcpy( config.ssid, str.c_str(), std::min( str.size(), sizeof( config.ssid ) ) );
+        copyJsonString( config.ssid, str );
       }
       {
         std::string str = j.value( "/wifi/password"_json_pointer, steerConfigDefaults.password );
-        memcpy( config.password, str.c_str(), std::min( str.size(), sizeof( config.password ) ) );
+        copyJsonString( config.password, str );
       }
       {
         std::string str = j.value( "/wifi/hostname"_json_pointer, steerConfigDefaults.hostname );
-        memcpy( config.hostname, str.c_str(), std::min( str.size(), sizeof( config.hostname ) ) );
+        copyJsonString( config.hostname, str );
       }
       config.apModePin = j.value( "/wifi/apModePin"_json_pointer, steerConfigDefaults.apModePin );
       config.retainWifiSettings = j.value( "/wifi/retainSettings"_json_pointer, steerConfigDefaults.retainWifiSettings );
 
       config.outputType = j.value( "/output/type"_json_pointer, steerConfigDefaults.outputType );
       config.pwmFrequency = j.value( "/output/pwmFrequency"_json_pointer, steerConfigDefaults.pwmFrequency );
+      config.wheelbase = j.value( "/output/wheelbase"_json_pointer, steerConfigDefaults.wheelbase );
       config.steeringPidMinPwm = j.value( "/output/minPWM"_json_pointer, steerConfigDefaults.steeringPidMinPwm );
       config.gpioPwm = j.value( "/output/gpioPwm"_json_pointer, steerConfigDefaults.gpioPwm );
       config.gpioDir = j.value( "/output/gpioDir"_json_pointer, steerConfigDefaults.gpioDir );
@@ -265,6 +329,9 @@ void parseJsonToSteerConfig( json& j, SteerConfig& config ) {
       config.gpioSDA = j.value( "/i2c/sda"_json_pointer, steerConfigDefaults.gpioSDA );
       config.gpioSCL = j.value( "/i2c/scl"_json_pointer, steerConfigDefaults.gpioSCL );
       config.i2cBusSpeed = j.value( "/i2c/speed"_json_pointer, steerConfigDefaults.i2cBusSpeed );
+      config.gpioSDA2 = j.value( "/i2c/sda2"_json_pointer, steerConfigDefaults.gpioSDA2 );
+      config.gpioSCL2 = j.value( "/i2c/scl2"_json_pointer, steerConfigDefaults.gpioSCL2 );
+      config.i2cBusSpeed2 = j.value( "/i2c/speed2"_json_pointer, steerConfigDefaults.i2cBusSpeed2 );
 
       config.imuType = j.value( "/imu/type"_json_pointer, steerConfigDefaults.imuType );
 
@@ -283,31 +350,65 @@ void parseJsonToSteerConfig( json& j, SteerConfig& config ) {
       config.canBusHitchThresholdHysteresis = j.value( "/canBus/hitchThresholdHysteresis"_json_pointer, steerConfigDefaults.canBusHitchThresholdHysteresis );
       config.canBusRpmThreshold = j.value( "/canBus/rpmThreshold"_json_pointer, steerConfigDefaults.canBusRpmThreshold );
       config.canBusRpmThresholdHysteresis = j.value( "/canBus/rpmThresholdHysteresis"_json_pointer, steerConfigDefaults.canBusRpmThresholdHysteresis );
+      config.canBusPreferredSourceAddress = j.value( "/canBus/preferredSourceAddress"_json_pointer, steerConfigDefaults.canBusPreferredSourceAddress );
+      config.canBusAcceptAllFrames = j.value( "/canBus/acceptAllFrames"_json_pointer, steerConfigDefaults.canBusAcceptAllFrames );
+      config.canBusSourceAddress = j.value( "/canBus/sourceAddress"_json_pointer, steerConfigDefaults.canBusSourceAddress );
 
       config.rtkCorrectionType = j.value( "/gps/correctionSource"_json_pointer, steerConfigDefaults.rtkCorrectionType );
       {
         std::string str = j.value( "/gps/ntrip/server"_json_pointer, steerConfigDefaults.rtkCorrectionServer );
-        memcpy( config.rtkCorrectionServer, str.c_str(), std::min( str.size(), sizeof( config.rtkCorrectionServer ) ) );
+        copyJsonString( config.rtkCorrectionServer, str );
       }
       config.rtkCorrectionPort = j.value( "/gps/ntrip/port"_json_pointer, steerConfigDefaults.rtkCorrectionPort );
       {
         std::string str = j.value( "/gps/ntrip/username"_json_pointer, steerConfigDefaults.rtkCorrectionUsername );
-        memcpy( config.rtkCorrectionUsername, str.c_str(), std::min( str.size(), sizeof( config.rtkCorrectionUsername ) ) );
+        copyJsonString( config.rtkCorrectionUsername, str );
       }
       {
         std::string str = j.value( "/gps/ntrip/password"_json_pointer, steerConfigDefaults.rtkCorrectionPassword );
-        memcpy( config.rtkCorrectionPassword, str.c_str(), std::min( str.size(), sizeof( config.rtkCorrectionPassword ) ) );
+        copyJsonString( config.rtkCorrectionPassword, str );
       }
       {
         std::string str = j.value( "/gps/ntrip/mountpoint"_json_pointer, steerConfigDefaults.rtkCorrectionMountpoint );
-        memcpy( config.rtkCorrectionMountpoint, str.c_str(), std::min( str.size(), sizeof( config.rtkCorrectionMountpoint ) ) );
+        copyJsonString( config.rtkCorrectionMountpoint, str );
       }
+      config.ntripVersion = j.value( "/gps/ntrip/version"_json_pointer, steerConfigDefaults.ntripVersion );
+      config.ntripStallTimeout = j.value( "/gps/ntrip/stallTimeout"_json_pointer, steerConfigDefaults.ntripStallTimeout );
+      config.ntripWarmStandby = j.value( "/gps/ntrip/warmStandby"_json_pointer, steerConfigDefaults.ntripWarmStandby );
+
+      for( uint8_t i = 0; i < ( sizeof( config.rtkCorrectionFallback ) / sizeof( config.rtkCorrectionFallback[0] ) ); ++i ) {
+        SteerConfig::NtripCaster& caster = config.rtkCorrectionFallback[i];
+        const SteerConfig::NtripCaster& defaults = steerConfigDefaults.rtkCorrectionFallback[i];
+
+        std::string path = "/gps/ntrip/fallback/";
+        path += char( '0' + i );
+
+        {
+          std::string str = j.value( json::json_pointer( path + "/server" ), defaults.server );
+          copyJsonString( caster.server, str );
+        }
+        caster.port = j.value( json::json_pointer( path + "/port" ), defaults.port );
+        {
+          std::string str = j.value( json::json_pointer( path + "/username" ), defaults.username );
+          copyJsonString( caster.username, str );
+        }
+        {
+          std::string str = j.value( json::json_pointer( path + "/password" ), defaults.password );
+          copyJsonString( caster.password, str );
+        }
+        {
+          std::string str = j.value( json::json_pointer( path + "/mountpoint" ), defaults.mountpoint );
+          copyJsonString( caster.mountpoint, str );
+        }
+      }
+
       {
         std::string str = j.value( "/gps/ntrip/NMEAToSend"_json_pointer, steerConfigDefaults.rtkCorrectionNmeaToSend );
-        memcpy( config.rtkCorrectionNmeaToSend, str.c_str(), std::min( str.size(), sizeof( config.rtkCorrectionNmeaToSend ) ) );
+        copyJsonString( config.rtkCorrectionNmeaToSend, str );
       }
 
       config.ntripPositionSendIntervall = j.value( "/gps/ntrip/intervalSendPosition"_json_pointer, steerConfigDefaults.ntripPositionSendIntervall );
+      config.ntripPositionSendDistance = j.value( "/gps/ntrip/distanceSendPosition"_json_pointer, steerConfigDefaults.ntripPositionSendDistance );
       config.rtkCorrectionBaudrate = j.value( "/gps/baudrate"_json_pointer, steerConfigDefaults.rtkCorrectionBaudrate );
       config.sendNmeaDataTo = j.value( "/gps/outputTo"_json_pointer, steerConfigDefaults.sendNmeaDataTo );
       config.sendNmeaDataTcpPort = j.value( "/gps/tcpPort"_json_pointer, steerConfigDefaults.sendNmeaDataTcpPort );
@@ -316,6 +417,8 @@ void parseJsonToSteerConfig( json& j, SteerConfig& config ) {
 
       config.baudrate = j.value( "/connection/baudrate"_json_pointer, steerConfigDefaults.baudrate );
       config.enableOTA = j.value( "/connection/enableOTA"_json_pointer, steerConfigDefaults.enableOTA );
+      config.fastBoot = j.value( "/connection/fastBoot"_json_pointer, steerConfigDefaults.fastBoot );
+      config.lazyWebUi = j.value( "/connection/lazyWebUi"_json_pointer, steerConfigDefaults.lazyWebUi );
 
       config.mode = j.value( "/connection/mode"_json_pointer, steerConfigDefaults.mode );
       config.aogPortSendFrom = j.value( "/connection/aog/sendFrom"_json_pointer, steerConfigDefaults.aogPortSendFrom );
@@ -365,34 +468,47 @@ void sendBase64DataTransmission( uint16_t channelId, const char* data, size_t le
   }
 }
 
+// called by the control tasks, so the CBOR is written to the stack instead of building a json
 void sendStateTransmission( uint16_t channelId, bool state ) {
-  json j;
-  j["channelId"] = channelId;
-  j["state"] = state;
-
-  std::vector<std::uint8_t> cbor = json::to_cbor( j );
-  udpSendFrom.broadcastTo( cbor.data(), cbor.size(), initialisation.portSendTo );
+  uint8_t buffer[24];
+  CborWriter cbor( buffer );
+  cbor.map( 2 );
+  cbor.key( "channelId" );
+  cbor.unsignedInteger( channelId );
+  cbor.key( "state" );
+  cbor.boolean( state );
+
+  udpSendFrom.broadcastTo( buffer, cbor.size(), initialisation.portSendTo );
 }
 
 void sendNumberTransmission( uint16_t channelId, double number ) {
-  json j;
-  j["channelId"] = channelId;
-  j["number"] = number;
-
-  std::vector<std::uint8_t> cbor = json::to_cbor( j );
-  udpSendFrom.broadcastTo( cbor.data(), cbor.size(), initialisation.portSendTo );
+  uint8_t buffer[32];
+  CborWriter cbor( buffer );
+  cbor.map( 2 );
+  cbor.key( "channelId" );
+  cbor.unsignedInteger( channelId );
+  cbor.key( "number" );
+  cbor.number( number );
+
+  udpSendFrom.broadcastTo( buffer, cbor.size(), initialisation.portSendTo );
 }
 
 void sendQuaternionTransmission( uint16_t channelId, imu::Quaternion quaterion ) {
-  json j;
-  j["channelId"] = channelId;
-  j["x"] = quaterion.x();
-  j["y"] = quaterion.y();
-  j["z"] = quaterion.z();
-  j["w"] = quaterion.w();
-
-  std::vector<std::uint8_t> cbor = json::to_cbor( j );
-  udpSendFrom.broadcastTo( cbor.data(), cbor.size(), initialisation.portSendTo );
+  uint8_t buffer[64];
+  CborWriter cbor( buffer );
+  cbor.map( 5 );
+  cbor.key( "channelId" );
+  cbor.unsignedInteger( channelId );
+  cbor.key( "w" );
+  cbor.number( quaterion.w() );
+  cbor.key( "x" );
+  cbor.number( quaterion.x() );
+  cbor.key( "y" );
+  cbor.number( quaterion.y() );
+  cbor.key( "z" );
+  cbor.number( quaterion.z() );
+
+  udpSendFrom.broadcastTo( buffer, cbor.size(), initialisation.portSendTo );
 }
 
 void parseJsonToFxos8700Fxas21002Calibration( json& config, Fxos8700Fxas21002CalibrationData& calibration ) {
@@ -34,6 +34,9 @@ using json = nlohmann::json;
 
 extern void loadSavedConfig();
 extern void saveConfig();
+// parses an uploaded config and stores it, the caller reboots to activate it; saveConfig() doesn't
+// overwrite it in the meantime. Returns false if the file is no valid config, nothing is stored then
+extern bool importConfigFromFile( const char* fileName );
 
 extern json loadJsonFromFile( const char* fileName );
 extern void saveJsonToFile( const json& json, const char* fileName );
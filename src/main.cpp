@@ -34,6 +34,7 @@
 
 #include <DNSServer.h>
 #include <ESPUI.h>
+#include "esp_heap_caps.h"
 
 #include <AsyncElegantOTA.h>
 
@@ -42,15 +43,15 @@
 ///////////////////////////////////////////////////////////////////////////
 SteerConfig steerConfig, steerConfigDefaults;
 Initialisation initialisation;
-SteerCanData steerCanData = {0};
+SeqLock<SteerCanData> steerCanData;
 
 portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
-SemaphoreHandle_t i2cMutex;
 
 const byte DNS_PORT = 53;
 IPAddress apIP( 192, 168, 1, 1 );
 
 uint16_t labelLoad;
+uint16_t labelBoot;
 uint16_t labelOrientation;
 uint16_t labelWheelAngle;
 uint16_t buttonReset;
@@ -63,8 +64,14 @@ uint16_t labelStatusAdc;
 uint16_t labelStatusCan;
 uint16_t labelStatusImu;
 uint16_t labelStatusInclino;
+uint16_t labelStatusI2c;
 uint16_t labelStatusGps;
 uint16_t labelStatusNtrip;
+uint16_t labelStatusTcpBridge;
+uint16_t labelCanStatistics;
+uint16_t labelStatusAog;
+
+static uint16_t tabConfigurations;
 
 ///////////////////////////////////////////////////////////////////////////
 // external Libraries
@@ -76,14 +83,148 @@ DNSServer dnsServer;
 ///////////////////////////////////////////////////////////////////////////
 // helper functions
 ///////////////////////////////////////////////////////////////////////////
+// kept over a rebuild of the WebUI
+static bool resetButtonRed = false;
+
+// set by the upload of a config, the reboot is done by loop()
+static volatile uint32_t rebootRequestedAt = 0;
+
 void setResetButtonToRed() {
-  ESPUI.getControl( buttonReset )->color = ControlColor::Alizarin;
-  ESPUI.updateControlAsync( buttonReset );
+  WebUiLock lock;
+  Control* handle = ESPUI.getControl( buttonReset );
+
+  resetButtonRed = true;
+
+  if( handle != nullptr ) {
+    handle->color = ControlColor::Alizarin;
+    ESPUI.updateControlAsync( handle );
+  }
 }
 
 void saveConfigToSPIFFS() {
 }
 
+// only called from setup() and loop(), so no locking is needed
+struct BootPhase {
+  const char* name;
+  uint32_t timestamp;
+};
+constexpr uint8_t BootPhasesMax = 12;
+static BootPhase bootPhases[BootPhasesMax];
+static uint8_t bootPhasesCount = 0;
+static bool labelBootCreated = false;
+
+static void updateBootLabel() {
+  WebUiLock lock;
+
+  if( !labelBootCreated ) {
+    return;
+  }
+
+  Control* handle = ESPUI.getControl( labelBoot );
+  String& str = handle->value;
+  str.reserve( 600 );
+
+  str = "<table style='margin:auto;'>";
+
+  for( uint8_t i = 0; i < bootPhasesCount; ++i ) {
+    str += "<tr><td style='text-align:left; padding: 0px 5px;'>";
+    str += bootPhases[i].name;
+    str += "</td><td style='text-align:left; padding: 0px 5px;'>";
+    str += bootPhases[i].timestamp;
+    str += "ms</td></tr>";
+  }
+
+  str += "</table>";
+
+  ESPUI.updateControlAsync( handle );
+}
+
+void bootPhase( const char* name ) {
+  uint32_t now = millis();
+
+  if( bootPhasesCount < BootPhasesMax ) {
+    bootPhases[bootPhasesCount++] = { name, now };
+  }
+
+  Serial.print( "Boot: " );
+  Serial.print( now );
+  Serial.print( "ms " );
+  Serial.println( name );
+
+  updateBootLabel();
+}
+
+volatile bool networkReady = false;
+static uint32_t wifiStateSince = 0;
+
+static void printWifiParameters() {
+  Serial.println( "\n\nWiFi parameters:" );
+  Serial.print( "Mode: " );
+  Serial.println( WiFi.getMode() == WIFI_AP ? "Station" : "Client" );
+  Serial.print( "IP address: " );
+  Serial.println( WiFi.getMode() == WIFI_AP ? WiFi.softAPIP() : WiFi.localIP() );
+}
+
+// connects to the configured network, if that fails a hotspot is created; called every 500ms by setup()
+// or, with fastBoot, every 100ms by loop(). Returns true when done.
+static bool updateWifi() {
+  enum class WifiState : uint8_t {
+    Connecting,
+    StartingHotspot,
+    Done
+  };
+  static WifiState state = WifiState::Connecting;
+
+  switch( state ) {
+    case WifiState::Connecting:
+      if( WiFi.status() == WL_CONNECTED ) {
+        if( steerConfig.apModePin != SteerConfig::Gpio::None ) {
+          digitalWrite( ( int )steerConfig.apModePin, HIGH );
+        }
+
+        state = WifiState::Done;
+        bootPhase( "WiFi connected" );
+      } else if( millis() - wifiStateSince >= 2500 ) {
+        // not connected -> create hotspot
+        Serial.print( "\n\nCreating hotspot" );
+
+        if( steerConfig.apModePin != SteerConfig::Gpio::None ) {
+          digitalWrite( ( int )steerConfig.apModePin, LOW );
+        }
+
+        WiFi.mode( WIFI_AP );
+        WiFi.softAPConfig( apIP, apIP, IPAddress( 255, 255, 255, 0 ) );
+        WiFi.softAP( steerConfig.ssid );
+
+        state = WifiState::StartingHotspot;
+        wifiStateSince = millis();
+      }
+
+      break;
+
+    case WifiState::StartingHotspot:
+      if( millis() - wifiStateSince >= 2500 ) {
+        state = WifiState::Done;
+        bootPhase( "hotspot created" );
+      }
+
+      break;
+
+    case WifiState::Done:
+      return true;
+  }
+
+  if( state == WifiState::Done ) {
+    dnsServer.start( DNS_PORT, "*", apIP );
+    printWifiParameters();
+    networkReady = true;
+    return true;
+  }
+
+  return false;
+}
+
 void addGpioOutput( uint16_t parent ) {
   ESPUI.addControl( ControlType::Option, "ESP32 GPIO 4", String( ( uint8_t )SteerConfig::Gpio::Esp32Gpio4 ), ControlColor::Alizarin, parent );
   ESPUI.addControl( ControlType::Option, "ESP32 GPIO 5", String( ( uint8_t )SteerConfig::Gpio::Esp32Gpio5 ), ControlColor::Alizarin, parent );
@@ -123,101 +264,222 @@ void addAnalogInputADS1115( uint16_t parent ) {
   ESPUI.addControl( ControlType::Option, "ADS1115 A2 Differential", String( ( uint8_t )SteerConfig::AnalogIn::ADS1115A2A3Differential ), ControlColor::Alizarin, parent );
 }
 
+// the fallback casters share one callback, the control is identified by its id
+static uint16_t textNtripFallback[2][5];
+
+void ntripFallbackCallback( Control* control, int id ) {
+  for( uint8_t i = 0; i < 2; ++i ) {
+    SteerConfig::NtripCaster& caster = steerConfig.rtkCorrectionFallback[i];
+
+    if( control->id == textNtripFallback[i][0] ) {
+      control->value.toCharArray( caster.server, sizeof( caster.server ) );
+    }
+
+    if( control->id == textNtripFallback[i][1] ) {
+      caster.port = control->value.toInt();
+    }
+
+    if( control->id == textNtripFallback[i][2] ) {
+      control->value.toCharArray( caster.username, sizeof( caster.username ) );
+    }
+
+    if( control->id == textNtripFallback[i][3] ) {
+      control->value.toCharArray( caster.password, sizeof( caster.password ) );
+    }
+
+    if( control->id == textNtripFallback[i][4] ) {
+      control->value.toCharArray( caster.mountpoint, sizeof( caster.mountpoint ) );
+    }
+  }
+
+  setResetButtonToRed();
+}
+
+void addNtripFallback( uint16_t parent, uint8_t index ) {
+  static const char* const labels[2][5] = {
+    { "Fallback 1: Server*", "Fallback 1: Port*", "Fallback 1: Username*", "Fallback 1: Password*", "Fallback 1: Mountpoint*" },
+    { "Fallback 2: Server*", "Fallback 2: Port*", "Fallback 2: Username*", "Fallback 2: Password*", "Fallback 2: Mountpoint*" }
+  };
+
+  SteerConfig::NtripCaster& caster = steerConfig.rtkCorrectionFallback[index];
+
+  textNtripFallback[index][0] = ESPUI.addControl( ControlType::Text, labels[index][0], String( caster.server ), ControlColor::Wetasphalt, parent, ntripFallbackCallback );
+  {
+    uint16_t num = ESPUI.addControl( ControlType::Number, labels[index][1], String( caster.port ), ControlColor::Wetasphalt, parent, ntripFallbackCallback );
+    ESPUI.addControl( ControlType::Min, "Min", "1", ControlColor::Peterriver, num );
+    ESPUI.addControl( ControlType::Max, "Max", "65535", ControlColor::Peterriver, num );
+    ESPUI.addControl( ControlType::Step, "Step", "1", ControlColor::Peterriver, num );
+    textNtripFallback[index][1] = num;
+  }
+  textNtripFallback[index][2] = ESPUI.addControl( ControlType::Text, labels[index][2], String( caster.username ), ControlColor::Wetasphalt, parent, ntripFallbackCallback );
+  textNtripFallback[index][3] = ESPUI.addControl( ControlType::Text, labels[index][3], String( caster.password ), ControlColor::Wetasphalt, parent, ntripFallbackCallback );
+  textNtripFallback[index][4] = ESPUI.addControl( ControlType::Text, labels[index][4], String( caster.mountpoint ), ControlColor::Wetasphalt, parent, ntripFallbackCallback );
+}
+
 ///////////////////////////////////////////////////////////////////////////
-// Application
+// WebUI
 ///////////////////////////////////////////////////////////////////////////
-void setup( void ) {
-  ESPUI.setVerbosity(Verbosity::VerboseJSON);
-  Serial.begin( 115200 );
-
-  WiFi.disconnect( true );
+SemaphoreHandle_t webUiMutex = nullptr;
+volatile uint32_t webUiHeapUsage = 0;
+
+static bool webUiBuilt = false;
+// number of controls removed by the last teardown
+static uint16_t webUiControls = 0;
+
+// the ids used from outside of the WebUI; they are invalidated by a teardown
+static uint16_t* const webUiIds[] = {
+  &labelLoad, &labelBoot, &labelOrientation, &labelWheelAngle, &buttonReset, &textNmeaToSend,
+  &labelWheelAngleDisplacement, &labelStatusOutput, &labelStatusAdc, &labelStatusCan, &labelStatusImu,
+  &labelStatusInclino, &labelStatusI2c, &labelStatusGps, &labelStatusNtrip, &labelStatusTcpBridge,
+  &labelCanStatistics, &labelStatusAog, &tabConfigurations
+};
+
+// some of the status labels are only set once while initialising, so keep their texts over a teardown
+static uint16_t* const statusLabels[] = {
+  &labelStatusOutput, &labelStatusAdc, &labelStatusCan, &labelStatusImu, &labelStatusInclino,
+  &labelStatusI2c, &labelStatusGps, &labelStatusNtrip, &labelStatusTcpBridge, &labelCanStatistics
+};
+constexpr uint8_t StatusLabelsCount = sizeof( statusLabels ) / sizeof( statusLabels[0] );
+
+struct StatusLabelCache {
+  String value;
+  ControlColor color;
+  bool valid;
+};
+static StatusLabelCache statusLabelCache[StatusLabelsCount];
+
+// time without a connected browser, after which the controls get freed
+constexpr uint32_t WebUiTeardownDelay = 30000;
+
+static void restoreStatusLabels() {
+  for( uint8_t i = 0; i < StatusLabelsCount; ++i ) {
+    Control* handle = ESPUI.getControl( *statusLabels[i] );
+
+    if( handle != nullptr && statusLabelCache[i].valid ) {
+      handle->value = statusLabelCache[i].value;
+      handle->color = statusLabelCache[i].color;
+      statusLabelCache[i].value = String();
+      statusLabelCache[i].valid = false;
+    }
+  }
+}
 
-  Wire.begin( ( int )steerConfig.gpioSDA, ( int )steerConfig.gpioSCL, steerConfig.i2cBusSpeed );
+void updateStatusLabel( uint16_t& label, const String& value, ControlColor color ) {
+  WebUiLock lock;
+  Control* handle = ESPUI.getControl( label );
 
-  if( !SPIFFS.begin( true ) ) {
-    Serial.println( "SPIFFS Mount Failed" );
+  if( handle != nullptr ) {
+    handle->value = value;
+    handle->color = color;
+    ESPUI.updateControlAsync( handle );
     return;
   }
 
-  loadSavedConfig();
+  for( uint8_t i = 0; i < StatusLabelsCount; ++i ) {
+    if( statusLabels[i] == &label ) {
+      statusLabelCache[i].value = value;
+      statusLabelCache[i].color = color;
+      statusLabelCache[i].valid = true;
+    }
+  }
+}
 
-  Serial.updateBaudRate( steerConfig.baudrate );
+static void teardownWebUi() {
+  WebUiLock lock;
 
-  if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
-    Serial.println( "Welcome to esp32-aog.\nThe selected mode is QtOpenGuidance.\nTo configure, please open the webui." );
+  // ESPUI sends the controls to a connecting browser from the task of AsyncTCP, without taking the lock,
+  // so no WebSocket is accepted while they are freed
+  ESPUI.ws->enable( false );
+
+  // a browser connected since updateWebUi() checked
+  if( ESPUI.ws->count() > 0 ) {
+    ESPUI.ws->enable( true );
+    return;
   }
 
-  if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
-    Serial.println( "Welcome to esp32-aog.\nThe selected mode is AgOpenGps.\nTo configure, please open the webui." );
+  uint32_t freeHeap = heap_caps_get_free_size( MALLOC_CAP_8BIT );
+
+  for( uint8_t i = 0; i < StatusLabelsCount; ++i ) {
+    Control* handle = ESPUI.getControl( *statusLabels[i] );
+
+    if( handle != nullptr ) {
+      statusLabelCache[i].value = handle->value;
+      statusLabelCache[i].color = handle->color;
+      statusLabelCache[i].valid = true;
+    }
   }
 
-  if( steerConfig.apModePin != SteerConfig::Gpio::None ) {
-    pinMode( ( int )steerConfig.apModePin, OUTPUT );
-    digitalWrite( ( int )steerConfig.apModePin, LOW );
+  // the controls are created in one go, so their ids are consecutive, starting with labelLoad
+  uint16_t id = labelLoad;
+  webUiControls = 0;
+
+  while( ESPUI.removeControl( id++ ) ) {
+    ++webUiControls;
   }
 
-#if defined(ESP32)
-  WiFi.setHostname( steerConfig.hostname );
-#else
-  WiFi.hostname( steerConfig.hostname );
-#endif
+  for( uint16_t* webUiId : webUiIds ) {
+    *webUiId = Control::noParent;
+  }
 
-  // try to connect to existing network
-  WiFi.begin( steerConfig.ssid, steerConfig.password );
-  Serial.print( "\n\nTry to connect to existing network \"" );
-  Serial.print( steerConfig.ssid );
-  Serial.print( "\" with password \"" );
-  Serial.print( steerConfig.password );
-  Serial.print( "\"" );
+  labelBootCreated = false;
+  webUiBuilt = false;
+  webUiHeapUsage = heap_caps_get_free_size( MALLOC_CAP_8BIT ) - freeHeap;
 
-  {
-    uint8_t timeout = 5;
+  // the browser reconnecting gets the controls built by updateWebUi()
+  ESPUI.ws->enable( true );
 
-    // Wait for connection, 2.5s timeout
-    do {
-      delay( 500 );
-      Serial.print( "." );
-      timeout--;
-    } while( timeout && WiFi.status() != WL_CONNECTED );
+  Serial.print( "WebUI freed, " );
+  Serial.print( webUiControls );
+  Serial.print( " controls, heap returned: " );
+  Serial.println( webUiHeapUsage );
+}
 
-    // not connected -> create hotspot
-    if( WiFi.status() != WL_CONNECTED ) {
-      Serial.print( "\n\nCreating hotspot" );
+static void buildWebUi();
 
-      if( steerConfig.apModePin != SteerConfig::Gpio::None ) {
-        digitalWrite( ( int )steerConfig.apModePin, LOW );
-      }
+// called by loop(): builds the controls as soon as a browser connects, and frees them with lazyWebUi
+// after the last one disconnected
+static void updateWebUi() {
+  static uint32_t lastClientSeen = 0;
+  uint32_t now = millis();
 
-      WiFi.mode( WIFI_AP );
-      WiFi.softAPConfig( apIP, apIP, IPAddress( 255, 255, 255, 0 ) );
-      WiFi.softAP( steerConfig.ssid );
+  // setup() didn't get to start the webserver
+  if( ESPUI.ws == nullptr ) {
+    return;
+  }
 
-      timeout = 5;
+  if( ESPUI.ws->count() > 0 ) {
+    lastClientSeen = now;
 
-      do {
-        delay( 500 );
-        Serial.print( "." );
-        timeout--;
-      } while( timeout );
-    } else {
-      if( steerConfig.apModePin != SteerConfig::Gpio::None ) {
-        digitalWrite( ( int )steerConfig.apModePin, HIGH );
-      }
+    if( !webUiBuilt ) {
+      buildWebUi();
+      // the browser got an empty page on connecting, so let it load again
+      ESPUI.jsonReload();
     }
-  }
 
-  dnsServer.start( DNS_PORT, "*", apIP );
+    return;
+  }
 
-  Serial.println( "\n\nWiFi parameters:" );
-  Serial.print( "Mode: " );
-  Serial.println( WiFi.getMode() == WIFI_AP ? "Station" : "Client" );
-  Serial.print( "IP address: " );
-  Serial.println( WiFi.getMode() == WIFI_AP ? WiFi.softAPIP() : WiFi.localIP() );
+  // the ids are never reused by ESPUI, so stop freeing the controls before they run out
+  if( steerConfig.lazyWebUi && webUiBuilt &&
+      ( now - lastClientSeen ) > WebUiTeardownDelay &&
+      ( uint32_t )labelLoad + 2 * ( uint32_t )webUiControls < Control::noParent ) {
+    teardownWebUi();
+  }
 
+  // with fastBoot, setup() leaves the controls to be built here, after the control chain got started
+  if( !steerConfig.lazyWebUi && !webUiBuilt ) {
+    buildWebUi();
+  }
+}
 
-  steerImuInclinometerData.sendCalibrationDataFromImu = false;
+static void buildWebUi() {
+  WebUiLock lock;
+  uint32_t freeHeap = heap_caps_get_free_size( MALLOC_CAP_8BIT );
 
   labelLoad = ESPUI.addControl( ControlType::Label, "Load:", "", ControlColor::Turquoise );
+  labelBoot = ESPUI.addControl( ControlType::Label, "Boot:", "", ControlColor::Turquoise );
+  labelBootCreated = true;
+  updateBootLabel();
   labelOrientation = ESPUI.addControl( ControlType::Label, "Orientation:", "", ControlColor::Emerald );
   labelWheelAngle = ESPUI.addControl( ControlType::Label, "Wheel Angle:", "0°", ControlColor::Emerald );
   // graphWheelAngle = ESPUI.addControl( ControlType::Graph, "Wheel Angle:", "", ControlColor::Emerald );
@@ -229,7 +491,7 @@ void setup( void ) {
     }
   } );
 
-  buttonReset = ESPUI.addControl( ControlType::Button, "If this turns red, you have to", "Apply & Reboot", ControlColor::Emerald, Control::noParent,
+  buttonReset = ESPUI.addControl( ControlType::Button, "If this turns red, you have to", "Apply & Reboot", resetButtonRed ? ControlColor::Alizarin : ControlColor::Emerald, Control::noParent,
   []( Control * control, int id ) {
     if( id == B_UP ) {
       saveConfig();
@@ -238,8 +500,6 @@ void setup( void ) {
     }
   } );
 
-  uint16_t tabConfigurations;
-
   // Status Tab
   {
     uint16_t tab = ESPUI.addControl( ControlType::Tab, "Status", "Status" );
@@ -249,12 +509,21 @@ void setup( void ) {
     labelStatusCan = ESPUI.addControl( ControlType::Label, "CAN:", "No CAN BUS configured", ControlColor::Turquoise, tab );
     labelStatusImu = ESPUI.addControl( ControlType::Label, "IMU:", "No IMU configured", ControlColor::Turquoise, tab );
 
+    labelStatusInclino = Control::noParent;
+    labelStatusAog = Control::noParent;
+
     if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
       labelStatusInclino = ESPUI.addControl( ControlType::Label, "Inclinometer:", "No Inclinometer configured", ControlColor::Turquoise, tab );
     }
 
+    labelStatusI2c = ESPUI.addControl( ControlType::Label, "I2C:", "No Transactions", ControlColor::Turquoise, tab );
+
     labelStatusGps = ESPUI.addControl( ControlType::Label, "GPS:", "Not configured", ControlColor::Turquoise, tab );
     labelStatusNtrip = ESPUI.addControl( ControlType::Label, "NTRIP:", "Not configured", ControlColor::Turquoise, tab );
+
+    if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
+      labelStatusAog = ESPUI.addControl( ControlType::Label, "PGNs from AgOpenGPS:", "No packets received", ControlColor::Turquoise, tab );
+    }
   }
 
   // Info Tab
@@ -336,6 +605,17 @@ void setup( void ) {
       setResetButtonToRed();
     } );
 
+    ESPUI.addControl( ControlType::Switcher, "Fast Boot (WiFi and WebUI in the background)*", steerConfig.fastBoot ? "1" : "0", ControlColor::Wetasphalt, tab,
+    []( Control * control, int id ) {
+      steerConfig.fastBoot = control->value.toInt() == 1;
+      setResetButtonToRed();
+    } );
+
+    ESPUI.addControl( ControlType::Switcher, "Free the WebUI without connected Browser", steerConfig.lazyWebUi ? "1" : "0", ControlColor::Peterriver, tab,
+    []( Control * control, int id ) {
+      steerConfig.lazyWebUi = control->value.toInt() == 1;
+    } );
+
     if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
       ESPUI.addControl( ControlType::Number, "Port to send to*", String( steerConfig.qogPortSendTo ), ControlColor::Wetasphalt, tab,
       []( Control * control, int id ) {
@@ -407,6 +687,36 @@ void setup( void ) {
       ESPUI.addControl( ControlType::Option, "250kB/s", "250", ControlColor::Alizarin, sel );
       ESPUI.addControl( ControlType::Option, "500kB/s", "500", ControlColor::Alizarin, sel );
     }
+
+    {
+      uint16_t num = ESPUI.addControl( ControlType::Number, "Preferred Source Address (255 = first ECU sending)", String( steerConfig.canBusPreferredSourceAddress ), ControlColor::Peterriver, tab,
+      []( Control * control, int id ) {
+        steerConfig.canBusPreferredSourceAddress = control->value.toInt();
+      } );
+      ESPUI.addControl( ControlType::Min, "Min", "0", ControlColor::Peterriver, num );
+      ESPUI.addControl( ControlType::Max, "Max", "255", ControlColor::Peterriver, num );
+      ESPUI.addControl( ControlType::Step, "Step", "1", ControlColor::Peterriver, num );
+    }
+
+    {
+      uint16_t num = ESPUI.addControl( ControlType::Number, "Own Source Address (for the ISOBUS Guidance)*", String( steerConfig.canBusSourceAddress ), ControlColor::Wetasphalt, tab,
+      []( Control * control, int id ) {
+        steerConfig.canBusSourceAddress = control->value.toInt();
+        setResetButtonToRed();
+      } );
+      ESPUI.addControl( ControlType::Min, "Min", "0", ControlColor::Wetasphalt, num );
+      ESPUI.addControl( ControlType::Max, "Max", "253", ControlColor::Wetasphalt, num );
+      ESPUI.addControl( ControlType::Step, "Step", "1", ControlColor::Wetasphalt, num );
+    }
+
+    ESPUI.addControl( ControlType::Switcher, "Accept all Frames (disables the hardware filter)*", steerConfig.canBusAcceptAllFrames ? "1" : "0", ControlColor::Wetasphalt, tab,
+    []( Control * control, int id ) {
+      steerConfig.canBusAcceptAllFrames = control->value.toInt() == 1;
+      setResetButtonToRed();
+    } );
+
+    labelCanStatistics = ESPUI.addControl( ControlType::Label, "Statistics:", "No CAN BUS configured", ControlColor::Turquoise, tab );
+    ESPUI.addControl( ControlType::Label, "Download the trace of the last frames (candump -l format):", "<a href='can.log'>can.log</a>", ControlColor::Peterriver, tab );
   }
 
   // Switches/Buttons Tab
@@ -661,6 +971,7 @@ void setup( void ) {
       ESPUI.addControl( ControlType::Option, "Motor: IBT 2", "2", ControlColor::Alizarin, sel );
       ESPUI.addControl( ControlType::Option, "Hydraulic: IBT 2 + PWM 2-Coil Valve", "3", ControlColor::Alizarin, sel );
       ESPUI.addControl( ControlType::Option, "Hydraulic: IBT 2 + Danfoss Valve PVE A/H/M", "4", ControlColor::Alizarin, sel );
+      ESPUI.addControl( ControlType::Option, "ISOBUS: Guidance System Command over CAN", "5", ControlColor::Alizarin, sel );
     }
 
     {
@@ -698,6 +1009,16 @@ void setup( void ) {
       steerConfig.invertOutput = control->value.toInt() == 1;
     } );
 
+    {
+      uint16_t num = ESPUI.addControl( ControlType::Number, "Wheelbase (m, for the ISOBUS Guidance)", String( steerConfig.wheelbase ), ControlColor::Peterriver, tab,
+      []( Control * control, int id ) {
+        steerConfig.wheelbase = control->value.toFloat();
+      } );
+      ESPUI.addControl( ControlType::Min, "Min", "0", ControlColor::Peterriver, num );
+      ESPUI.addControl( ControlType::Max, "Max", "20", ControlColor::Peterriver, num );
+      ESPUI.addControl( ControlType::Step, "Step", "0.01", ControlColor::Peterriver, num );
+    }
+
     // {
     // uint16_t num = ESPUI.addControl( ControlType::Slider, "PWM Frequency", String( steerConfig.pwmFrequency ), ControlColor::Peterriver, tab,
     // []( Control * control, int id ) {
@@ -809,7 +1130,7 @@ void setup( void ) {
       addGpioOutput( sel );
     }
     {
-      uint16_t num = ESPUI.addControl( ControlType::Number, "I2C Bus Speed*", String( steerConfig.i2cBusSpeed ), ControlColor::Wetasphalt, tab,
+      uint16_t num = ESPUI.addControl( ControlType::Number, "I2C Bus Speed (maximum)*", String( steerConfig.i2cBusSpeed ), ControlColor::Wetasphalt, tab,
       []( Control * control, int id ) {
         steerConfig.i2cBusSpeed = control->value.toInt();
       } );
@@ -817,6 +1138,34 @@ void setup( void ) {
       ESPUI.addControl( ControlType::Max, "Max", "5000000", ControlColor::Peterriver, num );
       ESPUI.addControl( ControlType::Step, "Step", "1000", ControlColor::Peterriver, num );
     }
+    {
+      uint16_t sel = ESPUI.addControl( ControlType::Select, "Second I2C Bus (only ADS1115) SDA Gpio*", String( ( int )steerConfig.gpioSDA2 ), ControlColor::Wetasphalt, tab,
+      []( Control * control, int id ) {
+        steerConfig.gpioSDA2 = ( SteerConfig::Gpio )control->value.toInt();
+        setResetButtonToRed();
+      } );
+      ESPUI.addControl( ControlType::Option, "None", "0", ControlColor::Alizarin, sel );
+      addGpioOutput( sel );
+    }
+    {
+      uint16_t sel = ESPUI.addControl( ControlType::Select, "Second I2C Bus (only ADS1115) SCL Gpio*", String( ( int )steerConfig.gpioSCL2 ), ControlColor::Wetasphalt, tab,
+      []( Control * control, int id ) {
+        steerConfig.gpioSCL2 = ( SteerConfig::Gpio )control->value.toInt();
+        setResetButtonToRed();
+      } );
+      ESPUI.addControl( ControlType::Option, "None", "0", ControlColor::Alizarin, sel );
+      addGpioOutput( sel );
+    }
+    {
+      uint16_t num = ESPUI.addControl( ControlType::Number, "Second I2C Bus Speed (maximum)*", String( steerConfig.i2cBusSpeed2 ), ControlColor::Wetasphalt, tab,
+      []( Control * control, int id ) {
+        steerConfig.i2cBusSpeed2 = control->value.toInt();
+        setResetButtonToRed();
+      } );
+      ESPUI.addControl( ControlType::Min, "Min", "10000", ControlColor::Peterriver, num );
+      ESPUI.addControl( ControlType::Max, "Max", "5000000", ControlColor::Peterriver, num );
+      ESPUI.addControl( ControlType::Step, "Step", "1000", ControlColor::Peterriver, num );
+    }
     {
       uint16_t sel = ESPUI.addControl( ControlType::Select, "IMU*", String( ( int )steerConfig.imuType ), ControlColor::Wetasphalt, tab,
       []( Control * control, int id ) {
@@ -828,9 +1177,12 @@ void setup( void ) {
     }
 
     {
-      ESPUI.addControl( ControlType::Switcher, "Send Calibration Data from IMU to USB", steerImuInclinometerData.sendCalibrationDataFromImu ? "1" : "0", ControlColor::Peterriver, tab,
+      ESPUI.addControl( ControlType::Switcher, "Send Calibration Data from IMU to USB", steerImuInclinometerData.read().sendCalibrationDataFromImu ? "1" : "0", ControlColor::Peterriver, tab,
       []( Control * control, int id ) {
-        steerImuInclinometerData.sendCalibrationDataFromImu = control->value.toInt() == 1;
+        bool sendCalibrationDataFromImu = control->value.toInt() == 1;
+        steerImuInclinometerData.update( [sendCalibrationDataFromImu]( SteerImuInclinometerData & data ) {
+          data.sendCalibrationDataFromImu = sendCalibrationDataFromImu;
+        } );
       } );
     }
 
@@ -901,8 +1253,8 @@ void setup( void ) {
       } );
       ESPUI.addControl( ControlType::Option, "No Correction", "0", ControlColor::Alizarin, sel );
       ESPUI.addControl( ControlType::Option, "NTRIP", "1", ControlColor::Alizarin, sel );
-      // ESPUI.addControl( ControlType::Option, "UDP", "2", ControlColor::Alizarin, sel );
-      // ESPUI.addControl( ControlType::Option, "TCP", "3", ControlColor::Alizarin, sel );
+      ESPUI.addControl( ControlType::Option, "UDP (listen on Port)", "2", ControlColor::Alizarin, sel );
+      ESPUI.addControl( ControlType::Option, "TCP (connect to Server:Port)", "3", ControlColor::Alizarin, sel );
     }
 
     ESPUI.addControl( ControlType::Text, "Server*", String( steerConfig.rtkCorrectionServer ), ControlColor::Wetasphalt, tab,
@@ -934,6 +1286,41 @@ void setup( void ) {
       ESPUI.addControl( ControlType::Max, "Max", "65535", ControlColor::Peterriver, num );
       ESPUI.addControl( ControlType::Step, "Step", "1", ControlColor::Peterriver, num );
     }
+    {
+      uint16_t sel = ESPUI.addControl( ControlType::Select, "NTRIP Version*", String( ( int )steerConfig.ntripVersion ), ControlColor::Wetasphalt, tab,
+      []( Control * control, int id ) {
+        steerConfig.ntripVersion = ( SteerConfig::NtripVersion )control->value.toInt();
+        setResetButtonToRed();
+      } );
+      ESPUI.addControl( ControlType::Option, "NTRIP 1.0", "1", ControlColor::Alizarin, sel );
+      ESPUI.addControl( ControlType::Option, "NTRIP 2.0 (HTTP/1.1, chunked)", "2", ControlColor::Alizarin, sel );
+    }
+
+    {
+      uint16_t num = ESPUI.addControl( ControlType::Number, "Switch to fallback after no data for (s)", String( steerConfig.ntripStallTimeout ), ControlColor::Peterriver, tab,
+      []( Control * control, int id ) {
+        steerConfig.ntripStallTimeout = control->value.toInt();
+      } );
+      ESPUI.addControl( ControlType::Min, "Min", "0", ControlColor::Peterriver, num );
+      ESPUI.addControl( ControlType::Max, "Max", "60", ControlColor::Peterriver, num );
+      ESPUI.addControl( ControlType::Step, "Step", "1", ControlColor::Peterriver, num );
+    }
+    ESPUI.addControl( ControlType::Switcher, "Keep a fallback connected (warm standby)*", steerConfig.ntripWarmStandby ? "1" : "0", ControlColor::Wetasphalt, tab,
+    []( Control * control, int id ) {
+      steerConfig.ntripWarmStandby = control->value.toInt() == 1;
+      setResetButtonToRed();
+    } );
+
+    addNtripFallback( tab, 0 );
+    addNtripFallback( tab, 1 );
+
+    ESPUI.addControl( ControlType::Button, "Retrieve the sourcetable of the caster", "Retrieve", ControlColor::Peterriver, tab,
+    []( Control * control, int id ) {
+      if( id == B_UP ) {
+        requestNtripSourcetable();
+      }
+    } );
+    ESPUI.addControl( ControlType::Label, "Download the sourcetable:", "<a href='sourcetable.txt'>Sourcetable</a>", ControlColor::Peterriver, tab );
 
     {
       uint16_t baudrate = ESPUI.addControl( ControlType::Select, "Baudrate GPS", String( steerConfig.rtkCorrectionBaudrate ), ControlColor::Peterriver, tab,
@@ -957,6 +1344,10 @@ void setup( void ) {
     []( Control * control, int id ) {
       steerConfig.ntripPositionSendIntervall = control->value.toInt();
     } );
+    ESPUI.addControl( ControlType::Number, "Send Position when moved more than (m, 0 = off)", String( steerConfig.ntripPositionSendDistance ), ControlColor::Peterriver, tab,
+    []( Control * control, int id ) {
+      steerConfig.ntripPositionSendDistance = control->value.toInt();
+    } );
 
     textNmeaToSend = ESPUI.addControl( ControlType::Text, "NMEA-String to send (leave empty to send live position)", String( steerConfig.rtkCorrectionNmeaToSend ), ControlColor::Peterriver, tab,
     []( Control * control, int id ) {
@@ -997,6 +1388,8 @@ void setup( void ) {
       ESPUI.addControl( ControlType::Max, "Max", "65535", ControlColor::Peterriver, num );
       ESPUI.addControl( ControlType::Step, "Step", "1", ControlColor::Peterriver, num );
     }
+
+    labelStatusTcpBridge = ESPUI.addControl( ControlType::Label, "Clients on the TCP-Socket:", "No clients connected", ControlColor::Turquoise, tab );
   }
 
   if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
@@ -1150,7 +1543,7 @@ void setup( void ) {
 
     ESPUI.addControl( ControlType::Label, "Download the config:", "<a href='config.json'>Configuration</a>", ControlColor::Carrot, tab );
 
-    ESPUI.addControl( ControlType::Label, "Upload the config:", "<form method='POST' action='/upload-config' enctype='multipart/form-data'><input name='f' type='file'><input type='submit'></form>", ControlColor::Carrot, tab );
+    ESPUI.addControl( ControlType::Label, "Upload the config (reboots to activate it):", "<form method='POST' action='/upload-config' enctype='multipart/form-data'><input name='f' type='file'><input type='submit'></form>", ControlColor::Carrot, tab );
 
     ESPUI.addControl( ControlType::Label, "Download the calibration:", "<a href='calibration.json'>Calibration</a>", ControlColor::Carrot, tab );
 
@@ -1189,7 +1582,126 @@ void setup( void ) {
 
   }
 
-  i2cMutex = xSemaphoreCreateMutex();
+  // the labels written by the control tasks get their buffers now, so these don't allocate later on
+  const struct {
+    uint16_t id;
+    uint16_t size;
+  } labelBuffers[] = {
+    { labelOrientation, 80 }, { labelWheelAngle, 100 }, { labelStatusOutput, 128 },
+    { labelStatusI2c, 1024 }, { labelStatusCan, 1024 }, { labelCanStatistics, 800 },
+    { labelStatusAog, 1024 }
+  };
+
+  for( const auto& labelBuffer : labelBuffers ) {
+    Control* handle = ESPUI.getControl( labelBuffer.id );
+
+    if( handle != nullptr ) {
+      handle->value.reserve( labelBuffer.size );
+    }
+  }
+
+  restoreStatusLabels();
+  webUiBuilt = true;
+  webUiHeapUsage = freeHeap - heap_caps_get_free_size( MALLOC_CAP_8BIT );
+
+  Serial.print( "WebUI built, heap used: " );
+  Serial.println( webUiHeapUsage );
+
+  static bool firstBuild = true;
+
+  if( firstBuild ) {
+    firstBuild = false;
+    bootPhase( "UI built" );
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Application
+///////////////////////////////////////////////////////////////////////////
+// the status labels written while initialising are cached by updateStatusLabel() until the WebUI is built
+static void initControlChain() {
+  initSensors();
+  bootPhase( "sensors initialised" );
+
+  initCan();
+
+  initAutosteer();
+  bootPhase( "control chain started" );
+}
+
+void setup( void ) {
+  webUiMutex = xSemaphoreCreateRecursiveMutex();
+  ESPUI.setVerbosity(Verbosity::VerboseJSON);
+  Serial.begin( 115200 );
+  bootPhase( "setup" );
+
+  WiFi.disconnect( true );
+
+  if( !SPIFFS.begin( true ) ) {
+    Serial.println( "SPIFFS Mount Failed" );
+    return;
+  }
+
+  initCrashReport();
+
+  loadSavedConfig();
+  bootPhase( "config loaded" );
+
+  // after loading the config, so the configured pins and speeds are used
+  Wire.begin( ( int )steerConfig.gpioSDA, ( int )steerConfig.gpioSCL, steerConfig.i2cBusSpeed );
+
+  if( steerConfig.gpioSDA2 != SteerConfig::Gpio::None && steerConfig.gpioSCL2 != SteerConfig::Gpio::None ) {
+    Wire1.begin( ( int )steerConfig.gpioSDA2, ( int )steerConfig.gpioSCL2, steerConfig.i2cBusSpeed2 );
+  }
+
+  Serial.updateBaudRate( steerConfig.baudrate );
+
+  if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
+    Serial.println( "Welcome to esp32-aog.\nThe selected mode is QtOpenGuidance.\nTo configure, please open the webui." );
+  }
+
+  if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
+    Serial.println( "Welcome to esp32-aog.\nThe selected mode is AgOpenGps.\nTo configure, please open the webui." );
+  }
+
+  if( steerConfig.apModePin != SteerConfig::Gpio::None ) {
+    pinMode( ( int )steerConfig.apModePin, OUTPUT );
+    digitalWrite( ( int )steerConfig.apModePin, LOW );
+  }
+
+#if defined(ESP32)
+  WiFi.setHostname( steerConfig.hostname );
+#else
+  WiFi.hostname( steerConfig.hostname );
+#endif
+
+  // try to connect to existing network
+  WiFi.begin( steerConfig.ssid, steerConfig.password );
+  wifiStateSince = millis();
+  Serial.print( "\n\nTry to connect to existing network \"" );
+  Serial.print( steerConfig.ssid );
+  Serial.print( "\" with password \"" );
+  Serial.print( steerConfig.password );
+  Serial.print( "\"" );
+
+  steerImuInclinometerData.update( []( SteerImuInclinometerData & data ) {
+    data.sendCalibrationDataFromImu = false;
+  } );
+
+  // with fastBoot, the control chain is started right away and loop() waits for the connection and
+  // builds the WebUI; the webserver and UDP already listen in the meantime, as WiFi.begin() has
+  // initialised the network stack
+  if( steerConfig.fastBoot ) {
+    initControlChain();
+  } else {
+    // Wait for connection, 2.5s timeout, then 2.5s for the hotspot
+    do {
+      delay( 500 );
+      Serial.print( "." );
+    } while( !updateWifi() );
+
+    buildWebUi();
+  }
 
   /*
   * .begin loads and serves all files from PROGMEM directly.
@@ -1224,12 +1736,42 @@ void setup( void ) {
   ESPUI.server->on( "/calibration.json", HTTP_GET, []( AsyncWebServerRequest * request ) {
     request->send( SPIFFS, "/calibration.json", "application/json", true );
   } );
+  ESPUI.server->on( "/crash.json", HTTP_GET, []( AsyncWebServerRequest * request ) {
+    if( SPIFFS.exists( "/crash.json" ) ) {
+      request->send( SPIFFS, "/crash.json", "application/json", true );
+    } else {
+      request->send( 404, "text/plain", "No crash recorded" );
+    }
+  } );
+  ESPUI.server->on( "/sourcetable.txt", HTTP_GET, []( AsyncWebServerRequest * request ) {
+    request->send( SPIFFS, "/sourcetable.txt", "text/plain" );
+  } );
+  ESPUI.server->on( "/can.log", HTTP_GET, []( AsyncWebServerRequest * request ) {
+    uint32_t position, end;
+    canTraceRange( position, end );
+
+    request->send( request->beginChunkedResponse( "text/plain", [position, end]( uint8_t* buffer, size_t maxLen, size_t index ) mutable -> size_t {
+      return canTraceRead( position, end, buffer, maxLen );
+    } ) );
+  } );
 
   // upload a file to /upload-config
+  // the response is sent after the upload handler, both run on the task of AsyncTCP
+  static bool configUploadImported = false;
   ESPUI.server->on( "/upload-config", HTTP_POST, []( AsyncWebServerRequest * request ) {
-    request->send( 200 );
-  }, [tabConfigurations]( AsyncWebServerRequest * request, String filename, size_t index, uint8_t* data, size_t len, bool final ) {
+    if( configUploadImported ) {
+      // rebooted by loop(), after the response is sent; the page reloads the WebUI once it is up again
+      rebootRequestedAt = millis();
+      String str( "<html><head><meta http-equiv='refresh' content='10; url=/#tab" );
+      str += tabConfigurations;
+      str += "'></head><body>Config imported, rebooting to activate it...</body></html>";
+      request->send( 200, "text/html", str );
+    } else {
+      request->send( 400, "text/plain", "Not a valid config, nothing changed" );
+    }
+  }, []( AsyncWebServerRequest * request, String filename, size_t index, uint8_t* data, size_t len, bool final ) {
     if( !index ) {
+      configUploadImported = false;
       request->_tempFile = SPIFFS.open( "/config.json", "w" );
     }
 
@@ -1240,10 +1782,8 @@ void setup( void ) {
 
       if( final ) {
         request->_tempFile.close();
-        setResetButtonToRed();
-        String str( "/#tab" );
-        str += tabConfigurations;
-        request->redirect( str );
+
+        configUploadImported = importConfigFromFile( "/config.json" );
       }
     }
   } );
@@ -1251,7 +1791,7 @@ void setup( void ) {
   // upload a file to /upload-calibration
   ESPUI.server->on( "/upload-calibration", HTTP_POST, []( AsyncWebServerRequest * request ) {
     request->send( 200 );
-  }, [tabConfigurations]( AsyncWebServerRequest * request, String filename, size_t index, uint8_t* data, size_t len, bool final ) {
+  }, []( AsyncWebServerRequest * request, String filename, size_t index, uint8_t* data, size_t len, bool final ) {
     if( !index ) {
       request->_tempFile = SPIFFS.open( "/calibration.json", "w" );
     }
@@ -1275,17 +1815,27 @@ void setup( void ) {
     AsyncElegantOTA.begin( ESPUI.server );
   }
 
-  initIdleStats();
+  if( !steerConfig.fastBoot ) {
+    initControlChain();
+  }
 
-  initSensors();
+  initIdleStats();
   initRtkCorrection();
-
-  initCan();
-
-  initAutosteer();
+  bootPhase( "setup done" );
 }
 
 void loop( void ) {
+  if( !networkReady ) {
+    updateWifi();
+  }
+
+  updateWebUi();
+
+  if( rebootRequestedAt != 0 && millis() - rebootRequestedAt > 1000 ) {
+    SPIFFS.end();
+    ESP.restart();
+  }
+
   dnsServer.processNextRequest();
   AsyncElegantOTA.loop();
   vTaskDelay( 100 );
@@ -36,12 +36,14 @@
 #include <utility/quaternion.h>
 
 #include "average.hpp"
+#include "seqlock.hpp"
 
 #include "jsonqueueselector.h"
 
 extern JsonQueueSelector jsonQueueSelector;
 
 extern uint16_t labelLoad;
+extern uint16_t labelBoot;
 extern uint16_t labelOrientation;
 extern uint16_t labelWheelAngle;
 extern uint16_t textNmeaToSend;
@@ -51,10 +53,41 @@ extern uint16_t labelStatusAdc;
 extern uint16_t labelStatusCan;
 extern uint16_t labelStatusImu;
 extern uint16_t labelStatusInclino;
+extern uint16_t labelStatusI2c;
 extern uint16_t labelStatusGps;
 extern uint16_t labelStatusNtrip;
+extern uint16_t labelStatusTcpBridge;
+extern uint16_t labelCanStatistics;
+extern uint16_t labelStatusAog;
+
+// With lazyWebUi, the controls only exist while a browser is connected and their ids change with every
+// rebuild. Take this lock for every access with ESPUI.getControl() from outside of the callbacks of
+// ESPUI, and check the returned handle for nullptr. The real-time tasks use a timeout of 0 and skip the
+// update if the WebUI is being built.
+extern SemaphoreHandle_t webUiMutex;
+class WebUiLock {
+  public:
+    WebUiLock( TickType_t timeout = portMAX_DELAY ) {
+      locked = xSemaphoreTakeRecursive( webUiMutex, timeout ) == pdTRUE;
+    }
+    ~WebUiLock() {
+      if( locked ) {
+        xSemaphoreGiveRecursive( webUiMutex );
+      }
+    }
+
+    explicit operator bool() const {
+      return locked;
+    }
 
-extern SemaphoreHandle_t i2cMutex;
+    WebUiLock( const WebUiLock& ) = delete;
+    WebUiLock& operator=( const WebUiLock& ) = delete;
+
+  private:
+    bool locked;
+};
+// in bytes, the heap used by the controls of the WebUI, measured at the last build or teardown
+extern volatile uint32_t webUiHeapUsage;
 
 ///////////////////////////////////////////////////////////////////////////
 // Configuration
@@ -115,18 +148,29 @@ struct SteerConfig {
 
   bool enableOTA = false;
 
+  // starts the control chain first, WiFi and the hotspot come up in the background
+  bool fastBoot = false;
+
+  // builds the controls of the WebUI only while a browser is connected, frees the heap otherwise
+  bool lazyWebUi = false;
+
   //set to 1  if you want to use Steering Motor + Cytron MD30C Driver
   //set to 2  if you want to use Steering Motor + IBT 2  Driver
   //set to 3  if you want to use IBT 2  Driver + PWM 2-Coil Valve
   //set to 4  if you want to use IBT 2  Driver + Danfoss Valve PVE A/H/M
+  //set to 5  if you want to send the curvature to an ISOBUS-ready steering valve over CAN
   enum class OutputType : uint8_t {
     None = 0,
     SteeringMotorCytron = 1,
     SteeringMotorIBT2,
     HydraulicPwm2Coil,
-    HydraulicDanfoss
+    HydraulicDanfoss,
+    IsobusGuidance
   } outputType = OutputType::None;
 
+  // to convert the steering angle into the curvature for the ISOBUS guidance
+  float wheelbase = 2.5;
+
   uint16_t pwmFrequency = 1000;
   bool invertOutput = false;
   SteerConfig::Gpio gpioPwm = SteerConfig::Gpio::Esp32Gpio15;
@@ -180,7 +224,12 @@ struct SteerConfig {
 
   SteerConfig::Gpio gpioSDA = SteerConfig::Gpio::Default;
   SteerConfig::Gpio gpioSCL = SteerConfig::Gpio::Default;
-  uint32_t i2cBusSpeed = 400000;
+  // the highest speed to use; at startup, the speed is stepped up to it as long as all devices answer
+  uint32_t i2cBusSpeed = 1000000;
+  // optional second bus, only for the ADS1115 (the wheel angle); disabled if one of the pins is None
+  SteerConfig::Gpio gpioSDA2 = SteerConfig::Gpio::None;
+  SteerConfig::Gpio gpioSCL2 = SteerConfig::Gpio::None;
+  uint32_t i2cBusSpeed2 = 1000000;
   enum class ImuType : uint8_t {
     None = 0,
 //     BNO055 = 1,
@@ -214,6 +263,15 @@ struct SteerConfig {
   uint16_t canBusRpmThreshold = 400;
   uint16_t canBusRpmThresholdHysteresis = 100;
 
+  // J1939 source address to take the values from, 255: the first ECU sending them
+  uint8_t canBusPreferredSourceAddress = 255;
+
+  // disables the acceptance filter, so the bus load and the trace show all frames on the bus
+  bool canBusAcceptAllFrames = false;
+
+  // own J1939 source address, claimed at startup; used to send the ISOBUS guidance messages
+  uint8_t canBusSourceAddress = 28;
+
   enum class RtkCorrectionType : uint8_t {
     None = 0,
     Ntrip = 1,
@@ -221,17 +279,39 @@ struct SteerConfig {
     tcp
   } rtkCorrectionType = RtkCorrectionType::None;
 
+  // server and port are used by NTRIP and TCP, UDP listens on the port
   char rtkCorrectionServer[48] = "example.com";
   uint16_t rtkCorrectionPort = 2101;
   char rtkCorrectionUsername[24] = "gps";
   char rtkCorrectionPassword[24] = "gps";
   char rtkCorrectionMountpoint[24] = "STALL";
 
+  enum class NtripVersion : uint8_t {
+    V1 = 1,
+    V2 = 2
+  } ntripVersion = NtripVersion::V1;
+
+  // additional casters/mountpoints, used when the stream of the active one stalls
+  struct NtripCaster {
+    char server[48] = "";
+    uint16_t port = 2101;
+    char username[24] = "";
+    char password[24] = "";
+    char mountpoint[24] = "";
+  } rtkCorrectionFallback[2];
+
+  // seconds without correction data, after which the stream counts as stalled
+  uint8_t ntripStallTimeout = 5;
+  // keeps a second caster connected, so switching over doesn't cost a reconnect
+  bool ntripWarmStandby = false;
+
   char rtkCorrectionNmeaToSend[120] = "";
 
   uint32_t rtkCorrectionBaudrate = 115200;
 
   uint8_t ntripPositionSendIntervall = 30;
+  // in m, the position is sent again if it moved more than this; 0 disables it
+  uint16_t ntripPositionSendDistance = 500;
 
   enum class SendNmeaDataTo : uint8_t {
     None = 0,
@@ -331,6 +411,8 @@ extern Initialisation initialisation;
 // Global Data
 ///////////////////////////////////////////////////////////////////////////
 
+// shared between the tasks and the callbacks of AsyncUDP: read() returns a consistent copy,
+// the changes are done with write() or update()
 struct SteerSettings {
   float Ko = 0.0f;  //overall gain
   float Kp = 0.0f;  //proportional gain
@@ -343,7 +425,7 @@ struct SteerSettings {
 
   time_t lastPacketReceived = 0;
 };
-extern SteerSettings steerSettings;
+extern SeqLock<SteerSettings> steerSettings;
 
 struct SteerSetpoints {
   uint8_t relais = 0;
@@ -360,7 +442,7 @@ struct SteerSetpoints {
 
   time_t lastPacketReceived = 0;
 };
-extern SteerSetpoints steerSetpoints;
+extern SeqLock<SteerSetpoints> steerSetpoints;
 
 struct SteerMachineControl {
   uint8_t pedalControl = 0;
@@ -381,17 +463,24 @@ struct SteerImuInclinometerData {
 
   imu::Quaternion orientation;
 };
-extern SteerImuInclinometerData steerImuInclinometerData;
+extern SeqLock<SteerImuInclinometerData> steerImuInclinometerData;
 
+// all values are float, so the signals can be decoded generically
 struct SteerCanData {
   float speed;
-  uint16_t motorRpm;
-  uint8_t frontHitchPosition;
-  uint8_t rearHitchPosition;
-  uint16_t frontPtoRpm;
-  uint16_t rearPtoRpm;
+  float groundSpeed;
+  float motorRpm;
+  float engineLoad;
+  float frontHitchPosition;
+  float rearHitchPosition;
+  float frontPtoRpm;
+  float rearPtoRpm;
+  // Guidance Machine Info of the tractor: curvature in 1/km, readiness and lockout are 0/1
+  float guidanceCurvature;
+  float guidanceReadiness;
+  float guidanceLockout;
 };
-extern SteerCanData steerCanData;
+extern SeqLock<SteerCanData> steerCanData;
 
 ///////////////////////////////////////////////////////////////////////////
 // external Libraries
@@ -410,27 +499,119 @@ extern Adafruit_MMA8451 mma;
 ///////////////////////////////////////////////////////////////////////////
 extern portMUX_TYPE mux;
 class TCritSect {
-    TCritSect() {
-      portENTER_CRITICAL( &mux );
+  public:
+    TCritSect( portMUX_TYPE* mux = &::mux ) : mux( mux ) {
+      portENTER_CRITICAL( mux );
     }
     ~TCritSect() {
-      portEXIT_CRITICAL( &mux );
+      portEXIT_CRITICAL( mux );
     }
+
+    TCritSect( const TCritSect& ) = delete;
+    TCritSect& operator=( const TCritSect& ) = delete;
+
+  private:
+    portMUX_TYPE* mux;
 };
 
 ///////////////////////////////////////////////////////////////////////////
 // Threads
 ///////////////////////////////////////////////////////////////////////////
+// the WiFi-, lwIP- and AsyncTCP-tasks run on core 0 (PRO_CPU), so the control loop gets core 1 (APP_CPU)
+// for itself; can be changed with build flags
+#ifndef TASK_CORE_CONTROL
+  #define TASK_CORE_CONTROL 1
+#endif
+#ifndef TASK_CORE_NETWORK
+  #define TASK_CORE_NETWORK 0
+#endif
+
+enum class TaskId : uint8_t {
+  I2cWorker0 = 0,
+  I2cWorker1,
+  SensorWorker100Hz,
+  Autosteer,
+  CanTx,
+  CanRx,
+  SensorWorker10Hz,
+  Nmea,
+  Ntrip,
+  NtripStandby,
+  NtripSourcetable,
+  TcpCorrection,
+  IdleStats,
+  Count
+};
+
+struct TaskLayout {
+  const char* name;
+  uint16_t stackSize;
+  UBaseType_t priority;
+  BaseType_t core;
+  // in ms, 0 for tasks waiting on data; used to calculate the jitter
+  uint16_t period;
+};
+extern const TaskLayout taskLayout[( uint8_t )TaskId::Count];
+
+// all in µs, the maximums are reset by the IdleStats-worker every second
+struct TaskTiming {
+  volatile uint32_t lastStart;
+  volatile uint32_t maxJitter;
+  volatile uint32_t maxRunTime;
+  volatile uint32_t loops;
+};
+extern TaskTiming taskTimings[( uint8_t )TaskId::Count];
+
+// the handles of the running tasks, nullptr if not created or deleted
+extern TaskHandle_t taskHandles[( uint8_t )TaskId::Count];
+
+// creates the task with the parameters from taskLayout, with a static stack
+extern BaseType_t createTask( TaskId id, TaskFunction_t function, void* parameter = nullptr, TaskHandle_t* handle = nullptr );
+// deletes the calling task
+extern void deleteTask( TaskId id );
+
+#if defined( HEAP_CHECK )
+// heap allocations per task after the boot, see heapCheck.cpp
+extern volatile uint32_t heapCheckAllocations[( uint8_t )TaskId::Count];
+#endif
+// call directly after the task woke up, and before going back to sleep
+extern void taskTimingStart( TaskId id );
+extern void taskTimingStop( TaskId id );
 
 
 ///////////////////////////////////////////////////////////////////////////
 // Helper Functions
 ///////////////////////////////////////////////////////////////////////////
 extern void setResetButtonToRed();
+// sets a status label; while the WebUI is freed, the text is kept for the next build
+extern void updateStatusLabel( uint16_t& label, const String& value, ControlColor color );
+
+// records the time of a boot phase, printed on serial and shown in the UI
+extern void bootPhase( const char* name );
+// true as soon as the WiFi is connected or the hotspot is up
+extern volatile bool networkReady;
+
+// writes the context of a crash before the last reset to /crash.json, call after mounting SPIFFS
+extern void initCrashReport();
+// the heap statistics stored with a crash
+extern void crashReportSampleHeap( uint32_t free, uint32_t minimumFree, uint32_t largestFreeBlock );
+
+// binary copy of SteerConfig in NVS; returns false if there is none or it doesn't match the current layout
+extern bool loadConfigBlob( SteerConfig& config );
+extern void saveConfigBlob( const SteerConfig& config );
 
 extern void initIdleStats();
 extern void initSensors();
 extern void calculateMountingCorrection();
 extern void initRtkCorrection();
+extern void requestNtripSourcetable();
+
+extern void updateWorkswitch( bool fromCan );
+
+extern void canTraceRange( uint32_t& begin, uint32_t& end );
+extern size_t canTraceRead( uint32_t& position, uint32_t end, uint8_t* buffer, size_t maxLen );
 extern void initCan();
+// sets the ISOBUS Guidance System Command, curvature in 1/km (positive turns left); sent every 100ms by the CAN-scheduler
+extern void canSetGuidanceCommand( float curvature, bool intendedToSteer );
+extern bool canTransmitReady();
 extern void initAutosteer();
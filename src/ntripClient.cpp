@@ -0,0 +1,388 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <mbedtls/base64.h>
+
+#include "ntripClient.hpp"
+
+constexpr uint32_t NtripHeaderTimeout = 5000;
+constexpr uint32_t NtripSourcetableTimeout = 10000;
+
+void NtripClient::begin( const char* host, uint16_t port,
+                         const char* mountpoint,
+                         const char* username, const char* password,
+                         SteerConfig::NtripVersion version ) {
+  stop();
+
+  this->host = host;
+  this->port = port;
+  this->mountpoint = mountpoint;
+  this->version = version;
+
+  addressValid = false;
+
+  authorization = "";
+
+  if( username[0] != '\0' ) {
+    char credentials[64];
+    snprintf( credentials, sizeof( credentials ), "%s:%s", username, password );
+
+    unsigned char encoded[( sizeof( credentials ) + 2 ) / 3 * 4 + 1];
+    size_t encodedLength = 0;
+
+    if( mbedtls_base64_encode( encoded, sizeof( encoded ), &encodedLength,
+                               ( const unsigned char* )credentials, strlen( credentials ) ) == 0 ) {
+      authorization.reserve( encodedLength );
+
+      for( size_t i = 0; i < encodedLength; ++i ) {
+        authorization += ( char )encoded[i];
+      }
+    }
+  }
+}
+
+bool NtripClient::resolve() {
+  addressValid = WiFi.hostByName( host.c_str(), cachedAddress ) == 1;
+  return addressValid;
+}
+
+bool NtripClient::openConnection() {
+  if( !addressValid && !resolve() ) {
+    return false;
+  }
+
+  // first try the cached address, the caster could have moved, so do a lookup if that fails
+  if( !client.connect( cachedAddress, port ) ) {
+    if( !resolve() || !client.connect( cachedAddress, port ) ) {
+      return false;
+    }
+  }
+
+  client.setNoDelay( true );
+
+  return true;
+}
+
+NtripClient::State NtripClient::connect( const char* gga ) {
+  stop();
+
+  if( !openConnection() ) {
+    currentState = State::Error;
+    return currentState;
+  }
+
+  sendRequest( mountpoint.c_str(), gga );
+  currentState = readResponseHeader();
+
+  if( currentState != State::Streaming ) {
+    client.stop();
+  }
+
+  return currentState;
+}
+
+void NtripClient::stop() {
+  client.stop();
+  currentState = State::Disconnected;
+}
+
+bool NtripClient::connected() {
+  return client.connected();
+}
+
+size_t NtripClient::available() {
+  return client.available();
+}
+
+size_t NtripClient::read( uint8_t* buffer, size_t len ) {
+  int c = client.read( buffer, len );
+
+  if( c <= 0 ) {
+    return 0;
+  }
+
+  if( chunked ) {
+    return decodeChunked( buffer, c );
+  }
+
+  return c;
+}
+
+size_t NtripClient::write( const uint8_t* buffer, size_t len ) {
+  return client.write( buffer, len );
+}
+
+void NtripClient::sendRequest( const char* path, const char* gga ) {
+  String request;
+  request.reserve( 384 );
+
+  request = "GET /";
+  request += path;
+
+  if( version == SteerConfig::NtripVersion::V2 ) {
+    request += " HTTP/1.1\r\nHost: ";
+    request += host;
+    request += ":";
+    request += port;
+    request += "\r\nNtrip-Version: Ntrip/2.0\r\n";
+  } else {
+    request += " HTTP/1.0\r\n";
+  }
+
+  request += "User-Agent: NTRIP Esp32NTRIPClient\r\n";
+
+  if( authorization.length() ) {
+    request += "Authorization: Basic ";
+    request += authorization;
+    request += "\r\n";
+  }
+
+  if( version == SteerConfig::NtripVersion::V2 ) {
+    // VRS-casters can start sending corrections right away, if the position is known
+    if( gga != nullptr && gga[0] == '$' ) {
+      request += "Ntrip-GGA: ";
+
+      for( const char* c = gga; *c != '\0' && *c != '\r' && *c != '\n'; ++c ) {
+        request += *c;
+      }
+
+      request += "\r\n";
+    }
+
+    request += path[0] == '\0' ? "Connection: close\r\n" : "Connection: keep-alive\r\n";
+  }
+
+  request += "\r\n";
+
+  client.write( ( const uint8_t* )request.c_str(), request.length() );
+}
+
+bool NtripClient::readLine( char* line, size_t len ) {
+  size_t pos = 0;
+  uint32_t timeout = millis() + NtripHeaderTimeout;
+
+  while( ( int32_t )( timeout - millis() ) > 0 ) {
+    if( client.available() ) {
+      int c = client.read();
+
+      if( c == '\n' ) {
+        if( pos > 0 && line[pos - 1] == '\r' ) {
+          --pos;
+        }
+
+        line[pos] = '\0';
+        return true;
+      }
+
+      if( c >= 0 && pos < ( len - 1 ) ) {
+        line[pos++] = c;
+      }
+    } else {
+      if( !client.connected() ) {
+        return false;
+      }
+
+      vTaskDelay( 1 );
+    }
+  }
+
+  return false;
+}
+
+NtripClient::State NtripClient::readResponseHeader() {
+  char line[128];
+
+  chunked = false;
+  chunkState = ChunkState::Size;
+  chunkRemaining = 0;
+
+  if( !readLine( line, sizeof( line ) ) ) {
+    return State::Error;
+  }
+
+  // NTRIP 1.0: the data follows directly after the status line
+  if( strncmp( line, "ICY 200", 7 ) == 0 ) {
+    return State::Streaming;
+  }
+
+  State result = State::Error;
+  bool isSourcetable = false;
+
+  if( strncmp( line, "SOURCETABLE 200", 15 ) == 0 ) {
+    result = State::Sourcetable;
+    isSourcetable = true;
+  } else if( strncmp( line, "HTTP/1.", 7 ) == 0 && strlen( line ) >= 12 ) {
+    switch( atoi( &line[9] ) ) {
+      case 200:
+        result = State::Streaming;
+        break;
+
+      case 401:
+        result = State::Unauthorized;
+        break;
+
+      default:
+        result = State::Error;
+        break;
+    }
+  }
+
+  // the rest of the header, ends with an empty line
+  for( ;; ) {
+    if( !readLine( line, sizeof( line ) ) ) {
+      return State::Error;
+    }
+
+    if( line[0] == '\0' ) {
+      break;
+    }
+
+    if( strncasecmp( line, "Transfer-Encoding:", 18 ) == 0 ) {
+      if( strstr( &line[18], "chunked" ) != nullptr ) {
+        chunked = true;
+      }
+    }
+
+    if( strncasecmp( line, "Content-Type:", 13 ) == 0 ) {
+      if( strstr( &line[13], "gnss/sourcetable" ) != nullptr ) {
+        isSourcetable = true;
+      }
+    }
+  }
+
+  if( result == State::Streaming && isSourcetable ) {
+    result = State::Sourcetable;
+  }
+
+  return result;
+}
+
+// decodes the chunked transfer encoding in place, returns the length of the payload
+size_t NtripClient::decodeChunked( uint8_t* buffer, size_t len ) {
+  size_t out = 0;
+
+  for( size_t i = 0; i < len; ++i ) {
+    uint8_t c = buffer[i];
+
+    switch( chunkState ) {
+      case ChunkState::Size: {
+        if( c >= '0' && c <= '9' ) {
+          chunkRemaining = ( chunkRemaining << 4 ) | ( c - '0' );
+        } else if( c >= 'a' && c <= 'f' ) {
+          chunkRemaining = ( chunkRemaining << 4 ) | ( c - 'a' + 10 );
+        } else if( c >= 'A' && c <= 'F' ) {
+          chunkRemaining = ( chunkRemaining << 4 ) | ( c - 'A' + 10 );
+        } else if( c == ';' ) {
+          chunkState = ChunkState::Extension;
+        } else if( c == '\r' ) {
+          chunkState = ChunkState::SizeLf;
+        }
+      }
+      break;
+
+      case ChunkState::Extension: {
+        if( c == '\r' ) {
+          chunkState = ChunkState::SizeLf;
+        }
+      }
+      break;
+
+      case ChunkState::SizeLf: {
+        if( c == '\n' ) {
+          // a chunk with size 0 ends the stream, the caster closes the connection afterwards
+          chunkState = chunkRemaining ? ChunkState::Data : ChunkState::DataCr;
+        }
+      }
+      break;
+
+      case ChunkState::Data: {
+        size_t n = len - i;
+
+        if( n > chunkRemaining ) {
+          n = chunkRemaining;
+        }
+
+        memmove( &buffer[out], &buffer[i], n );
+        out += n;
+        i += n - 1;
+        chunkRemaining -= n;
+
+        if( chunkRemaining == 0 ) {
+          chunkState = ChunkState::DataCr;
+        }
+      }
+      break;
+
+      case ChunkState::DataCr: {
+        if( c == '\r' ) {
+          chunkState = ChunkState::DataLf;
+        }
+      }
+      break;
+
+      case ChunkState::DataLf: {
+        if( c == '\n' ) {
+          chunkState = ChunkState::Size;
+          chunkRemaining = 0;
+        }
+      }
+      break;
+    }
+  }
+
+  return out;
+}
+
+bool NtripClient::fetchSourcetable( Print& output ) {
+  stop();
+
+  if( !openConnection() ) {
+    return false;
+  }
+
+  sendRequest( "", nullptr );
+
+  if( readResponseHeader() != State::Sourcetable ) {
+    client.stop();
+    return false;
+  }
+
+  uint8_t buffer[256];
+  uint32_t timeout = millis() + NtripSourcetableTimeout;
+
+  while( ( client.connected() || client.available() ) && ( int32_t )( timeout - millis() ) > 0 ) {
+    if( client.available() ) {
+      size_t c = read( buffer, sizeof( buffer ) );
+      output.write( buffer, c );
+    } else {
+      vTaskDelay( 10 );
+    }
+  }
+
+  client.stop();
+
+  return true;
+}
@@ -0,0 +1,115 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <WiFi.h>
+
+#include "main.hpp"
+
+// Minimal NTRIP client, speaks NTRIP 1.0 (ICY-responses, raw stream) and
+// NTRIP 2.0 (HTTP/1.1 with chunked transfer encoding).
+// The address of the caster is resolved only once and cached, so a reconnect
+// after a dropped connection costs only the TCP handshake and the request.
+class NtripClient {
+  public:
+    enum class State : uint8_t {
+      Disconnected = 0,
+      Streaming,
+      Sourcetable,
+      Unauthorized,
+      Error
+    };
+
+    NtripClient() {}
+
+    void begin( const char* host, uint16_t port,
+                const char* mountpoint,
+                const char* username, const char* password,
+                SteerConfig::NtripVersion version );
+
+    // connects to the caster and requests the mountpoint; the optional GGA-sentence is sent in the request header (NTRIP 2.0)
+    State connect( const char* gga = nullptr );
+    void stop();
+
+    bool connected();
+    size_t available();
+
+    // reads the correction data, the transfer encoding is already removed
+    size_t read( uint8_t* buffer, size_t len );
+
+    // sends data (usually a GGA-sentence) to the caster
+    size_t write( const uint8_t* buffer, size_t len );
+
+    // retrieves the sourcetable on a separate connection and prints it into output
+    bool fetchSourcetable( Print& output );
+
+    // forget the resolved address; the next connect does a new DNS lookup
+    void invalidateAddress() {
+      addressValid = false;
+    }
+
+    const IPAddress& address() const {
+      return cachedAddress;
+    }
+
+    State state() const {
+      return currentState;
+    }
+
+  private:
+    bool resolve();
+    bool openConnection();
+    void sendRequest( const char* path, const char* gga );
+    State readResponseHeader();
+    bool readLine( char* line, size_t len );
+    size_t decodeChunked( uint8_t* buffer, size_t len );
+
+    enum class ChunkState : uint8_t {
+      Size = 0,
+      Extension,
+      SizeLf,
+      Data,
+      DataCr,
+      DataLf
+    };
+
+    WiFiClient client;
+
+    String host;
+    String mountpoint;
+    String authorization;
+    uint16_t port = 2101;
+    SteerConfig::NtripVersion version = SteerConfig::NtripVersion::V1;
+
+    IPAddress cachedAddress;
+    bool addressValid = false;
+
+    State currentState = State::Disconnected;
+
+    bool chunked = false;
+    ChunkState chunkState = ChunkState::Size;
+    uint32_t chunkRemaining = 0;
+};
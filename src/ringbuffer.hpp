@@ -30,116 +30,139 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#include <main.hpp>
-
+#include <algorithm>
+#include <atomic>
+
+// Wait-free ring buffer for one producer and one consumer (e.g. an AsyncTCP-callback and a worker task).
+// The indices run freely and are masked on access, so all Size elements can be used; Size has to be a
+// power of two. The producer only writes head, the consumer only writes tail, so no locking is needed.
+// peekContiguous()/consume() give the consumer direct access to the stored data, e.g. for socket writes
+// without copying, reserveContiguous()/commit() do the same for the producer.
 template <class T, size_t Size>
 class RingBuffer {
-
-  private:
-    // Pointer zum Puffer
-    T Buffer[Size];
-
-    // gespeicherte Daten
-    volatile uint8_t dataInBuffer;
-
-    // Lese- und Schreibe-Pointer
-    volatile T*  readPointer;
-    volatile T* writePointer;
+    static_assert( Size != 0 && ( Size & ( Size - 1 ) ) == 0, "the size of the RingBuffer has to be a power of two" );
 
   public:
-
     RingBuffer()
-      : Buffer(),
-        dataInBuffer( 0 ),
-        readPointer( Buffer ),
-        writePointer( Buffer ) {
+      : head( 0 ),
+        tail( 0 ),
+        buffer() {
     }
 
-    bool isEmpty() {
-      return dataInBuffer == 0;
+    RingBuffer( const RingBuffer& ) = delete;
+    RingBuffer& operator=( const RingBuffer& ) = delete;
+
+    static constexpr size_t capacity() {
+      return Size;
     }
 
-    uint8_t sizeOfBuffer() {
-      return dataInBuffer;
+    size_t available() const {
+      return head.load( std::memory_order_acquire ) - tail.load( std::memory_order_acquire );
     }
 
-    void addToBufferBack( const T c ) {
-      TCritSect critical;
+    size_t space() const {
+      return Size - available();
+    }
 
-      *writePointer++ = c;
+    bool isEmpty() const {
+      return available() == 0;
+    }
 
-      // bei Überlauf auch readPointer inkrementieren
-      if( dataInBuffer < ( Size * sizeof( T ) ) ) {
-        dataInBuffer++;
-      } else {
-        if( ++readPointer >= &Buffer[Size] ) {
-          readPointer = Buffer;
-        }
-      }
+    // producer: returns false if full
+    bool push( const T& value ) {
+      size_t writeIndex = head.load( std::memory_order_relaxed );
 
-      // Überlauf
-      if( writePointer >= &( Buffer[Size] ) ) {
-        writePointer = Buffer;
+      if( writeIndex - tail.load( std::memory_order_acquire ) >= Size ) {
+        return false;
       }
 
+      buffer[writeIndex & Mask] = value;
+      head.store( writeIndex + 1, std::memory_order_release );
+      return true;
     }
 
-    void operator>>( T& c ) {
-      c = takeFront();
-    }
+    // producer: all or nothing, returns false if there is not enough space
+    bool push( const T* data, size_t len ) {
+      size_t writeIndex = head.load( std::memory_order_relaxed );
+
+      if( len > Size - ( writeIndex - tail.load( std::memory_order_acquire ) ) ) {
+        return false;
+      }
 
-    uint8_t operator<<( const T c ) {
-      addToBufferBack( c );
-      return dataInBuffer;
+      size_t offset = writeIndex & Mask;
+      size_t firstPart = std::min( len, Size - offset );
+      std::copy( data, data + firstPart, &buffer[offset] );
+      std::copy( data + firstPart, data + len, &buffer[0] );
+
+      head.store( writeIndex + len, std::memory_order_release );
+      return true;
     }
 
-    T takeFront() {
-      T c = 0;
-      TCritSect critical;
+    // producer: the free space up to the end of the buffer, to be filled in place and then committed
+    size_t reserveContiguous( T*& data ) {
+      size_t writeIndex = head.load( std::memory_order_relaxed );
+      size_t offset = writeIndex & Mask;
+
+      data = &buffer[offset];
+      return std::min( Size - ( writeIndex - tail.load( std::memory_order_acquire ) ), Size - offset );
+    }
 
-      // auf leeren Puffer prüfen
-      if( dataInBuffer ) {
-        // hole das Zeichen
-        c = *readPointer++;
+    void commit( size_t len ) {
+      head.store( head.load( std::memory_order_relaxed ) + len, std::memory_order_release );
+    }
 
-        // dataInBuffer ändern
-        dataInBuffer--;
+    // consumer: returns false if empty
+    bool pop( T& value ) {
+      size_t readIndex = tail.load( std::memory_order_relaxed );
 
-        // Überlauf
-        if( readPointer >= &( Buffer[Size] ) ) {
-          readPointer = Buffer;
-        }
+      if( readIndex == head.load( std::memory_order_acquire ) ) {
+        return false;
       }
 
-      return c;
+      value = buffer[readIndex & Mask];
+      tail.store( readIndex + 1, std::memory_order_release );
+      return true;
     }
 
-    T& viewFront() {
-      return *readPointer;
-    }
+    // consumer: returns the number of elements copied to data
+    size_t pop( T* data, size_t maxLen ) {
+      size_t readIndex = tail.load( std::memory_order_relaxed );
+      size_t len = std::min( maxLen, head.load( std::memory_order_acquire ) - readIndex );
+
+      size_t offset = readIndex & Mask;
+      size_t firstPart = std::min( len, Size - offset );
+      std::copy( &buffer[offset], &buffer[offset] + firstPart, data );
+      std::copy( &buffer[0], &buffer[0] + ( len - firstPart ), data + firstPart );
 
-    void incrementFront() {
-      TCritSect critical;
+      tail.store( readIndex + len, std::memory_order_release );
+      return len;
+    }
 
-      // auf leeren Puffer prüfen
-      if( dataInBuffer ) {
-        // hole das Zeichen
-        readPointer++;
+    // consumer: the stored data up to the end of the buffer; call again after consume() to get the wrapped part
+    size_t peekContiguous( const T*& data ) const {
+      size_t readIndex = tail.load( std::memory_order_relaxed );
+      size_t offset = readIndex & Mask;
 
-        // dataInBuffer ändern
-        dataInBuffer--;
+      data = &buffer[offset];
+      return std::min( head.load( std::memory_order_acquire ) - readIndex, Size - offset );
+    }
 
-        // Überlauf
-        if( readPointer >= &( Buffer[Size] ) ) {
-          readPointer = Buffer;
-        }
-      }
+    void consume( size_t len ) {
+      tail.store( tail.load( std::memory_order_relaxed ) + len, std::memory_order_release );
     }
 
+    // consumer: drops all the stored data
     void flush() {
-      TCritSect critical;
-      readPointer = writePointer;
-      dataInBuffer = 0;
+      tail.store( head.load( std::memory_order_acquire ), std::memory_order_release );
     }
 
+  private:
+    static constexpr size_t Mask = Size - 1;
+
+    // written only by the producer
+    std::atomic<size_t> head;
+    // written only by the consumer
+    std::atomic<size_t> tail;
+
+    T buffer[Size];
 };
@@ -24,9 +24,10 @@
 #include <WiFiMulti.h>
 
 // #include <ESPAsyncTCP.h>
-#include <vector>
+#include <atomic>
 
-#include <HTTPClient.h>
+#include <FS.h>
+#include <SPIFFS.h>
 
 #include <ESPUI.h>
 
@@ -34,9 +35,16 @@
 
 #include "main.hpp"
 #include "jsonFunctions.hpp"
+#include "ntripClient.hpp"
+#include "ringbuffer.hpp"
 
 String lastGN;
 
+// position of the last GGA-sentence with a valid fix in millionths of a degree, written by nmeaWorker
+static volatile bool ggaFixValid = false;
+static volatile int32_t ggaLatitude = 0;
+static volatile int32_t ggaLongitude = 0;
+
 constexpr size_t NmeaBufferSize = 120;
 char nmeaBuffer[NmeaBufferSize];
 MicroNMEA nmea( nmeaBuffer, NmeaBufferSize );
@@ -44,39 +52,203 @@ MicroNMEA nmea( nmeaBuffer, NmeaBufferSize );
 AsyncUDP udpGpsData;
 
 AsyncServer* server;
-static std::vector<AsyncClient*> clients;
 
-static void handleError( void* arg, AsyncClient* client, int8_t error ) {
-//   Serial.printf( "\n connection error %s from client %s \n", client->errorToString( error ), client->remoteIP().toString().c_str() );
+static SemaphoreHandle_t uartWriteMutex = nullptr;
+
+// all data for the receiver (NTRIP, UDP, TCP, TCP-bridge) goes through this, directly from the receive buffers;
+// the mutex keeps the writes of the different tasks in one piece
+static void writeCorrectionData( const uint8_t* data, size_t len ) {
+  if( uartWriteMutex != nullptr ) {
+    xSemaphoreTake( uartWriteMutex, portMAX_DELAY );
+    Serial2.write( data, len );
+    xSemaphoreGive( uartWriteMutex );
+  } else {
+    Serial2.write( data, len );
+  }
 }
 
+// Bridge between the receiver and multiple TCP-clients (u-center, 3rd-party NMEA-consumers...).
+// The clients live in fixed slots, which are claimed and released with atomics, so the
+// AsyncTCP-callbacks and nmeaWorker never lock each other out. Each slot has its own TX- and
+// RX-buffer: a slow client only drops its own data and the data of the clients is written
+// to the UART only by nmeaWorker, a whole buffer at a time. The RX-buffer is filled by the
+// AsyncTCP-task and emptied by nmeaWorker, the TX-buffer is used only by nmeaWorker.
+constexpr size_t TcpBridgeTxBufferSize = 2048;
+constexpr size_t TcpBridgeRxBufferSize = 1024;
+
+struct TcpBridgeClient {
+  enum State : uint32_t {
+    Free = 0,
+    Claimed,
+    Active,
+    Closing
+  };
+
+  std::atomic<uint32_t> state;
+  // nmeaWorker is using the client, it must not be deleted
+  std::atomic<uint32_t> users;
+
+  AsyncClient* client = nullptr;
+  RingBuffer<uint8_t, TcpBridgeTxBufferSize>* txBuffer = nullptr;
+  RingBuffer<uint8_t, TcpBridgeRxBufferSize>* rxBuffer = nullptr;
+
+  uint32_t remoteIP = 0;
+  volatile uint32_t txBytes = 0;
+  volatile uint32_t txDropped = 0;
+  volatile uint32_t rxBytes = 0;
+  volatile uint32_t rxDropped = 0;
+
+  TcpBridgeClient() : state( Free ), users( 0 ) {}
+};
+
+constexpr uint8_t TcpBridgeClientsMax = 4;
+static TcpBridgeClient tcpBridgeClients[TcpBridgeClientsMax];
+
 static void handleData( void* arg, AsyncClient* client, void* data, size_t len ) {
-  Serial2.write( ( uint8_t* )data, len );
+  TcpBridgeClient* slot = ( TcpBridgeClient* )arg;
+
+  slot->rxBytes += len;
+
+  if( !slot->rxBuffer->push( ( const uint8_t* )data, len ) ) {
+    slot->rxDropped += len;
+  }
 }
 
 static void handleDisconnect( void* arg, AsyncClient* client ) {
-//   Serial.printf( "\n client %s disconnected \n", client->remoteIP().toString().c_str() );
+  TcpBridgeClient* slot = ( TcpBridgeClient* )arg;
 
-  // remove client from vector
-  clients.erase( std::remove_if( clients.begin(), clients.end(), [client]( AsyncClient * itClient ) {
-    return itClient == client;
-  } ), clients.end() );
-}
+  slot->state = TcpBridgeClient::Closing;
+
+  // wait until nmeaWorker is done with the client
+  while( slot->users != 0 ) {
+    vTaskDelay( 1 );
+  }
 
-static void handleTimeOut( void* arg, AsyncClient* client, uint32_t time ) {
-//   Serial.printf( "\n client ACK timeout ip: %s \n", client->remoteIP().toString().c_str() );
+  slot->client = nullptr;
+  delete client;
+
+  slot->state = TcpBridgeClient::Free;
 }
+
 static void handleNewClient( void* arg, AsyncClient* client ) {
-//   Serial.printf( "\n new client has been connected to server, ip: %s", client->remoteIP().toString().c_str() );
+  for( auto& slot : tcpBridgeClients ) {
+    uint32_t expected = TcpBridgeClient::Free;
+
+    if( slot.state.compare_exchange_strong( expected, TcpBridgeClient::Claimed ) ) {
+      // the slot is free, so nmeaWorker doesn't touch the buffers
+      slot.txBuffer->flush();
+      slot.rxBuffer->flush();
+
+      slot.client = client;
+      slot.remoteIP = client->remoteIP();
+      slot.txBytes = 0;
+      slot.txDropped = 0;
+      slot.rxBytes = 0;
+      slot.rxDropped = 0;
+
+      client->setNoDelay( true );
+      client->onData( &handleData, &slot );
+      client->onDisconnect( &handleDisconnect, &slot );
+
+      slot.state = TcpBridgeClient::Active;
+      return;
+    }
+  }
+
+  // no free slot
+  client->close( true );
+  delete client;
+}
+
+// called by nmeaWorker: sends the data from the receiver to all clients and writes the data of the clients to the receiver
+static void serviceTcpBridge( const uint8_t* data, size_t len ) {
+  for( auto& slot : tcpBridgeClients ) {
+    ++slot.users;
+
+    if( slot.state == TcpBridgeClient::Active ) {
+      if( len && !slot.txBuffer->push( data, len ) ) {
+        slot.txDropped += len;
+      }
+
+      // send as much as the client can take, directly out of the buffer
+      {
+        size_t space = slot.client->space();
+        const uint8_t* chunk;
+        size_t chunkLength;
+
+        while( space && ( chunkLength = slot.txBuffer->peekContiguous( chunk ) ) != 0 ) {
+          chunkLength = slot.client->add( ( const char* )chunk, std::min( chunkLength, space ) );
+
+          if( chunkLength == 0 ) {
+            break;
+          }
+
+          slot.txBuffer->consume( chunkLength );
+
+          slot.txBytes += chunkLength;
+          space -= chunkLength;
+        }
+
+        slot.client->send();
+      }
+
+      // the whole buffer of a client is written at once, so the messages don't get interleaved
+      {
+        const uint8_t* chunk;
+        size_t chunkLength;
+
+        while( ( chunkLength = slot.rxBuffer->peekContiguous( chunk ) ) != 0 ) {
+          writeCorrectionData( chunk, chunkLength );
+          slot.rxBuffer->consume( chunkLength );
+        }
+      }
+    }
+
+    --slot.users;
+  }
+}
+
+static void updateTcpBridgeStatus() {
+  WebUiLock lock( 0 );
+  Control* handle = lock ? ESPUI.getControl( labelStatusTcpBridge ) : nullptr;
+
+  if( handle == nullptr ) {
+    return;
+  }
+
+  String& str = handle->value;
+  str.reserve( 500 );
+
+  str = "<table style='margin:auto;'><tr><td style='text-align:left; padding: 0px 5px;'>Client</td><td style='padding: 0px 5px;'>TX</td><td style='padding: 0px 5px;'>TX dropped</td><td style='padding: 0px 5px;'>RX</td><td style='padding: 0px 5px;'>RX dropped</td></tr>";
+
+  uint8_t numClients = 0;
+
+  for( auto& slot : tcpBridgeClients ) {
+    if( slot.state == TcpBridgeClient::Active ) {
+      ++numClients;
 
-  // add to list
-  clients.push_back( client );
+      str += "<tr><td style='text-align:left; padding: 0px 5px;'>";
+      str += IPAddress( slot.remoteIP ).toString();
+      str += "</td><td style='padding: 0px 5px;'>";
+      str += slot.txBytes;
+      str += "</td><td style='padding: 0px 5px;'>";
+      str += slot.txDropped;
+      str += "</td><td style='padding: 0px 5px;'>";
+      str += slot.rxBytes;
+      str += "</td><td style='padding: 0px 5px;'>";
+      str += slot.rxDropped;
+      str += "</td></tr>";
+    }
+  }
+
+  str += "</table>";
+
+  if( numClients == 0 ) {
+    str = "No clients connected";
+  }
 
-  // register events
-  client->onData( &handleData, NULL );
-  client->onError( &handleError, NULL );
-  client->onDisconnect( &handleDisconnect, NULL );
-  client->onTimeout( &handleTimeOut, NULL );
+  handle->color = numClients ? ControlColor::Emerald : ControlColor::Turquoise;
+  ESPUI.updateControlAsync( handle );
 }
 
 static char receiveBuffer[400];
@@ -88,6 +260,11 @@ void nmeaWorker( void* z ) {
   lastGN.reserve( NmeaBufferSize );
 
   if( steerConfig.sendNmeaDataTcpPort != 0 ) {
+    for( auto& slot : tcpBridgeClients ) {
+      slot.txBuffer = new RingBuffer<uint8_t, TcpBridgeTxBufferSize>;
+      slot.rxBuffer = new RingBuffer<uint8_t, TcpBridgeRxBufferSize>;
+    }
+
     server = new AsyncServer( steerConfig.sendNmeaDataTcpPort );
     server->onClient( &handleNewClient, server );
     server->begin();
@@ -97,6 +274,8 @@ void nmeaWorker( void* z ) {
   TickType_t xLastWakeTime = xTaskGetTickCount();
 
   for( ;; ) {
+    taskTimingStart( TaskId::Nmea );
+
     uint16_t cnt = Serial2.available();
 
     if( cnt ) {
@@ -108,15 +287,6 @@ void nmeaWorker( void* z ) {
         receiveBuffer[i] = Serial2.read();
       }
 
-      // send sentence to all connected clients on the TCP-Socket
-      for( auto client : clients ) {
-        // reply to client
-        if( client->space() > cnt && client->canSend() ) {
-          client->write( receiveBuffer, cnt );
-          client->send();
-        }
-      }
-
       if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance &&
           steerConfig.qogChannelIdGpsDataOut != 0 ) {
         sendBase64DataTransmission( steerConfig.qogChannelIdGpsDataOut, receiveBuffer, cnt );
@@ -153,6 +323,13 @@ void nmeaWorker( void* z ) {
         if( nmea.process( c ) ) {
           if( strcmp( nmea.getMessageID(), "GGA" ) == 0 ) {
             lastGN = nmea.getSentence();
+
+            if( nmea.isValid() ) {
+              ggaLatitude = nmea.getLatitude();
+              ggaLongitude = nmea.getLongitude();
+            }
+
+            ggaFixValid = nmea.isValid();
           }
 
           if( steerConfig.sendNmeaDataTo != SteerConfig::SendNmeaDataTo::None ) {
@@ -191,15 +368,22 @@ void nmeaWorker( void* z ) {
       }
     }
 
+    // the clients on the TCP-Socket get the data of the receiver, their data is written to the receiver
+    if( server != nullptr ) {
+      serviceTcpBridge( ( const uint8_t* )receiveBuffer, cnt );
+    }
+
     {
       static uint8_t loopCounter = 0;
 
       if( loopCounter++ >= ( 1000 / xFrequency ) ) {
         loopCounter = 0;
-        Control* handle = ESPUI.getControl( labelStatusGps );
 
+        if( server != nullptr ) {
+          updateTcpBridgeStatus();
+        }
         String str;
-        str.reserve( 200 );
+        str.reserve( 300 );
 
         str = "<table style='margin:auto;'><tr><td style='text-align:left; padding: 0px 5px;'>Lat:</td><td style='text-align:left; padding: 0px 5px;'>";
         str += String( ( float )nmea.getLatitude() / 1000000, 6 );
@@ -211,6 +395,24 @@ void nmeaWorker( void* z ) {
         str += ( float )nmea.getHDOP() / 10;
         str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Age:</td><td style='text-align:left; padding: 0px 5px;'>";
         str += ( float )nmea.getAgeOfDGPS() / 10;
+
+        // the age of the corrections over the last minute, only with a differential fix
+        {
+          static MovingStatistics<uint16_t, uint32_t, 60> correctionAge;
+
+          if( nmea.getQuality() >= 2 ) {
+            correctionAge += nmea.getAgeOfDGPS();
+          }
+
+          if( !correctionAge.isEmpty() ) {
+            str += " (avg ";
+            str += ( float )correctionAge.mean() / 10;
+            str += ", max ";
+            str += ( float )correctionAge.max() / 10;
+            str += ")";
+          }
+        }
+
         str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Quality:</td><td style='text-align:left; padding: 0px 5px;'>";
 
         switch( nmea.getQuality() ) {
@@ -243,173 +445,668 @@ void nmeaWorker( void* z ) {
             break;
         }
 
-        handle->value = str;
-        ESPUI.updateControlAsync( handle );
+        WebUiLock lock( 0 );
+        Control* handle = lock ? ESPUI.getControl( labelStatusGps ) : nullptr;
+
+        if( handle != nullptr ) {
+          handle->value = str;
+          ESPUI.updateControlAsync( handle );
+        }
       }
     }
 
+    taskTimingStop( TaskId::Nmea );
+
     vTaskDelayUntil( &xLastWakeTime, xFrequency );
   }
 }
 
-void ntripWorker( void* z ) {
-  vTaskDelay( 2000 );
+static TaskHandle_t ntripSourcetableTask = nullptr;
+
+void requestNtripSourcetable() {
+  if( ntripSourcetableTask != nullptr ) {
+    xTaskNotifyGive( ntripSourcetableTask );
+  }
+}
+
+// The sourcetable is retrieved on a separate connection by its own task: connecting and reading it take
+// up to 15s, the correction stream is forwarded by ntripWorker() in the meantime.
+static void ntripSourcetableWorker( void* z ) {
+  for( ;; ) {
+    ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+    if( !networkReady ) {
+      continue;
+    }
+
+    NtripClient sourcetableClient;
+    sourcetableClient.begin( steerConfig.rtkCorrectionServer, steerConfig.rtkCorrectionPort, "",
+                             steerConfig.rtkCorrectionUsername, steerConfig.rtkCorrectionPassword,
+                             steerConfig.ntripVersion );
+
+    File file = SPIFFS.open( "/sourcetable.txt", "w" );
+
+    if( file ) {
+      if( !sourcetableClient.fetchSourcetable( file ) ) {
+        file.print( "Could not retrieve the sourcetable" );
+      }
+
+      file.close();
+    }
+  }
+}
+
+// get the NMEA-sentence to send to the caster, with a valid checksum and line ending
+static bool getNmeaToSend( String& nmeaToSend ) {
+  if( steerConfig.rtkCorrectionNmeaToSend[0] != '\0' ) {
+    nmeaToSend = steerConfig.rtkCorrectionNmeaToSend;
+  } else {
+    nmeaToSend = lastGN;
+  }
+
+  if( nmeaToSend.length() ) {
+    // calculate checksum if not correct
+    if( !nmea.testChecksum( nmeaToSend.c_str() ) ) {
+
+      // snap off the checksum, if it exists
+      {
+        uint8_t occurence = nmeaToSend.lastIndexOf( "*" );
+
+        if( occurence > 0 ) {
+          nmeaToSend.remove( occurence );
+        }
+      }
+
+      // add the checksum
+      char checksum[] = {'*', '\0', '\0', '\0'};
+      nmea.generateChecksum( nmeaToSend.c_str(), &checksum[1] );
+      nmeaToSend += checksum;
+
+      // update checksum, also in the WebUI
+      if( steerConfig.rtkCorrectionNmeaToSend[0] != '\0' ) {
+        nmeaToSend.toCharArray( steerConfig.rtkCorrectionNmeaToSend, sizeof( steerConfig.rtkCorrectionNmeaToSend ) );
+
+        {
+          WebUiLock lock;
+          Control* handle = ESPUI.getControl( textNmeaToSend );
+
+          if( handle != nullptr ) {
+            handle->value.reserve( 80 );
+            handle->value = steerConfig.rtkCorrectionNmeaToSend;
+            ESPUI.updateControlAsync( handle );
+          }
+        }
+      }
+    }
 
-  Control* labelNtripHandle = ESPUI.getControl( labelStatusNtrip );
+    if( nmeaToSend.lastIndexOf( '\n' ) == -1 ) {
+      nmeaToSend += "\r\n";
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+// Decides when the position is sent to the caster: right after the first valid fix,
+// then on the configured interval and whenever the position has moved more than the
+// configured distance, so VRS-casters can recompute the virtual base.
+class GgaScheduler {
+  public:
+    // called after a (re)connect, the caster gets the position as soon as there is a valid fix
+    void reset() {
+      sentValidFix = false;
+      nextSend = millis() + ( steerConfig.ntripPositionSendIntervall * 1000 );
+    }
+
+    bool due() {
+      if( ( int32_t )( millis() - nextSend ) >= 0 ) {
+        return true;
+      }
 
-  initialisation.rtkCorrectionURL.reserve( 200 );
-  initialisation.rtkCorrectionURL = "http://";
+      // a fixed sentence is configured, only the interval applies
+      if( steerConfig.rtkCorrectionNmeaToSend[0] != '\0' ) {
+        return false;
+      }
 
-  if( steerConfig.rtkCorrectionUsername != '\0' ) {
-    initialisation.rtkCorrectionURL += steerConfig.rtkCorrectionUsername;
+      if( !ggaFixValid ) {
+        return false;
+      }
 
-    if( steerConfig.rtkCorrectionPassword != '\0' ) {
-      initialisation.rtkCorrectionURL += ":";
-      initialisation.rtkCorrectionURL += steerConfig.rtkCorrectionPassword;
+      if( !sentValidFix ) {
+        return true;
+      }
+
+      return steerConfig.ntripPositionSendDistance != 0 &&
+             distanceToSent() > steerConfig.ntripPositionSendDistance;
     }
 
-    initialisation.rtkCorrectionURL += "@";
+    void sent() {
+      nextSend = millis() + ( steerConfig.ntripPositionSendIntervall * 1000 );
+
+      if( ggaFixValid ) {
+        sentValidFix = true;
+        sentLatitude = ggaLatitude;
+        sentLongitude = ggaLongitude;
+      }
+    }
+
+  private:
+    // equirectangular approximation in m, good enough for the distances in question
+    float distanceToSent() {
+      constexpr float metersPerMicrodegree = 111320.0f / 1000000;
+
+      float latitude = ( float )ggaLatitude;
+      float dLatitude = ( latitude - sentLatitude ) * metersPerMicrodegree;
+      float dLongitude = ( ( float )ggaLongitude - sentLongitude ) * metersPerMicrodegree *
+                         cosf( latitude / 1000000 * DEG_TO_RAD );
+
+      return sqrtf( dLatitude * dLatitude + dLongitude * dLongitude );
+    }
+
+    uint32_t nextSend = 0;
+    bool sentValidFix = false;
+    int32_t sentLatitude = 0;
+    int32_t sentLongitude = 0;
+};
+
+// one connection to a caster/mountpoint, with the statistics used to select the active one
+struct NtripStream {
+  NtripClient client;
+  String url;
+
+  // millis() of the last received correction data, the age of the corrections is calculated from it
+  uint32_t lastData = 0;
+  // time from the connect until the caster starts streaming in ms, smoothed over the connects
+  uint32_t connectLatency = UINT32_MAX;
+  // bytes/s, updated every second
+  uint32_t throughput = 0;
+  uint32_t bytesReceived = 0;
+
+  NtripClient::State lastResult = NtripClient::State::Disconnected;
+  uint8_t failures = 0;
+  uint32_t retryAt = 0;
+};
+
+constexpr uint8_t NtripStreamsMax = 1 + ( sizeof( SteerConfig::rtkCorrectionFallback ) / sizeof( SteerConfig::rtkCorrectionFallback[0] ) );
+static NtripStream ntripStreams[NtripStreamsMax];
+static uint8_t ntripStreamsCount = 0;
+
+static void buildNtripUrl( String& url, const char* server, uint16_t port, const char* username, const char* password, const char* mountpoint ) {
+  url.reserve( 200 );
+  url = "http://";
+
+  if( username[0] != '\0' ) {
+    url += username;
+
+    if( password[0] != '\0' ) {
+      url += ":";
+      url += password;
+    }
+
+    url += "@";
   }
 
-  initialisation.rtkCorrectionURL += steerConfig.rtkCorrectionServer;
+  url += server;
 
-  if( steerConfig.rtkCorrectionPort != '\0' ) {
-    initialisation.rtkCorrectionURL += ":";
-    initialisation.rtkCorrectionURL += steerConfig.rtkCorrectionPort;
+  if( port != 0 ) {
+    url += ":";
+    url += port;
   }
 
-  initialisation.rtkCorrectionURL += "/";
+  url += "/";
+  url += mountpoint;
+}
 
-  if( steerConfig.rtkCorrectionMountpoint != '\0' ) {
-    initialisation.rtkCorrectionURL += steerConfig.rtkCorrectionMountpoint;
+static void addNtripStream( const char* server, uint16_t port, const char* username, const char* password, const char* mountpoint ) {
+  if( server[0] == '\0' || mountpoint[0] == '\0' ) {
+    return;
   }
 
-  if( initialisation.rtkCorrectionURL.length() <= 8 ) {
-    // update WebUI
-    {
-      labelNtripHandle->value = "Cannot connect to " + initialisation.rtkCorrectionURL;
-      labelNtripHandle->color = ControlColor::Carrot;
-      ESPUI.updateControlAsync( labelNtripHandle );
+  NtripStream& stream = ntripStreams[ntripStreamsCount++];
+
+  buildNtripUrl( stream.url, server, port, username, password, mountpoint );
+  stream.client.begin( server, port, mountpoint, username, password, steerConfig.ntripVersion );
+}
+
+// the first reconnect is done immediately, then back off if the caster stays unreachable
+static void ntripStreamFailed( NtripStream& stream ) {
+  constexpr uint32_t reconnectDelayMin = 500;
+  constexpr uint32_t reconnectDelayMax = 10000;
+
+  stream.client.stop();
+  stream.throughput = 0;
+  stream.bytesReceived = 0;
+
+  uint32_t reconnectDelay = 0;
+
+  if( stream.failures > 0 ) {
+    reconnectDelay = std::min( reconnectDelayMin << ( stream.failures - 1 ), reconnectDelayMax );
+  }
+
+  if( stream.failures < 16 ) {
+    ++stream.failures;
+  }
+
+  stream.retryAt = millis() + reconnectDelay;
+}
+
+// blocks until the caster answered or the header timed out; gga is sent in the request header
+static bool connectNtripStream( NtripStream& stream, const char* gga ) {
+  uint32_t start = millis();
+
+  stream.lastResult = stream.client.connect( gga );
+
+  if( stream.lastResult == NtripClient::State::Streaming ) {
+    uint32_t latency = millis() - start;
+
+    if( stream.connectLatency == UINT32_MAX ) {
+      stream.connectLatency = latency;
+    } else {
+      stream.connectLatency = ( stream.connectLatency * 3 + latency ) / 4;
+    }
+
+    stream.lastData = millis();
+    stream.failures = 0;
+    return true;
+  }
+
+  ntripStreamFailed( stream );
+  return false;
+}
+
+// a stream is alive if it is connected and corrections arrived in the configured time
+static bool ntripStreamAlive( NtripStream& stream ) {
+  if( !stream.client.connected() ) {
+    return false;
+  }
+
+  if( steerConfig.ntripStallTimeout != 0 &&
+      ( millis() - stream.lastData ) > ( uint32_t( steerConfig.ntripStallTimeout ) * 1000 ) ) {
+    return false;
+  }
+
+  return true;
+}
+
+// The handshake of the standby is done by ntripStandbyWorker(), so the active stream is forwarded in the meantime.
+// ntripWorker() sets the stream and the GGA-sentence and notifies the task; the stream belongs to the task until
+// done is set.
+struct NtripStandbyConnect {
+  TaskHandle_t task = nullptr;
+  int8_t stream = -1;
+  String gga;
+  std::atomic<bool> done{ false };
+  bool connected = false;
+};
+static NtripStandbyConnect ntripStandbyConnect;
+
+static void ntripStandbyWorker( void* z ) {
+  for( ;; ) {
+    ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+    ntripStandbyConnect.connected = connectNtripStream( ntripStreams[ntripStandbyConnect.stream], ntripStandbyConnect.gga.c_str() );
+    ntripStandbyConnect.done.store( true );
+  }
+}
+
+// select the stream with the lowest latency, which isn't backing off; unmeasured ones are tried in the configured order
+static int8_t selectNtripStream( int8_t exclude ) {
+  int8_t selected = -1;
+  uint32_t now = millis();
+
+  for( int8_t i = 0; i < ntripStreamsCount; ++i ) {
+    NtripStream& stream = ntripStreams[i];
+
+    if( i == exclude || i == ntripStandbyConnect.stream || ( int32_t )( stream.retryAt - now ) > 0 ) {
+      continue;
+    }
+
+    if( selected == -1 || stream.connectLatency < ntripStreams[selected].connectLatency ) {
+      selected = i;
+    }
+  }
+
+  return selected;
+}
+
+// read all data from the stream; only the active one is written to the receiver, the standby is kept empty
+static void readNtripStream( NtripStream& stream, bool active ) {
+  constexpr uint16_t buffSize = 1436;
+  static uint8_t buff[buffSize];
+
+  size_t size = stream.client.available();
+
+  while( size ) {
+    size_t c = stream.client.read( buff, ( ( size > buffSize ) ? buffSize : size ) );
+
+    if( c ) {
+      if( active ) {
+        writeCorrectionData( buff, c );
+      }
+
+      stream.lastData = millis();
+      stream.bytesReceived += c;
+    }
+
+    size = stream.client.available();
+  }
+}
+
+static void updateNtripStatus( int8_t active, int8_t standby ) {
+  static String str;
+  str.reserve( 600 );
+  ControlColor color;
+
+  if( active >= 0 ) {
+    str = "Connected to ";
+    str += ntripStreams[active].url;
+    color = ControlColor::Emerald;
+  } else {
+    switch( ntripStreams[0].lastResult ) {
+      case NtripClient::State::Unauthorized:
+        str = "Unauthorized: ";
+        break;
+
+      case NtripClient::State::Sourcetable:
+        str = "Mountpoint not found: ";
+        break;
+
+      default:
+        str = "Cannot connect to ";
+        break;
     }
 
-    // delete this task
-    TaskHandle_t myself = xTaskGetCurrentTaskHandle();
-    vTaskDelete( myself );
+    str += ntripStreams[0].url;
+    color = ControlColor::Carrot;
+  }
+
+  if( ntripStreamsCount > 1 ) {
+    uint32_t now = millis();
+
+    str += "<table style='margin:auto;'><tr><td></td><td style='padding: 0px 5px;'>Age</td><td style='padding: 0px 5px;'>B/s</td><td style='padding: 0px 5px;'>Latency</td></tr>";
+
+    for( int8_t i = 0; i < ntripStreamsCount; ++i ) {
+      NtripStream& stream = ntripStreams[i];
+
+      str += "<tr><td style='text-align:left; padding: 0px 5px;'>";
+      str += i == active ? "Active" : ( i == standby ? "Standby" :
+                                        ( i == ntripStandbyConnect.stream ? "Connecting" : ( i == 0 ? "Primary" : "Fallback" ) ) );
+      str += "</td><td style='padding: 0px 5px;'>";
+
+      if( i == active || i == standby ) {
+        str += ( float )( now - stream.lastData ) / 1000;
+        str += "s</td><td style='padding: 0px 5px;'>";
+        str += stream.throughput;
+      } else {
+        str += "-</td><td style='padding: 0px 5px;'>-";
+      }
+
+      str += "</td><td style='padding: 0px 5px;'>";
+
+      if( stream.connectLatency != UINT32_MAX ) {
+        str += stream.connectLatency;
+        str += "ms";
+      } else {
+        str += "-";
+      }
+
+      str += "</td></tr>";
+    }
+
+    str += "</table>";
+  }
+
+  updateStatusLabel( labelStatusNtrip, str, color );
+}
+
+void ntripWorker( void* z ) {
+  // with fastBoot, the WiFi is still connecting
+  while( !networkReady ) {
+    vTaskDelay( 100 );
+  }
+
+  vTaskDelay( 2000 );
+
+  addNtripStream( steerConfig.rtkCorrectionServer, steerConfig.rtkCorrectionPort,
+                  steerConfig.rtkCorrectionUsername, steerConfig.rtkCorrectionPassword,
+                  steerConfig.rtkCorrectionMountpoint );
 
+  for( const auto& caster : steerConfig.rtkCorrectionFallback ) {
+    addNtripStream( caster.server, caster.port, caster.username, caster.password, caster.mountpoint );
+  }
+
+  if( ntripStreamsCount == 0 ) {
+    // update WebUI
+    updateStatusLabel( labelStatusNtrip, "No caster configured", ControlColor::Carrot );
+
+    deleteTask( TaskId::Ntrip );
     return;
   }
 
+  initialisation.rtkCorrectionURL = ntripStreams[0].url;
+
+  String nmeaToSend;
+  nmeaToSend.reserve( sizeof( SteerConfig::rtkCorrectionNmeaToSend ) );
+
+  int8_t active = -1;
+  int8_t standby = -1;
+  bool statusChanged = true;
+
+  if( steerConfig.ntripWarmStandby && ntripStreamsCount > 1 ) {
+    ntripStandbyConnect.gga.reserve( sizeof( SteerConfig::rtkCorrectionNmeaToSend ) );
+    createTask( TaskId::NtripStandby, ntripStandbyWorker, nullptr, &ntripStandbyConnect.task );
+  }
+
+  GgaScheduler ggaScheduler;
+  ggaScheduler.reset();
+
+  uint32_t lastStatistics = millis();
+
   for( ;; ) {
-    HTTPClient http;
-    http.begin( initialisation.rtkCorrectionURL );
-    http.setUserAgent( "NTRIP Esp32NTRIPClient" );
-    int httpCode = http.GET();
+    // drop stalled or disconnected streams
+    if( active >= 0 && !ntripStreamAlive( ntripStreams[active] ) ) {
+      ntripStreamFailed( ntripStreams[active] );
+      active = -1;
+    }
 
-    if( httpCode > 0 ) {
-      // HTTP header has been send and Server response header has been handled
+    if( standby >= 0 && !ntripStreamAlive( ntripStreams[standby] ) ) {
+      ntripStreamFailed( ntripStreams[standby] );
+      standby = -1;
+      statusChanged = true;
+    }
 
-      // file found at server
-      if( httpCode == HTTP_CODE_OK ) {
-        // update WebUI
-        {
-          labelNtripHandle->value = "Connected to " + initialisation.rtkCorrectionURL;
-          labelNtripHandle->color = ControlColor::Emerald;
-          ESPUI.updateControlAsync( labelNtripHandle );
+    if( active < 0 ) {
+      // the standby is already streaming, so switching over costs nothing
+      if( standby >= 0 ) {
+        active = standby;
+        standby = -1;
+      } else {
+        int8_t candidate = selectNtripStream( -1 );
+
+        if( candidate >= 0 ) {
+          getNmeaToSend( nmeaToSend );
+
+          if( connectNtripStream( ntripStreams[candidate], nmeaToSend.c_str() ) ) {
+            active = candidate;
+            ggaScheduler.reset();
+          }
         }
+      }
 
-        // create buffer for read
-        constexpr uint16_t buffSize = 1436;
-        uint8_t* buff = ( uint8_t* )malloc( buffSize );
+      if( active >= 0 ) {
+        initialisation.rtkCorrectionURL = ntripStreams[active].url;
+      }
 
-        // get tcp stream
-        WiFiClient* stream = http.getStreamPtr();
+      statusChanged = true;
+    }
 
-        time_t timeoutSendGGA = millis() + ( steerConfig.ntripPositionSendIntervall * 1000 );
+    // the standby is connected in the background; it gets the position with the request and then with the active one
+    if( ntripStandbyConnect.task != nullptr ) {
+      if( ntripStandbyConnect.stream >= 0 ) {
+        if( ntripStandbyConnect.done.load() ) {
+          if( ntripStandbyConnect.connected ) {
+            standby = ntripStandbyConnect.stream;
+            statusChanged = true;
+          }
 
-        // read all data from server
-        while( http.connected() ) {
-          // get available data size
-          size_t size = stream->available();
+          ntripStandbyConnect.stream = -1;
+        }
+      } else if( active >= 0 && standby < 0 ) {
+        int8_t candidate = selectNtripStream( active );
+
+        if( candidate >= 0 ) {
+          getNmeaToSend( ntripStandbyConnect.gga );
+          ntripStandbyConnect.done.store( false );
+          ntripStandbyConnect.stream = candidate;
+          xTaskNotifyGive( ntripStandbyConnect.task );
+        }
+      }
+    }
 
-          if( size ) {
-            int c = stream->readBytes( buff, ( ( size > buffSize ) ? buffSize : size ) );
+    if( active >= 0 ) {
+      readNtripStream( ntripStreams[active], true );
+    }
 
-            // write it to Serial
-            Serial2.write( buff, c );
-          }
+    if( standby >= 0 ) {
+      readNtripStream( ntripStreams[standby], false );
+    }
 
-          if( millis() > timeoutSendGGA ) {
-            String nmeaToSend;
-            nmeaToSend.reserve( sizeof( SteerConfig::rtkCorrectionNmeaToSend ) );
+    // send the position to all connected casters, so VRS-mountpoints are ready to take over
+    if( ggaScheduler.due() ) {
+      if( getNmeaToSend( nmeaToSend ) ) {
+        if( active >= 0 ) {
+          ntripStreams[active].client.write( ( const uint8_t* )nmeaToSend.c_str(), nmeaToSend.length() );
+        }
 
-            if( steerConfig.rtkCorrectionNmeaToSend[0] != '\0' ) {
-              nmeaToSend = steerConfig.rtkCorrectionNmeaToSend;
-            } else {
-              nmeaToSend = lastGN;
-            }
+        if( standby >= 0 ) {
+          ntripStreams[standby].client.write( ( const uint8_t* )nmeaToSend.c_str(), nmeaToSend.length() );
+        }
+      }
 
-            if( nmeaToSend.length() ) {
-              // calculate checksum if not correct
-              if( !nmea.testChecksum( nmeaToSend.c_str() ) ) {
-
-                // snap off the checksum, if it exists
-                {
-                  uint8_t occurence = nmeaToSend.lastIndexOf( "*" );
-
-                  if( occurence > 0 ) {
-                    nmeaToSend.remove( occurence );
-                  }
-                }
-
-                // add the checksum
-                char checksum[] = {'*', '\0', '\0', '\0'};
-                nmea.generateChecksum( nmeaToSend.c_str(), &checksum[1] );
-                nmeaToSend += checksum;
-
-                // update checksum, also in the WebUI
-                if( steerConfig.rtkCorrectionNmeaToSend[0] != '\0' ) {
-                  nmeaToSend.toCharArray( steerConfig.rtkCorrectionNmeaToSend, sizeof( steerConfig.rtkCorrectionNmeaToSend ) );
-
-                  {
-                    Control* handle = ESPUI.getControl( textNmeaToSend );
-                    handle->value.reserve( 80 );
-                    handle->value = steerConfig.rtkCorrectionNmeaToSend;
-                    ESPUI.updateControlAsync( handle );
-                  }
-                }
-              }
-
-              if( nmeaToSend.lastIndexOf( '\n' ) == -1 ) {
-                nmeaToSend += "\r\n";
-              }
-
-              stream->write( nmeaToSend.c_str(), nmeaToSend.length() );
-            }
+      ggaScheduler.sent();
+    }
+
+    {
+      uint32_t elapsed = millis() - lastStatistics;
+
+      if( elapsed >= 1000 ) {
+        lastStatistics = millis();
 
-            timeoutSendGGA = millis() + ( steerConfig.ntripPositionSendIntervall * 1000 );
+        for( int8_t i = 0; i < ntripStreamsCount; ++i ) {
+          // written by ntripStandbyWorker() while connecting
+          if( i == ntripStandbyConnect.stream ) {
+            continue;
           }
 
-          vTaskDelay( 1 );
+          NtripStream& stream = ntripStreams[i];
+          stream.throughput = ( stream.throughput + ( stream.bytesReceived * 1000 / elapsed ) ) / 2;
+          stream.bytesReceived = 0;
         }
 
-        free( buff );
+        // the table with the statistics of all streams is refreshed every second
+        if( ntripStreamsCount > 1 ) {
+          statusChanged = true;
+        }
       }
     }
 
-    // update WebUI
-    {
-      labelNtripHandle->value = "Cannot connect to " + initialisation.rtkCorrectionURL;
-      labelNtripHandle->color = ControlColor::Carrot;
-      ESPUI.updateControlAsync( labelNtripHandle );
+    if( statusChanged ) {
+      statusChanged = false;
+      updateNtripStatus( active, standby );
     }
 
-    http.end();
-    vTaskDelay( 1000 );
+    vTaskDelay( active >= 0 ? 1 : 10 );
   }
 
-// delete this task
-  TaskHandle_t myself = xTaskGetCurrentTaskHandle();
-  vTaskDelete( myself );
+  deleteTask( TaskId::Ntrip );
+}
+
+AsyncUDP udpRtkCorrection;
+
+static void initUdpCorrection() {
+  if( udpRtkCorrection.listen( steerConfig.rtkCorrectionPort ) ) {
+    // the packet is written to the receiver without copying it
+    udpRtkCorrection.onPacket( []( AsyncUDPPacket packet ) {
+      writeCorrectionData( packet.data(), packet.length() );
+    } );
+
+    updateStatusLabel( labelStatusNtrip, "Listening on UDP-port " + String( steerConfig.rtkCorrectionPort ), ControlColor::Emerald );
+  } else {
+    updateStatusLabel( labelStatusNtrip, "Cannot listen on UDP-port " + String( steerConfig.rtkCorrectionPort ), ControlColor::Carrot );
+  }
+}
+
+static AsyncClient* tcpCorrectionClient = nullptr;
+static volatile bool tcpCorrectionConnected = false;
+
+void tcpCorrectionWorker( void* z ) {
+  // with fastBoot, the WiFi is still connecting
+  while( !networkReady ) {
+    vTaskDelay( 100 );
+  }
+
+  vTaskDelay( 2000 );
+
+  tcpCorrectionClient = new AsyncClient;
+  tcpCorrectionClient->setNoDelay( true );
+
+  // the data is written to the receiver directly from the TCP-buffer
+  tcpCorrectionClient->onData( []( void* arg, AsyncClient * client, void* data, size_t len ) {
+    writeCorrectionData( ( uint8_t* )data, len );
+  }, nullptr );
+  tcpCorrectionClient->onConnect( []( void* arg, AsyncClient * client ) {
+    tcpCorrectionConnected = true;
+  }, nullptr );
+  tcpCorrectionClient->onDisconnect( []( void* arg, AsyncClient * client ) {
+    tcpCorrectionConnected = false;
+  }, nullptr );
+
+  String url;
+  url.reserve( 80 );
+  url = "tcp://";
+  url += steerConfig.rtkCorrectionServer;
+  url += ":";
+  url += steerConfig.rtkCorrectionPort;
+
+  // the first reconnect is done immediately, then back off if the base stays unreachable
+  constexpr TickType_t reconnectDelayMin = 500;
+  constexpr TickType_t reconnectDelayMax = 10000;
+  TickType_t reconnectDelay = 0;
+
+  // update WebUI
+  updateStatusLabel( labelStatusNtrip, "Connecting to " + url, ControlColor::Carrot );
+
+  bool wasConnected = false;
+
+  for( ;; ) {
+    if( tcpCorrectionConnected != wasConnected ) {
+      wasConnected = tcpCorrectionConnected;
+
+      // update WebUI
+      updateStatusLabel( labelStatusNtrip, ( wasConnected ? "Connected to " : "Cannot connect to " ) + url,
+                         wasConnected ? ControlColor::Emerald : ControlColor::Carrot );
+
+      if( wasConnected ) {
+        reconnectDelay = 0;
+      }
+    }
+
+    if( !wasConnected && tcpCorrectionClient->disconnected() ) {
+      vTaskDelay( reconnectDelay );
+
+      tcpCorrectionClient->connect( steerConfig.rtkCorrectionServer, steerConfig.rtkCorrectionPort );
+
+      if( reconnectDelay < reconnectDelayMin ) {
+        reconnectDelay = reconnectDelayMin;
+      } else if( reconnectDelay < reconnectDelayMax ) {
+        reconnectDelay *= 2;
+      }
+    }
+
+    vTaskDelay( 100 );
+  }
 }
 
 void initRtkCorrection() {
@@ -423,9 +1120,27 @@ void initRtkCorrection() {
 
   Serial2.begin( steerConfig.rtkCorrectionBaudrate );
 
-  if( steerConfig.rtkCorrectionType == SteerConfig::RtkCorrectionType::Ntrip ) {
-    xTaskCreate( ntripWorker, "ntripWorker", 3064, NULL, 8, NULL );
+  uartWriteMutex = xSemaphoreCreateMutex();
+
+  // also without a configured caster, to choose a mountpoint
+  createTask( TaskId::NtripSourcetable, ntripSourcetableWorker, nullptr, &ntripSourcetableTask );
+
+  switch( steerConfig.rtkCorrectionType ) {
+    case SteerConfig::RtkCorrectionType::Ntrip:
+      createTask( TaskId::Ntrip, ntripWorker );
+      break;
+
+    case SteerConfig::RtkCorrectionType::udp:
+      initUdpCorrection();
+      break;
+
+    case SteerConfig::RtkCorrectionType::tcp:
+      createTask( TaskId::TcpCorrection, tcpCorrectionWorker );
+      break;
+
+    default:
+      break;
   }
 
-  xTaskCreate( nmeaWorker, "nmeaWorker", 2048, NULL, 6, NULL );
+  createTask( TaskId::Nmea, nmeaWorker );
 }
@@ -20,7 +20,7 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
-// #include <Wire.h>
+#include <Wire.h>
 // #include <WiredDevice.h>
 // #include <RegisterBasedWiredDevice.h>
 // #include <Accelerometer.h>
@@ -38,28 +38,30 @@
 #include <MahonyAHRS.h>
 #include <MadgwickAHRS.h>
 
-#include <Adafruit_ADS1015.h>
-
 
 #include <ESPUI.h>
 
+#include <esp_timer.h>
+
 #include "main.hpp"
 #include "jsonFunctions.hpp"
 
+#include "ads1115.hpp"
 #include "average.hpp"
+#include "biquad.hpp"
 #include "ringbuffer.hpp"
 
 Adafruit_MMA8451 mma = Adafruit_MMA8451();
 Adafruit_FXAS21002C fxas2100 = Adafruit_FXAS21002C( 0x0021002C );
 Adafruit_FXOS8700 fxos8700 = Adafruit_FXOS8700( 0x8700A, 0x8700B );
-Adafruit_ADS1115 ads = Adafruit_ADS1115( 0x48 );
+Ads1115 ads = Ads1115( 0x48 );
 
 Madgwick ahrs;
 // Mahony filter;
 
 Fxos8700Fxas21002CalibrationData fxos8700Fxas21002CalibrationData, fxos8700Fxas21002CalibrationDefault;
 
-SteerImuInclinometerData steerImuInclinometerData;
+SeqLock<SteerImuInclinometerData> steerImuInclinometerData;
 
 Average<float, float, 20> accXaverage, accYaverage, accZaverage;
 float accX, accY, accZ;
@@ -70,141 +72,16 @@ volatile uint16_t samplesPerSecond;
 
 imu::Quaternion mountingCorrection;
 
-// FXOS8700/FXAS2100
-
-// http://www.schwietering.com/jayduino/filtuino/index.php?characteristic=bu&passmode=lp&order=2&usesr=usesr&sr=100&frequencyLow=10&noteLow=&noteHigh=&pw=pw&calctype=float&run=Send
-//Low pass butterworth filter order=2 alpha1=0.1
-class  FilterBuLp2_fxos8700Acc {
-  public:
-    FilterBuLp2_fxos8700Acc() {
-      v[0] = 0.0;
-      v[1] = 0.0;
-    }
-  private:
-    float v[3];
-  public:
-    float step( float x ) { //class II
-      v[0] = v[1];
-      v[1] = v[2];
-      v[2] = ( 6.745527388907189559e-2 * x )
-             + ( -0.41280159809618854894 * v[0] )
-             + ( 1.14298050253990091107 * v[1] );
-      return
-              ( v[0] + v[2] )
-              + 2 * v[1];
-    }
-} fxos8700accFilterX, fxos8700accFilterY, fxos8700accFilterZ;
-
-// http://www.schwietering.com/jayduino/filtuino/index.php?characteristic=bu&passmode=lp&order=2&usesr=usesr&sr=100&frequencyLow=10&noteLow=&noteHigh=&pw=pw&calctype=float&run=Send
-//Low pass butterworth filter order=2 alpha1=0.1
-class  FilterBuLp2_fxos8700Mag {
-  public:
-    FilterBuLp2_fxos8700Mag() {
-      v[0] = 0.0;
-      v[1] = 0.0;
-    }
-  private:
-    float v[3];
-  public:
-    float step( float x ) { //class II
-      v[0] = v[1];
-      v[1] = v[2];
-      v[2] = ( 6.745527388907189559e-2 * x )
-             + ( -0.41280159809618854894 * v[0] )
-             + ( 1.14298050253990091107 * v[1] );
-      return
-              ( v[0] + v[2] )
-              + 2 * v[1];
-    }
-} fxos8700magFilterX, fxos8700magFilterY, fxos8700magFilterZ;
-
-// http://www.schwietering.com/jayduino/filtuino/index.php?characteristic=bu&passmode=hp&order=1&usesr=usesr&sr=100&frequencyLow=1&noteLow=&noteHigh=&calctype=float&run=Send
-// High pass butterworth filter order=1 alpha1=0.01
-class  FilterBuHp2_fxas2100Gyr {
-  public:
-    FilterBuHp2_fxas2100Gyr() {
-      v[0] = 0.0;
-    }
-  private:
-    float v[2];
-  public:
-    float step( float x ) { //class II
-      v[0] = v[1];
-      v[1] = ( 9.695312529087461995e-1 * x )
-             + ( 0.93906250581749239892 * v[0] );
-      return
-              ( v[1] - v[0] );
-    }
-} fxas2100gyrFilterX, fxas2100gyrFilterY, fxas2100gyrFilterZ;
+// the rate of i2cWorker and sensorWorker100HzPoller; the filters are designed for it in initSensors()
+constexpr TickType_t sensorLoopPeriod = 10;
+constexpr float sensorSampleRate = 1000.0f / ( sensorLoopPeriod * portTICK_PERIOD_MS );
+constexpr float mma8451SampleRate = 200;
 
-
-//Low pass butterworth filter order=2 alpha1=0.05
-class  FilterBuLp2_mma8481acc {
-  public:
-    FilterBuLp2_mma8481acc() {
-      v[0] = 0.0;
-      v[1] = 0.0;
-    }
-  private:
-    float v[3];
-  public:
-    float step( float x ) { //class II
-      v[0] = v[1];
-      v[1] = v[2];
-      v[2] = ( 2.008336556421122521e-2 * x )
-             + ( -0.64135153805756306422 * v[0] )
-             + ( 1.56101807580071816339 * v[1] );
-      return
-              ( v[0] + v[2] )
-              + 2 * v[1];
-    }
-} mma8481accFilterX, mma8481accFilterY, mma8481accFilterZ;
-
-// http://www.schwietering.com/jayduino/filtuino/index.php?characteristic=bu&passmode=lp&order=2&usesr=usesr&sr=1000&frequencyLow=5&noteLow=&noteHigh=&pw=pw&calctype=float&run=Send
-//Low pass butterworth filter order=2 alpha1=0.005
-class  FilterBuLp2_2 {
-  public:
-    FilterBuLp2_2() {
-      v[0] = 0.0;
-      v[1] = 0.0;
-    }
-  private:
-    float v[3];
-  public:
-    float step( float x ) { //class II
-      v[0] = v[1];
-      v[1] = v[2];
-      v[2] = ( 2.413590490419614820e-4 * x )
-             + ( -0.95654367651120375537 * v[0] )
-             + ( 1.95557824031503590945 * v[1] );
-      return
-              ( v[0] + v[2] )
-              + 2 * v[1];
-    }
-} filterRoll, filterPitch, filterHeading;
-
-// http://www.schwietering.com/jayduino/filtuino/index.php?characteristic=bu&passmode=lp&order=2&usesr=usesr&sr=100&frequencyLow=5&noteLow=&noteHigh=&pw=pw&calctype=float&run=Send
-//Low pass butterworth filter order=2 alpha1=0.05
-class  FilterBuLp2_3 {
-  public:
-    FilterBuLp2_3() {
-      v[0] = 0.0;
-      v[1] = 0.0;
-    }
-  private:
-    float v[3];
-  public:
-    float step( float x ) { //class II
-      v[0] = v[1];
-      v[1] = v[2];
-      v[2] = ( 2.008336556421122521e-2 * x )
-             + ( -0.64135153805756306422 * v[0] )
-             + ( 1.56101807580071816339 * v[1] );
-      return
-              ( v[0] + v[2] )
-              + 2 * v[1];
-    }
-} wheelAngleSensorFilter;
+// FXOS8700/FXAS2100: low pass for acc + mag, high pass for gyr
+BiquadCascade3<1> fxos8700AccFilter, fxos8700MagFilter, fxas2100GyrFilter;
+// MMA8451: low pass
+BiquadCascade3<1> mma8451AccFilter;
+BiquadCascade<1> wheelAngleSensorFilter;
 
 void calculateMountingCorrection() {
   // rotate by the correction, relative to the tracot axis
@@ -223,44 +100,456 @@ void calculateMountingCorrection() {
   }
 }
 
-void sensorWorker100HzPoller( void* z ) {
-  vTaskDelay( 2000 );
-  constexpr TickType_t xFrequency = 10;
+// I2C bus manager: after the initialisation, there is one i2cWorker per bus, which is the only task using it.
+// It executes the transactions of i2cSchedule on its bus in the order of their importance and publishes the
+// results with the time of the reading in mailboxes (queues with the length of one). The processing only
+// takes new samples out of them, so a failed reading is skipped instead of working with stale values.
+// With the second bus configured, the ADS1115 is read there, concurrently to the IMU and the inclinometer.
+struct I2cBus {
+  TwoWire* wire;
+  int sda;
+  int scl;
+  // negotiated by i2cProbeBusSpeed()
+  uint32_t speed;
+  uint32_t recoveries;
+};
+
+static I2cBus i2cBuses[] = { { &Wire, SDA, SCL, 100000, 0 }, { &Wire1, -1, -1, 100000, 0 } };
+constexpr uint8_t i2cBusesCount = sizeof( i2cBuses ) / sizeof( i2cBuses[0] );
+static uint8_t i2cWheelAngleBus = 0;
+
+struct WheelAngleSample {
+  int64_t timestamp;
+  float value;
+};
+
+struct ImuSample {
+  int64_t timestamp;
+  sensors_event_t gyro;
+  sensors_event_t accel;
+  sensors_event_t mag;
+  int16_t gyroRaw[3];
+  int16_t accelRaw[3];
+  int16_t magRaw[3];
+};
+
+struct InclinometerSample {
+  int64_t timestamp;
+  uint8_t numSamples;
+  sensors_event_t events[32];
+};
+
+static QueueHandle_t wheelAngleMailbox = nullptr;
+static QueueHandle_t imuMailbox = nullptr;
+static QueueHandle_t inclinometerMailbox = nullptr;
+
+// the processing of the wheel angle and the IMU runs right after the readings on the bus of the wheel angle
+static TaskHandle_t sensorWorker100HzHandle = nullptr;
+
+static bool i2cWheelAngleEnabled( uint8_t bus ) {
+  return bus == i2cWheelAngleBus && steerConfig.wheelAngleInput >= SteerConfig::AnalogIn::ADS1115A0Single;
+}
+
+static bool i2cReadWheelAngle( TwoWire& wire, int64_t timestamp ) {
+  WheelAngleSample sample = { timestamp, 0 };
+  Ads1115::Mux mux;
+
+  switch( steerConfig.wheelAngleInput ) {
+    case SteerConfig::AnalogIn::ADS1115A0Single:
+      mux = Ads1115::Mux::Single0;
+      break;
+
+    case SteerConfig::AnalogIn::ADS1115A1Single:
+      mux = Ads1115::Mux::Single1;
+      break;
+
+    case SteerConfig::AnalogIn::ADS1115A2Single:
+      mux = Ads1115::Mux::Single2;
+      break;
+
+    case SteerConfig::AnalogIn::ADS1115A3Single:
+      mux = Ads1115::Mux::Single3;
+      break;
+
+    case SteerConfig::AnalogIn::ADS1115A0A1Differential:
+      mux = Ads1115::Mux::Differential01;
+      break;
+
+    case SteerConfig::AnalogIn::ADS1115A2A3Differential:
+      mux = Ads1115::Mux::Differential23;
+      break;
+
+    default:
+      return false;
+  }
+
+  int16_t value;
+
+  if( !ads.read( mux, value ) ) {
+    return false;
+  }
+
+  sample.value = value;
+
+  xQueueOverwrite( wheelAngleMailbox, &sample );
+  return true;
+}
+
+// the Adafruit-libraries of the IMU and the inclinometer only work on the first bus
+static bool i2cImuEnabled( uint8_t bus ) {
+  return bus == 0 &&
+         ( initialisation.inclinoType == SteerConfig::InclinoType::Fxos8700Fxas21002 ||
+           initialisation.imuType == SteerConfig::ImuType::Fxos8700Fxas21002 );
+}
+
+static bool i2cReadImu( TwoWire& wire, int64_t timestamp ) {
+  static ImuSample sample;
+  sample.timestamp = timestamp;
+
+  if( !fxas2100.getEvent( &sample.gyro ) || wire.lastError() != I2C_ERROR_OK ||
+      !fxos8700.getEvent( &sample.accel, &sample.mag ) || wire.lastError() != I2C_ERROR_OK ) {
+    return false;
+  }
+
+  sample.gyroRaw[0] = fxas2100.raw.x;
+  sample.gyroRaw[1] = fxas2100.raw.y;
+  sample.gyroRaw[2] = fxas2100.raw.z;
+  sample.accelRaw[0] = fxos8700.accel_raw.x;
+  sample.accelRaw[1] = fxos8700.accel_raw.y;
+  sample.accelRaw[2] = fxos8700.accel_raw.z;
+  sample.magRaw[0] = fxos8700.mag_raw.x;
+  sample.magRaw[1] = fxos8700.mag_raw.y;
+  sample.magRaw[2] = fxos8700.mag_raw.z;
+
+  xQueueOverwrite( imuMailbox, &sample );
+  return true;
+}
+
+static bool i2cInclinometerEnabled( uint8_t bus ) {
+  return bus == 0 && initialisation.inclinoType == SteerConfig::InclinoType::MMA8451;
+}
+
+static bool i2cReadInclinometer( TwoWire& wire, int64_t timestamp ) {
+  static InclinometerSample sample;
+  sample.timestamp = timestamp;
+  sample.numSamples = mma.getEventsFromFifo( sample.events );
+
+  if( wire.lastError() != I2C_ERROR_OK ) {
+    return false;
+  }
+
+  xQueueOverwrite( inclinometerMailbox, &sample );
+  return true;
+}
+
+struct I2cTransaction {
+  const char* name;
+  // in cycles of i2cWorker (10ms)
+  uint8_t interval;
+  bool ( *enabled )( uint8_t bus );
+  bool ( *execute )( TwoWire& wire, int64_t timestamp );
+};
+
+// ordered by priority: the wheel angle is needed by the control loop, the IMU by the AHRS, the inclinometer has a FIFO
+static const I2cTransaction i2cSchedule[] = {
+  { "Wheel Angle (ADS1115)", 1, i2cWheelAngleEnabled, i2cReadWheelAngle },
+  { "IMU (FXOS8700/FXAS21002)", 1, i2cImuEnabled, i2cReadImu },
+  { "Inclinometer (MMA8451)", 10, i2cInclinometerEnabled, i2cReadInclinometer }
+};
+
+constexpr uint8_t i2cScheduleCount = sizeof( i2cSchedule ) / sizeof( i2cSchedule[0] );
+
+struct I2cStatistics {
+  uint32_t transactions;
+  uint32_t errors;
+  // of the last transaction, in us
+  uint32_t duration;
+};
+
+static I2cStatistics i2cStatistics[i2cScheduleCount];
+static uint8_t i2cBusUtilization[i2cBusesCount];
+
+// the longest transaction is reading the FIFO of the MMA8451 (192 bytes), which takes about 18ms at 100kHz
+static uint16_t i2cTimeout( uint32_t speed ) {
+  return speed >= 400000 ? 10 : 25;
+}
+
+// A slave interrupted in the middle of a read can hold SDA low. It is freed by clocking out the rest of
+// its byte, then a STOP is sent and the pins are given back to the controller.
+static void i2cRecoverBus( I2cBus& bus ) {
+  pinMode( bus.sda, INPUT_PULLUP );
+  pinMode( bus.scl, OUTPUT_OPEN_DRAIN );
+  digitalWrite( bus.scl, HIGH );
+
+  for( uint8_t i = 0; i < 9 && digitalRead( bus.sda ) == LOW; ++i ) {
+    digitalWrite( bus.scl, LOW );
+    delayMicroseconds( 5 );
+    digitalWrite( bus.scl, HIGH );
+    delayMicroseconds( 5 );
+  }
+
+  // STOP: SDA rises while SCL is high
+  pinMode( bus.sda, OUTPUT_OPEN_DRAIN );
+  digitalWrite( bus.sda, LOW );
+  delayMicroseconds( 5 );
+  digitalWrite( bus.sda, HIGH );
+  delayMicroseconds( 5 );
+
+  bus.wire->begin( bus.sda, bus.scl, bus.speed );
+  bus.wire->setTimeOut( i2cTimeout( bus.speed ) );
+
+  ++bus.recoveries;
+}
+
+// Devices to verify by reading a register with a known value: the identification for the NXP-sensors,
+// for the ADS1115 the comparator bits of the config register, which are never changed
+struct I2cDevice {
+  uint8_t address;
+  uint8_t reg;
+  uint8_t length;
+  uint16_t mask;
+  uint16_t expected;
+  // if the device is configured on the bus
+  bool ( *configured )( uint8_t bus );
+};
+
+static bool i2cFxosFxasConfigured( uint8_t bus ) {
+  return bus == 0 &&
+         ( steerConfig.inclinoType == SteerConfig::InclinoType::Fxos8700Fxas21002 ||
+           steerConfig.imuType == SteerConfig::ImuType::Fxos8700Fxas21002 );
+}
+
+static bool i2cMma8451Configured( uint8_t bus ) {
+  return bus == 0 && steerConfig.mode == SteerConfig::Mode::AgOpenGps &&
+         steerConfig.inclinoType == SteerConfig::InclinoType::MMA8451;
+}
+
+static const I2cDevice i2cDevices[] = {
+  // ADS1115: config register, COMP_QUE
+  { 0x48, 0x01, 2, 0x0003, 0x0003, i2cWheelAngleEnabled },
+  // FXOS8700: WHO_AM_I
+  { 0x1F, 0x0D, 1, 0xFF, 0xC7, i2cFxosFxasConfigured },
+  // FXAS21002: WHO_AM_I
+  { 0x21, 0x0C, 1, 0xFF, 0xD7, i2cFxosFxasConfigured },
+  // MMA8451: WHO_AM_I
+  { 0x1D, 0x0D, 1, 0xFF, 0x1A, i2cMma8451Configured }
+};
+
+static bool i2cVerifyDevices( uint8_t bus ) {
+  TwoWire& wire = *i2cBuses[bus].wire;
+
+  for( const auto& device : i2cDevices ) {
+    if( !device.configured( bus ) ) {
+      continue;
+    }
+
+    // a marginal speed shows up as sporadic errors, so read more than once
+    for( uint8_t i = 0; i < 3; ++i ) {
+      uint8_t reg = device.reg;
+      uint8_t data[2] = { 0, 0 };
+
+      if( wire.writeTransmission( device.address, &reg, 1 ) != I2C_ERROR_OK ||
+          wire.readTransmission( device.address, data, device.length ) != I2C_ERROR_OK ) {
+        return false;
+      }
+
+      uint16_t value = device.length == 2 ? ( ( data[0] << 8 ) | data[1] ) : data[0];
+
+      if( ( value & device.mask ) != device.expected ) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// steps up the speed as long as all configured devices answer correctly, up to the configured speed
+static uint32_t i2cProbeBusSpeed( uint8_t bus, uint32_t maxSpeed ) {
+  static const uint32_t speeds[] = { 100000, 400000, 1000000 };
+
+  I2cBus& i2cBus = i2cBuses[bus];
+  uint32_t speed = std::min( speeds[0], maxSpeed );
+
+  for( uint32_t step : speeds ) {
+    uint32_t candidate = std::min( step, maxSpeed );
+
+    i2cBus.wire->setClock( candidate );
+    i2cBus.wire->setTimeOut( i2cTimeout( candidate ) );
+
+    if( !i2cVerifyDevices( bus ) ) {
+      i2cRecoverBus( i2cBus );
+      break;
+    }
+
+    speed = candidate;
+
+    if( candidate == maxSpeed ) {
+      break;
+    }
+  }
+
+  i2cBus.speed = speed;
+  i2cBus.wire->setClock( speed );
+  i2cBus.wire->setTimeOut( i2cTimeout( speed ) );
+
+  return speed;
+}
+
+// the parameter is the index of the bus
+void i2cWorker( void* z ) {
+  const uint8_t bus = ( uintptr_t )z;
+  const TaskId taskId = bus ? TaskId::I2cWorker1 : TaskId::I2cWorker0;
+  TwoWire& wire = *i2cBuses[bus].wire;
+
+  // the devices are initialised by initSensors(), with fastBoot the steering starts right away
+  if( !steerConfig.fastBoot ) {
+    vTaskDelay( 2000 );
+  }
+  constexpr TickType_t xFrequency = sensorLoopPeriod;
   TickType_t xLastWakeTime = xTaskGetTickCount();
 
+  uint32_t cycle = 0;
+  int64_t busyTime = 0;
+  int64_t lastStatistics = esp_timer_get_time();
+
   for( ;; ) {
-    if( initialisation.inclinoType == SteerConfig::InclinoType::Fxos8700Fxas21002 ||
-        initialisation.imuType == SteerConfig::ImuType::Fxos8700Fxas21002 ) {
+    taskTimingStart( taskId );
 
-      sensors_event_t gyro_event, accel_event, mag_event;
+    for( uint8_t i = 0; i < i2cScheduleCount; ++i ) {
+      const I2cTransaction& transaction = i2cSchedule[i];
 
-      // Get new data samples
-      if( xSemaphoreTake( i2cMutex, 1000 ) == pdTRUE ) {
-        fxas2100.getEvent( &gyro_event );
-        fxos8700.getEvent( &accel_event, &mag_event );
-        xSemaphoreGive( i2cMutex );
+      if( ( cycle % transaction.interval ) == 0 && transaction.enabled( bus ) ) {
+        int64_t start = esp_timer_get_time();
+        bool success = transaction.execute( wire, start );
+        uint32_t duration = esp_timer_get_time() - start;
+
+        busyTime += duration;
+        i2cStatistics[i].duration = duration;
+        ++i2cStatistics[i].transactions;
+
+        if( !success ) {
+          ++i2cStatistics[i].errors;
+
+          // a stuck bus would fail all the following transactions
+          uint8_t error = wire.lastError();
+
+          if( error == I2C_ERROR_TIMEOUT || error == I2C_ERROR_BUS ) {
+            i2cRecoverBus( i2cBuses[bus] );
+          }
+        }
+      }
+    }
+
+    ++cycle;
+
+    if( bus == i2cWheelAngleBus && sensorWorker100HzHandle != nullptr ) {
+      xTaskNotifyGive( sensorWorker100HzHandle );
+    }
+
+    {
+      int64_t now = esp_timer_get_time();
+
+      if( ( now - lastStatistics ) >= 1000000 ) {
+        i2cBusUtilization[bus] = busyTime * 100 / ( now - lastStatistics );
+        busyTime = 0;
+        lastStatistics = now;
       }
+    }
+
+    taskTimingStop( taskId );
+
+    vTaskDelayUntil( &xLastWakeTime, xFrequency );
+  }
+}
+
+static void updateI2cStatusLabel() {
+  WebUiLock lock( 0 );
+  Control* handle = lock ? ESPUI.getControl( labelStatusI2c ) : nullptr;
+
+  if( handle == nullptr ) {
+    return;
+  }
+
+  // the buffer is reserved when the WebUI is built
+  String& str = handle->value;
+
+  str = "<table style='margin:auto;'><tr><td style='text-align:left; padding: 0px 5px;'>Utilization:</td><td style='text-align:left; padding: 0px 5px;'>";
+  str += i2cBusUtilization[0];
+  str += "%, ";
+  str += i2cBuses[0].speed / 1000;
+  str += "kHz, ";
+  str += i2cBuses[0].recoveries;
+  str += " recoveries";
+
+  if( i2cWheelAngleBus != 0 ) {
+    str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>Second Bus:</td><td style='text-align:left; padding: 0px 5px;'>";
+    str += i2cBusUtilization[1];
+    str += "%, ";
+    str += i2cBuses[1].speed / 1000;
+    str += "kHz, ";
+    str += i2cBuses[1].recoveries;
+    str += " recoveries";
+  }
+
+  for( uint8_t i = 0; i < i2cScheduleCount; ++i ) {
+    if( i2cStatistics[i].transactions ) {
+      str += "</td></tr><tr><td style='text-align:left; padding: 0px 5px;'>";
+      str += i2cSchedule[i].name;
+      str += ":</td><td style='text-align:left; padding: 0px 5px;'>";
+      str += i2cStatistics[i].duration;
+      str += "us, ";
+      str += i2cStatistics[i].errors;
+      str += " errors / ";
+      str += i2cStatistics[i].transactions;
+    }
+  }
+
+  str += "</td></tr></table>";
+
+  handle->color = ControlColor::Emerald;
+  ESPUI.updateControlAsync( handle );
+}
+
+void sensorWorker100HzPoller( void* z ) {
+  if( !steerConfig.fastBoot ) {
+    vTaskDelay( 2000 );
+  }
+  constexpr TickType_t xFrequency = sensorLoopPeriod;
+
+  for( ;; ) {
+    taskTimingStart( TaskId::SensorWorker100Hz );
+
+    static ImuSample imuSample;
+
+    if( ( initialisation.inclinoType == SteerConfig::InclinoType::Fxos8700Fxas21002 ||
+          initialisation.imuType == SteerConfig::ImuType::Fxos8700Fxas21002 ) &&
+        xQueueReceive( imuMailbox, &imuSample, 0 ) == pdTRUE ) {
 
-      if( steerImuInclinometerData.sendCalibrationDataFromImu ) {
+      const sensors_event_t& gyro_event = imuSample.gyro;
+      const sensors_event_t& accel_event = imuSample.accel;
+      const sensors_event_t& mag_event = imuSample.mag;
+
+      if( steerImuInclinometerData.read().sendCalibrationDataFromImu ) {
         // Print the sensor data
         Serial.print( "Raw:" );
-        Serial.print( fxos8700.accel_raw.x );
+        Serial.print( imuSample.accelRaw[0] );
         Serial.print( ',' );
-        Serial.print( fxos8700.accel_raw.y );
+        Serial.print( imuSample.accelRaw[1] );
         Serial.print( ',' );
-        Serial.print( fxos8700.accel_raw.z );
+        Serial.print( imuSample.accelRaw[2] );
         Serial.print( ',' );
-        Serial.print( fxas2100.raw.x );
+        Serial.print( imuSample.gyroRaw[0] );
         Serial.print( ',' );
-        Serial.print( fxas2100.raw.y );
+        Serial.print( imuSample.gyroRaw[1] );
         Serial.print( ',' );
-        Serial.print( fxas2100.raw.z );
+        Serial.print( imuSample.gyroRaw[2] );
         Serial.print( ',' );
-        Serial.print( fxos8700.mag_raw.x );
+        Serial.print( imuSample.magRaw[0] );
         Serial.print( ',' );
-        Serial.print( fxos8700.mag_raw.y );
+        Serial.print( imuSample.magRaw[1] );
         Serial.print( ',' );
-        Serial.print( fxos8700.mag_raw.z );
+        Serial.print( imuSample.magRaw[2] );
         Serial.println();
 
         if( Serial.available() >= 68 ) {
@@ -316,19 +605,13 @@ void sensorWorker100HzPoller( void* z ) {
 
 //       // filter everything: lpf acc + mag, hpf gyr
 //       // input into AHRS
-//       ahrs.update(
-//         fxas2100gyrFilterX.step( gx ),
-//         fxas2100gyrFilterY.step( gy ),
-//         fxas2100gyrFilterZ.step( gz ),
-//
-//         fxos8700accFilterX.step( accel_event.acceleration.x ),
-//         fxos8700accFilterY.step( accel_event.acceleration.y ),
-//         fxos8700accFilterZ.step( accel_event.acceleration.z ),
-//
-//         fxos8700magFilterX.step( mmx ),
-//         fxos8700magFilterY.step( mmy ),
-//         fxos8700magFilterZ.step( mmz )
-//       );
+//       float ax = accel_event.acceleration.x;
+//       float ay = accel_event.acceleration.y;
+//       float az = accel_event.acceleration.z;
+//       fxas2100GyrFilter.step( gx, gy, gz );
+//       fxos8700AccFilter.step( ax, ay, az );
+//       fxos8700MagFilter.step( mmx, mmy, mmz );
+//       ahrs.update( gx, gy, gz, ax, ay, az, mmx, mmy, mmz );
 
       // input into AHRS
       ahrs.update(
@@ -364,8 +647,6 @@ void sensorWorker100HzPoller( void* z ) {
         imu::Vector<3> euler;
         euler = orientation.toEuler();
         euler.toDegrees();
-        steerImuInclinometerData.roll = euler[2];
-        steerImuInclinometerData.pitch = -euler[1];
         float heading = euler[0];
 
         if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
@@ -380,15 +661,23 @@ void sensorWorker100HzPoller( void* z ) {
           heading -= 360;
         }
 
-        steerImuInclinometerData.heading = heading;
+        steerImuInclinometerData.update( [&euler, heading]( SteerImuInclinometerData & data ) {
+          data.roll = euler[2];
+          data.pitch = -euler[1];
+          data.heading = heading;
+        } );
 
         if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
           static uint8_t loopCounter = 0;
 
           if( ++loopCounter >= 10 ) {
             loopCounter = 0;
-            steerImuInclinometerData.orientation.fromEuler( radians( -euler[1] ), radians( euler[2] ), radians( heading ) );
-            sendQuaternionTransmission( steerConfig.qogChannelIdOrientation, steerImuInclinometerData.orientation );
+            imu::Quaternion qogOrientation;
+            qogOrientation.fromEuler( radians( -euler[1] ), radians( euler[2] ), radians( heading ) );
+            steerImuInclinometerData.update( [&qogOrientation]( SteerImuInclinometerData & data ) {
+              data.orientation = qogOrientation;
+            } );
+            sendQuaternionTransmission( steerConfig.qogChannelIdOrientation, qogOrientation );
           }
         }
 
@@ -413,34 +702,21 @@ void sensorWorker100HzPoller( void* z ) {
 
     if( steerConfig.wheelAngleInput != SteerConfig::AnalogIn::None ) {
       float wheelAngleTmp = 0;
+      bool newSample = false;
 
       switch( ( uint8_t )steerConfig.wheelAngleInput ) {
         case( uint8_t )SteerConfig::AnalogIn::Esp32GpioA2 ...( uint8_t )SteerConfig::AnalogIn::Esp32GpioA12: {
           wheelAngleTmp = analogRead( ( uint8_t )steerConfig.wheelAngleInput );
+          newSample = true;
         }
         break;
 
-        case( uint8_t )SteerConfig::AnalogIn::ADS1115A0Single ...( uint8_t )SteerConfig::AnalogIn::ADS1115A3Single: {
-          if( xSemaphoreTake( i2cMutex, 1000 ) == pdTRUE ) {
-            wheelAngleTmp = ads.readADC_SingleEnded(
-                                    ( uint8_t )steerConfig.wheelAngleInput - ( uint8_t )SteerConfig::AnalogIn::ADS1115A0Single );
-            xSemaphoreGive( i2cMutex );
-          }
-        }
-        break;
+        case( uint8_t )SteerConfig::AnalogIn::ADS1115A0Single ...( uint8_t )SteerConfig::AnalogIn::ADS1115A2A3Differential: {
+          WheelAngleSample sample;
 
-        case( uint8_t )SteerConfig::AnalogIn::ADS1115A0A1Differential: {
-          if( xSemaphoreTake( i2cMutex, 1000 ) == pdTRUE ) {
-            wheelAngleTmp = ads.readADC_Differential_0_1();
-            xSemaphoreGive( i2cMutex );
-          }
-        }
-        break;
-
-        case( uint8_t )SteerConfig::AnalogIn::ADS1115A2A3Differential: {
-          if( xSemaphoreTake( i2cMutex, 1000 ) == pdTRUE ) {
-            wheelAngleTmp = ads.readADC_Differential_2_3();
-            xSemaphoreGive( i2cMutex );
+          if( xQueueReceive( wheelAngleMailbox, &sample, 0 ) == pdTRUE ) {
+            wheelAngleTmp = sample.value;
+            newSample = true;
           }
         }
         break;
@@ -449,11 +725,12 @@ void sensorWorker100HzPoller( void* z ) {
           break;
       }
 
-      {
+      if( newSample ) {
         wheelAngleTmp -= steerConfig.wheelAnglePositionZero;
         wheelAngleTmp /= steerConfig.wheelAngleCountsPerDegree;
 
-        steerSetpoints.wheelAngleRaw = wheelAngleTmp;
+        float wheelAngleRaw = wheelAngleTmp;
+        float wheelAngleCurrentDisplacement = 0;
 
         if( steerConfig.wheelAngleSensorType == SteerConfig::WheelAngleSensorType::TieRodDisplacement ) {
           if( steerConfig.wheelAngleFirstArmLenght != 0 && steerConfig.wheelAngleSecondArmLenght != 0 &&
@@ -471,11 +748,11 @@ void sensorWorker100HzPoller( void* z ) {
               return steerConfig.wheelAngleSecondArmLenght * sin( gamma ) / sin( alpha );
             };
 
-            steerSetpoints.wheelAngleCurrentDisplacement = getDisplacementFromAngle( wheelAngleTmp );
+            wheelAngleCurrentDisplacement = getDisplacementFromAngle( wheelAngleTmp );
 
             double relativeDisplacementToStraightAhead =
                     // real displacement
-                    steerSetpoints.wheelAngleCurrentDisplacement -
+                    wheelAngleCurrentDisplacement -
                     // calculate middle of displacement -
                     ( getDisplacementFromAngle( steerConfig.wheelAngleMinimumAngle ) + ( steerConfig.wheelAngleTieRodStroke / 2 ) );
 
@@ -490,7 +767,11 @@ void sensorWorker100HzPoller( void* z ) {
         wheelAngleTmp -= steerConfig.wheelAngleOffset;
 
         wheelAngleTmp = wheelAngleSensorFilter.step( wheelAngleTmp );
-        steerSetpoints.actualSteerAngle = wheelAngleTmp;
+        steerSetpoints.update( [wheelAngleRaw, wheelAngleCurrentDisplacement, wheelAngleTmp]( SteerSetpoints & setpoints ) {
+          setpoints.wheelAngleRaw = wheelAngleRaw;
+          setpoints.wheelAngleCurrentDisplacement = wheelAngleCurrentDisplacement;
+          setpoints.actualSteerAngle = wheelAngleTmp;
+        } );
 
         if( steerConfig.mode == SteerConfig::Mode::QtOpenGuidance ) {
           static uint8_t loopCounter = 0;
@@ -507,45 +788,55 @@ void sensorWorker100HzPoller( void* z ) {
 
       if( loopCounter++ > 99 ) {
         loopCounter = 0;
-        {
-          Control* handle = ESPUI.getControl( labelOrientation );
+        WebUiLock lock( 0 );
+        Control* handle = lock ? ESPUI.getControl( labelOrientation ) : nullptr;
+
+        if( handle != nullptr ) {
+          SteerImuInclinometerData imuInclinometerData = steerImuInclinometerData.read();
           handle->value = "Roll: ";
-          handle->value += ( float )steerImuInclinometerData.roll;
+          handle->value += ( float )imuInclinometerData.roll;
           handle->value += "°, Pitch: ";
-          handle->value += ( float )steerImuInclinometerData.pitch;
+          handle->value += ( float )imuInclinometerData.pitch;
           handle->value += "°, Heading: ";
-          handle->value += ( float )steerImuInclinometerData.heading;
+          handle->value += ( float )imuInclinometerData.heading;
 
           ESPUI.updateControlAsync( handle );
         }
-        {
-          Control* handle = ESPUI.getControl( labelWheelAngle );
-          String str;
-          str.reserve( 30 );
+
+        handle = lock ? ESPUI.getControl( labelWheelAngle ) : nullptr;
+
+        if( handle != nullptr ) {
+          SteerSetpoints setpoints = steerSetpoints.read();
+          String& str = handle->value;
+          str = "";
 
           if( steerConfig.wheelAngleSensorType == SteerConfig::WheelAngleSensorType::TieRodDisplacement ) {
-            str += ( float )steerSetpoints.actualSteerAngle;
+            str += ( float )setpoints.actualSteerAngle;
             str += "°, Raw ";
-            str += ( float )steerSetpoints.wheelAngleRaw;
+            str += ( float )setpoints.wheelAngleRaw;
             str += "°, Displacement ";
-            str += ( float )steerSetpoints.wheelAngleCurrentDisplacement;
+            str += ( float )setpoints.wheelAngleCurrentDisplacement;
             str += "mm";
           } else {
-            str += ( float )steerSetpoints.actualSteerAngle;
+            str += ( float )setpoints.actualSteerAngle;
             str += "°, Raw: ";
-            str += ( float )steerSetpoints.wheelAngleRaw;
+            str += ( float )setpoints.wheelAngleRaw;
             str += "°, SetPoint: ";
-            str += ( float )steerSetpoints.requestedSteerAngle;
+            str += ( float )setpoints.requestedSteerAngle;
             str += "°";
           }
 
-          handle->value = str;
           ESPUI.updateControlAsync( handle );
         }
+
+        updateI2cStatusLabel();
       }
     }
 
-    vTaskDelayUntil( &xLastWakeTime, xFrequency );
+    taskTimingStop( TaskId::SensorWorker100Hz );
+
+    // paced by i2cWorker, the timeout keeps the loop running if it stalls
+    ulTaskNotifyTake( pdTRUE, xFrequency * 2 );
   }
 }
 
@@ -555,20 +846,18 @@ void sensorWorker10HzPoller( void* z ) {
   TickType_t xLastWakeTime = xTaskGetTickCount();
 
   for( ;; ) {
-    if( initialisation.inclinoType == SteerConfig::InclinoType::MMA8451 ) {
-      sensors_event_t events[32];
+    taskTimingStart( TaskId::SensorWorker10Hz );
 
-      uint8_t numSamples = 0;
+    static InclinometerSample sample;
 
-      if( xSemaphoreTake( i2cMutex, 1000 ) == pdTRUE ) {
-        numSamples = mma.getEventsFromFifo( events );
-        xSemaphoreGive( i2cMutex );
-      }
+    if( initialisation.inclinoType == SteerConfig::InclinoType::MMA8451 &&
+        xQueueReceive( inclinometerMailbox, &sample, 0 ) == pdTRUE ) {
 
-      for( uint8_t i = 0; i < numSamples; i++ ) {
-        float x = mma8481accFilterX.step( events[i].acceleration.x );
-        float y = mma8481accFilterY.step( events[i].acceleration.y );
-        float z = mma8481accFilterZ.step( events[i].acceleration.z );
+      for( uint8_t i = 0; i < sample.numSamples; i++ ) {
+        float x = sample.events[i].acceleration.x;
+        float y = sample.events[i].acceleration.y;
+        float z = sample.events[i].acceleration.z;
+        mma8451AccFilter.step( x, y, z );
 
 //         accXaverage += x;
 //         accYaverage += y;
@@ -601,10 +890,14 @@ void sensorWorker10HzPoller( void* z ) {
       imu::Vector<3> euler = orientation.toEuler();
       euler.toDegrees();
 
-      steerImuInclinometerData.roll = euler[2];
-      steerImuInclinometerData.pitch = euler[1];
+      steerImuInclinometerData.update( [&euler]( SteerImuInclinometerData & data ) {
+        data.roll = euler[2];
+        data.pitch = euler[1];
+      } );
     }
 
+    taskTimingStop( TaskId::SensorWorker10Hz );
+
     vTaskDelayUntil( &xLastWakeTime, xFrequency );
   }
 }
@@ -612,27 +905,56 @@ void sensorWorker10HzPoller( void* z ) {
 void initSensors() {
   calculateMountingCorrection();
 
+  fxos8700AccFilter.butterworthLowPass( 10, sensorSampleRate );
+  fxos8700MagFilter.butterworthLowPass( 10, sensorSampleRate );
+  fxas2100GyrFilter.setCoefficients( 0, BiquadCoefficients::highPassFirstOrder( 1, sensorSampleRate ) );
+  wheelAngleSensorFilter.butterworthLowPass( 5, sensorSampleRate );
+  fxos8700AccFilter.reset();
+  fxos8700MagFilter.reset();
+  fxas2100GyrFilter.reset();
+  wheelAngleSensorFilter.reset();
+
+  // the ADS1115 gets a bus for itself, if the second one is configured
+  if( steerConfig.gpioSDA2 != SteerConfig::Gpio::None && steerConfig.gpioSCL2 != SteerConfig::Gpio::None ) {
+    i2cWheelAngleBus = 1;
+  }
+
+  // negotiate the speed before initialising the devices
+  {
+    if( steerConfig.gpioSDA != SteerConfig::Gpio::Default ) {
+      i2cBuses[0].sda = ( int )steerConfig.gpioSDA;
+    }
+
+    if( steerConfig.gpioSCL != SteerConfig::Gpio::Default ) {
+      i2cBuses[0].scl = ( int )steerConfig.gpioSCL;
+    }
+
+    i2cProbeBusSpeed( 0, steerConfig.i2cBusSpeed );
+
+    if( i2cWheelAngleBus != 0 ) {
+      i2cBuses[1].sda = ( int )steerConfig.gpioSDA2;
+      i2cBuses[1].scl = ( int )steerConfig.gpioSCL2;
+      i2cProbeBusSpeed( 1, steerConfig.i2cBusSpeed2 );
+    }
+  }
+
   if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
     if( steerConfig.inclinoType == SteerConfig::InclinoType::MMA8451 ) {
-      Control* handle = ESPUI.getControl( labelStatusInclino );
-
       if( mma.begin() ) {
         initialisation.inclinoType = SteerConfig::InclinoType::MMA8451;
 
-        handle->value = "MMA8451 found & initialized";
-        handle->color = ControlColor::Emerald;
+        updateStatusLabel( labelStatusInclino, "MMA8451 found & initialized", ControlColor::Emerald );
 
         mma.setRange( MMA8451_RANGE_2_G );
         mma.setDataRate( MMA8451_DATARATE_200_HZ );
+        mma8451AccFilter.butterworthLowPass( 10, mma8451SampleRate );
+        mma8451AccFilter.reset();
         mma.setFifoSettings( MMA8451_FIFO_CIRCULAR );
       } else {
         initialisation.inclinoType = SteerConfig::InclinoType::None;
 
-        handle->value = "MMA8451 not found";
-        handle->color = ControlColor::Alizarin;
+        updateStatusLabel( labelStatusInclino, "MMA8451 not found", ControlColor::Alizarin );
       }
-
-      ESPUI.updateControlAsync( handle );
     }
   }
 
@@ -644,20 +966,14 @@ void initSensors() {
       if( steerConfig.imuType == SteerConfig::ImuType::Fxos8700Fxas21002 ) {
         initialisation.imuType = steerConfig.imuType;
 
-        Control* handle = ESPUI.getControl( labelStatusImu );
-        handle->value = "FXAS2100/FXOS8700 found & initialized";
-        handle->color = ControlColor::Emerald;
-        ESPUI.updateControlAsync( handle );
+        updateStatusLabel( labelStatusImu, "FXAS2100/FXOS8700 found & initialized", ControlColor::Emerald );
       }
 
       if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
         if( steerConfig.inclinoType == SteerConfig::InclinoType::Fxos8700Fxas21002 ) {
           initialisation.inclinoType = steerConfig.inclinoType;
 
-          Control* handle = ESPUI.getControl( labelStatusInclino );
-          handle->value = "FXAS2100/FXOS8700 found & initialized";
-          handle->color = ControlColor::Emerald;
-          ESPUI.updateControlAsync( handle );
+          updateStatusLabel( labelStatusInclino, "FXAS2100/FXOS8700 found & initialized", ControlColor::Emerald );
         }
       }
 
@@ -666,20 +982,14 @@ void initSensors() {
       if( steerConfig.imuType == SteerConfig::ImuType::Fxos8700Fxas21002 ) {
         initialisation.imuType = SteerConfig::ImuType::None;
 
-        Control* handle = ESPUI.getControl( labelStatusImu );
-        handle->value = "FXAS2100/FXOS8700 not found";
-        handle->color = ControlColor::Alizarin;
-        ESPUI.updateControlAsync( handle );
+        updateStatusLabel( labelStatusImu, "FXAS2100/FXOS8700 not found", ControlColor::Alizarin );
       }
 
       if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
         if( steerConfig.inclinoType == SteerConfig::InclinoType::Fxos8700Fxas21002 ) {
           initialisation.inclinoType = SteerConfig::InclinoType::None;
 
-          Control* handle = ESPUI.getControl( labelStatusInclino );
-          handle->value = "FXAS2100/FXOS8700 not found";
-          handle->color = ControlColor::Alizarin;
-          ESPUI.updateControlAsync( handle );
+          updateStatusLabel( labelStatusInclino, "FXAS2100/FXOS8700 not found", ControlColor::Alizarin );
         }
       }
     }
@@ -688,28 +998,31 @@ void initSensors() {
 
   // initialise ads1115 everytime, even if not avaible (no answer in the init -> just sending)
   {
-    ads.setGain( GAIN_TWOTHIRDS );   // 2/3x gain +/- 6.144V  1 bit = 3mV      0.1875mV (default)
-    // ads.setGain(GAIN_ONE);        // 1x gain   +/- 4.096V  1 bit = 2mV      0.125mV
-    // ads.setGain(GAIN_TWO);        // 2x gain   +/- 2.048V  1 bit = 1mV      0.0625mV
-    // ads.setGain(GAIN_FOUR);       // 4x gain   +/- 1.024V  1 bit = 0.5mV    0.03125mV
-    // ads.setGain(GAIN_EIGHT);      // 8x gain   +/- 0.512V  1 bit = 0.25mV   0.015625mV
-    // ads.setGain(GAIN_SIXTEEN);    // 16x gain  +/- 0.256V  1 bit = 0.125mV  0.0078125mV
-
-    ads.begin();
-    ads.setSPS( ADS1115_DR_860SPS );
-
-    Control* handle = ESPUI.getControl( labelStatusAdc );
-    handle->value = "ADC1115 initialized";
-    handle->color = ControlColor::Emerald;
+    ads.begin( *i2cBuses[i2cWheelAngleBus].wire );
+
+    updateStatusLabel( labelStatusAdc, i2cWheelAngleBus ? "ADC1115 initialized on the second I2C bus" : "ADC1115 initialized",
+                       ControlColor::Emerald );
     initialisation.wheelAngleInput = steerConfig.wheelAngleInput;
-    ESPUI.updateControlAsync( handle );
   }
 
   if( steerConfig.mode == SteerConfig::Mode::AgOpenGps ) {
     if( steerConfig.inclinoType == SteerConfig::InclinoType::MMA8451 ) {
-      xTaskCreate( sensorWorker10HzPoller, "sensorWorker10HzPoller", 2048, NULL, 5, NULL );
+      createTask( TaskId::SensorWorker10Hz, sensorWorker10HzPoller );
     }
   }
 
-  xTaskCreate( sensorWorker100HzPoller, "sensorWorker100HzPoller", 4096, NULL, 6, NULL );
+  static StaticQueue_t wheelAngleMailboxBuffer, imuMailboxBuffer, inclinometerMailboxBuffer;
+  static uint8_t wheelAngleMailboxStorage[sizeof( WheelAngleSample )];
+  static uint8_t imuMailboxStorage[sizeof( ImuSample )];
+  static uint8_t inclinometerMailboxStorage[sizeof( InclinometerSample )];
+  wheelAngleMailbox = xQueueCreateStatic( 1, sizeof( WheelAngleSample ), wheelAngleMailboxStorage, &wheelAngleMailboxBuffer );
+  imuMailbox = xQueueCreateStatic( 1, sizeof( ImuSample ), imuMailboxStorage, &imuMailboxBuffer );
+  inclinometerMailbox = xQueueCreateStatic( 1, sizeof( InclinometerSample ), inclinometerMailboxStorage, &inclinometerMailboxBuffer );
+
+  createTask( TaskId::SensorWorker100Hz, sensorWorker100HzPoller, nullptr, &sensorWorker100HzHandle );
+  createTask( TaskId::I2cWorker0, i2cWorker, ( void* )0 );
+
+  if( i2cWheelAngleBus != 0 ) {
+    createTask( TaskId::I2cWorker1, i2cWorker, ( void* )1 );
+  }
 }
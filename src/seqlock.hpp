@@ -0,0 +1,107 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#if defined(ESP32)
+#include <Arduino.h>
+
+// critical section for the writers, so a writer can't be preempted in the middle of an update by a
+// reader on the same core, which would then spin forever
+class SeqLockWriteMutex {
+  public:
+    SeqLockWriteMutex() {
+      vPortCPUInitializeMutex( &mux );
+    }
+
+    void lock() {
+      portENTER_CRITICAL( &mux );
+    }
+
+    void unlock() {
+      portEXIT_CRITICAL( &mux );
+    }
+
+  private:
+    portMUX_TYPE mux;
+};
+#else
+#include <mutex>
+
+// on the host (test/test_seqlock.cpp), the threads are preempted anyway
+typedef std::mutex SeqLockWriteMutex;
+#endif
+
+// Sequence lock for the state shared between the tasks: the readers get a consistent copy without
+// locking, they retry if a write was in progress. The sequence is odd while writing.
+// The writers are serialised with SeqLockWriteMutex. Keep the updates short.
+template<class T>
+class SeqLock {
+  public:
+    SeqLock() : sequence( 0 ), data() {}
+
+    T read() const {
+      T value;
+      uint32_t begin;
+
+      do {
+        begin = sequence.load( std::memory_order_acquire );
+
+        if( begin & 1 ) {
+          continue;
+        }
+
+        value = data;
+        std::atomic_thread_fence( std::memory_order_acquire );
+      } while( ( begin & 1 ) || begin != sequence.load( std::memory_order_relaxed ) );
+
+      return value;
+    }
+
+    void write( const T& value ) {
+      update( [&value]( T & data ) {
+        data = value;
+      } );
+    }
+
+    // read-modify-write, for the state written by more than one task; f gets a reference to the data
+    template<class F>
+    void update( F f ) {
+      writeMutex.lock();
+      sequence.store( sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_release );
+
+      f( data );
+
+      sequence.store( sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+      writeMutex.unlock();
+    }
+
+  private:
+    std::atomic<uint32_t> sequence;
+    SeqLockWriteMutex writeMutex;
+    T data;
+};
@@ -0,0 +1,112 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <Arduino.h>
+
+#include "main.hpp"
+
+// The control path (I2C -> sensors -> autosteer -> CAN) gets the highest priorities on its own core; the
+// networking tasks run on the other core together with WiFi and AsyncTCP, below the priorities of the system
+// tasks there (WiFi: 23, lwIP: 18). The idle hooks in idleStats.cpp need some idle time on both cores.
+constexpr TaskLayout taskLayout[( uint8_t )TaskId::Count] = {
+  // name                       stack  prio  core               period
+  { "i2cWorker",                3072,  15,   TASK_CORE_CONTROL, 10 },
+  { "i2cWorker1",               2048,  15,   TASK_CORE_CONTROL, 10 },
+  { "sensorWorker100HzPoller",  4096,  14,   TASK_CORE_CONTROL, 10 },
+  { "autosteerWorker",          3096,  13,   TASK_CORE_CONTROL, 10 },
+  { "canTxWorker",              2048,  12,   TASK_CORE_CONTROL, 5 },
+  { "canWorker",                2048,  11,   TASK_CORE_CONTROL, 0 },
+  { "sensorWorker10HzPoller",   2048,  10,   TASK_CORE_CONTROL, 100 },
+  { "nmeaWorker",               2048,  5,    TASK_CORE_NETWORK, 10 },
+  { "ntripWorker",              4096,  4,    TASK_CORE_NETWORK, 0 },
+  { "ntripStandbyWorker",       3072,  4,    TASK_CORE_NETWORK, 0 },
+  { "ntripSourcetableWorker",   3072,  2,    TASK_CORE_NETWORK, 0 },
+  { "tcpCorrectionWorker",      2048,  4,    TASK_CORE_NETWORK, 0 },
+  { "IdleStats",                3072,  1,    TASK_CORE_NETWORK, 1000 }
+};
+
+TaskTiming taskTimings[( uint8_t )TaskId::Count] = {};
+TaskHandle_t taskHandles[( uint8_t )TaskId::Count] = {};
+
+// The stacks and the control blocks of all tasks are allocated statically, so they don't fragment the
+// heap and an oversized layout fails at link time instead of at runtime.
+static constexpr uint32_t taskStackOffset( uint8_t id ) {
+  return id == 0 ? 0 : taskStackOffset( id - 1 ) + taskLayout[id - 1].stackSize;
+}
+alignas( 16 ) static StackType_t taskStacks[taskStackOffset( ( uint8_t )TaskId::Count )];
+static StaticTask_t taskBuffers[( uint8_t )TaskId::Count];
+
+BaseType_t createTask( TaskId id, TaskFunction_t function, void* parameter, TaskHandle_t* handle ) {
+  const TaskLayout& layout = taskLayout[( uint8_t )id];
+
+  // a task can only be created once, its stack is reused otherwise
+  if( taskHandles[( uint8_t )id] != nullptr ) {
+    Serial.print( "Task already created: " );
+    Serial.println( layout.name );
+    return pdFAIL;
+  }
+
+  TaskHandle_t taskHandle = xTaskCreateStaticPinnedToCore( function, layout.name, layout.stackSize, parameter, layout.priority,
+                            &taskStacks[taskStackOffset( ( uint8_t )id )], &taskBuffers[( uint8_t )id], layout.core );
+
+  taskHandles[( uint8_t )id] = taskHandle;
+
+  if( handle != nullptr ) {
+    *handle = taskHandle;
+  }
+
+  return taskHandle != nullptr ? pdPASS : pdFAIL;
+}
+
+void deleteTask( TaskId id ) {
+  taskHandles[( uint8_t )id] = nullptr;
+  vTaskDelete( nullptr );
+}
+
+void taskTimingStart( TaskId id ) {
+  TaskTiming& timing = taskTimings[( uint8_t )id];
+  uint32_t now = micros();
+
+  if( taskLayout[( uint8_t )id].period && timing.loops ) {
+    int32_t jitter = ( int32_t )( now - timing.lastStart ) - ( int32_t )taskLayout[( uint8_t )id].period * 1000;
+
+    if( jitter < 0 ) {
+      jitter = -jitter;
+    }
+
+    if( ( uint32_t )jitter > timing.maxJitter ) {
+      timing.maxJitter = jitter;
+    }
+  }
+
+  timing.lastStart = now;
+  ++timing.loops;
+}
+
+void taskTimingStop( TaskId id ) {
+  TaskTiming& timing = taskTimings[( uint8_t )id];
+  uint32_t runTime = micros() - timing.lastStart;
+
+  if( runTime > timing.maxRunTime ) {
+    timing.maxRunTime = runTime;
+  }
+}
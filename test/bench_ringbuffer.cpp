@@ -0,0 +1,146 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Throughput of RingBuffer on the host, with a producer and a consumer thread and the size of the
+// transmit buffer of the TCP bridge. Compares the single element, the bulk and the zero-copy accessors.
+//
+//   g++ -std=c++11 -O2 -pthread -Isrc test/bench_ringbuffer.cpp -o bench_ringbuffer && ./bench_ringbuffer
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "ringbuffer.hpp"
+
+constexpr size_t BufferSize = 2048;
+constexpr size_t Bytes = 256 * 1024 * 1024;
+// about the size of a TCP segment or a burst of NMEA sentences
+constexpr size_t ChunkSize = 512;
+
+typedef RingBuffer<uint8_t, BufferSize> Buffer;
+
+static void produceSingle( Buffer& ringBuffer ) {
+  for( size_t written = 0; written < Bytes; ) {
+    if( ringBuffer.push( ( uint8_t )written ) ) {
+      ++written;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+static void consumeSingle( Buffer& ringBuffer ) {
+  uint8_t value;
+
+  for( size_t read = 0; read < Bytes; ) {
+    if( ringBuffer.pop( value ) ) {
+      ++read;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+static void produceBulk( Buffer& ringBuffer ) {
+  uint8_t data[ChunkSize] = {};
+
+  for( size_t written = 0; written < Bytes; ) {
+    if( ringBuffer.push( data, ChunkSize ) ) {
+      written += ChunkSize;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+static void consumeBulk( Buffer& ringBuffer ) {
+  uint8_t data[ChunkSize];
+
+  for( size_t read = 0; read < Bytes; ) {
+    size_t len = ringBuffer.pop( data, ChunkSize );
+    read += len;
+
+    if( !len ) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+static void produceZeroCopy( Buffer& ringBuffer ) {
+  for( size_t written = 0; written < Bytes; ) {
+    uint8_t* reserved;
+    size_t len = std::min( ringBuffer.reserveContiguous( reserved ), ChunkSize );
+
+    std::fill( reserved, reserved + len, 0 );
+    ringBuffer.commit( len );
+    written += len;
+
+    if( !len ) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+static void consumeZeroCopy( Buffer& ringBuffer ) {
+  volatile uint8_t sink = 0;
+
+  for( size_t read = 0; read < Bytes; ) {
+    const uint8_t* peeked;
+    size_t len = std::min( ringBuffer.peekContiguous( peeked ), ChunkSize );
+
+    // touch the data, like a socket write would
+    if( len ) {
+      sink = peeked[len - 1];
+    } else {
+      std::this_thread::yield();
+    }
+
+    ringBuffer.consume( len );
+    read += len;
+  }
+
+  ( void )sink;
+}
+
+static void bench( const char* name, void ( *producer )( Buffer& ), void ( *consumer )( Buffer& ) ) {
+  static Buffer ringBuffer;
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread producerThread( producer, std::ref( ringBuffer ) );
+  std::thread consumerThread( consumer, std::ref( ringBuffer ) );
+  producerThread.join();
+  consumerThread.join();
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>( end - start ).count();
+  printf( "%-24s %8.1f MB/s\n", name, Bytes / seconds / ( 1024 * 1024 ) );
+}
+
+int main() {
+  bench( "push()/pop()", produceSingle, consumeSingle );
+  bench( "bulk push()/pop()", produceBulk, consumeBulk );
+  bench( "zero-copy accessors", produceZeroCopy, consumeZeroCopy );
+  return 0;
+}
@@ -0,0 +1,167 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Fuzzer for the decoder of the AgOpenGPS PGNs, with the same tables as initAutosteer(). The handlers
+// are replaced by ones checking that the decoder only passes packets on which are long enough.
+//
+// Build and run with libFuzzer:
+//   clang++ -std=c++11 -g -O1 -fsanitize=fuzzer,address,undefined -Isrc test/fuzz_aogPgn.cpp -o fuzz_aogPgn
+//   ./fuzz_aogPgn -max_len=64
+//
+// Without clang, -DFUZZ_STANDALONE adds a main() which feeds random packets or the files given as arguments:
+//   g++ -std=c++11 -g -fsanitize=address,undefined -DFUZZ_STANDALONE -Isrc test/fuzz_aogPgn.cpp -o fuzz_aogPgn
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "aogPgnTable.hpp"
+
+static AogPgnDecoder aogLocalDecoder( aogLocalPgns, sizeof( aogLocalPgns ) / sizeof( aogLocalPgns[0] ) );
+static AogPgnDecoder aogRemoteDecoder( aogRemotePgns, sizeof( aogRemotePgns ) / sizeof( aogRemotePgns[0] ) );
+
+static const AogPgnDecoder::Entry* currentEntries = nullptr;
+static size_t currentCount = 0;
+static uint32_t handlerCalls = 0;
+
+#define FUZZ_CHECK( condition ) \
+  if( !( condition ) ) { \
+    fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+    abort(); \
+  }
+
+static void checkPacket( const uint8_t* data, size_t len, AogPgnDecoder::Handler handler ) {
+  ++handlerCalls;
+  FUZZ_CHECK( len >= 2 && data[0] == 0x7F );
+
+  uint16_t pgn = ( data[0] << 8 ) | data[1];
+  const AogPgnDecoder::Entry* entry = nullptr;
+
+  for( size_t i = 0; i < currentCount; ++i ) {
+    if( currentEntries[i].pgn == pgn ) {
+      entry = &currentEntries[i];
+    }
+  }
+
+  FUZZ_CHECK( entry != nullptr && entry->handler == handler );
+  FUZZ_CHECK( len >= entry->length );
+
+  // touch every byte the real handler is allowed to index, so the sanitizer sees overreads
+  volatile uint8_t sum = 0;
+
+  for( size_t i = 0; i < entry->length; ++i ) {
+    sum += data[i];
+  }
+}
+
+void decodeAogSteerData( const uint8_t* data, size_t len ) {
+  checkPacket( data, len, decodeAogSteerData );
+}
+
+void decodeAogSteerSettings( const uint8_t* data, size_t len ) {
+  checkPacket( data, len, decodeAogSteerSettings );
+}
+
+void decodeAogMachineControl( const uint8_t* data, size_t len ) {
+  checkPacket( data, len, decodeAogMachineControl );
+}
+
+void decodeAogRoll( const uint8_t* data, size_t len ) {
+  checkPacket( data, len, decodeAogRoll );
+}
+
+static uint32_t decoderTotal( const AogPgnDecoder& decoder ) {
+  uint32_t total = decoder.unknown + decoder.tooShort + decoder.malformed;
+
+  for( uint8_t i = 0; i < decoder.size(); ++i ) {
+    total += decoder.decoded[i];
+  }
+
+  return total;
+}
+
+static void decodeWith( AogPgnDecoder& decoder, const AogPgnDecoder::Entry* entries, size_t count,
+                        const uint8_t* data, size_t size ) {
+  currentEntries = entries;
+  currentCount = count;
+
+  uint32_t callsBefore = handlerCalls;
+  uint32_t totalBefore = decoderTotal( decoder );
+
+  bool decoded = decoder.decode( data, size );
+
+  // exactly one handler is called for a decoded packet, and every packet is counted once
+  FUZZ_CHECK( handlerCalls - callsBefore == ( decoded ? 1u : 0u ) );
+  FUZZ_CHECK( decoderTotal( decoder ) - totalBefore == 1 );
+}
+
+extern "C" int LLVMFuzzerTestOneInput( const uint8_t* data, size_t size ) {
+  decodeWith( aogLocalDecoder, aogLocalPgns, sizeof( aogLocalPgns ) / sizeof( aogLocalPgns[0] ), data, size );
+  decodeWith( aogRemoteDecoder, aogRemotePgns, sizeof( aogRemotePgns ) / sizeof( aogRemotePgns[0] ), data, size );
+  return 0;
+}
+
+#if defined(FUZZ_STANDALONE)
+int main( int argc, char** argv ) {
+  if( argc > 1 ) {
+    for( int i = 1; i < argc; ++i ) {
+      FILE* file = fopen( argv[i], "rb" );
+
+      if( file != nullptr ) {
+        static uint8_t buffer[4096];
+        size_t size = fread( buffer, 1, sizeof( buffer ), file );
+        fclose( file );
+
+        // copy into an allocation of the exact size, so the sanitizer catches overreads
+        uint8_t* data = ( uint8_t* )malloc( size );
+        memcpy( data, buffer, size );
+        LLVMFuzzerTestOneInput( data, size );
+        free( data );
+      }
+    }
+  } else {
+    srand( 1 );
+
+    for( uint32_t i = 0; i < 1000000; ++i ) {
+      size_t size = rand() % 16;
+      uint8_t* data = ( uint8_t* )malloc( size );
+
+      for( size_t j = 0; j < size; ++j ) {
+        data[j] = rand();
+      }
+
+      // mostly valid PGNs, to get past the first checks
+      if( size >= 2 && ( i & 1 ) ) {
+        data[0] = 0x7F;
+        data[1] = 0xEE + rand() % 0x12;
+      }
+
+      LLVMFuzzerTestOneInput( data, size );
+      free( data );
+    }
+  }
+
+  printf( "%u packets decoded\n", handlerCalls );
+  return 0;
+}
+#endif
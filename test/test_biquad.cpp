@@ -0,0 +1,171 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Tests for BiquadCascade on the host: after reset( value ), the filter has to be in the same state as
+// one which got that value applied for a long time, so it has to output the same for any input that
+// follows, without a transient at the start.
+//
+//   g++ -std=c++11 -O2 -Isrc test/test_biquad.cpp -o test_biquad && ./test_biquad
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <initializer_list>
+
+#include "biquad.hpp"
+
+#define TEST_CHECK( condition ) \
+  if( !( condition ) ) { \
+    fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+    abort(); \
+  }
+
+static uint32_t randomState = 1;
+
+static float nextRandom() {
+  randomState = randomState * 1103515245 + 12345;
+  return ( float )( randomState >> 8 ) / ( 1 << 24 );
+}
+
+enum class Design { LowPass, HighPass, LowPassFirstOrder, HighPassFirstOrder };
+
+template<size_t Sections, size_t Channels>
+static void design( BiquadCascade<Sections, Channels>& filter, Design type, float cutoff, float sampleRate ) {
+  switch( type ) {
+    case Design::LowPass:
+      filter.butterworthLowPass( cutoff, sampleRate );
+      break;
+
+    case Design::HighPass:
+      filter.butterworthHighPass( cutoff, sampleRate );
+      break;
+
+    case Design::LowPassFirstOrder:
+      for( size_t i = 0; i < Sections; ++i ) {
+        filter.setCoefficients( i, BiquadCoefficients::lowPassFirstOrder( cutoff, sampleRate ) );
+      }
+
+      break;
+
+    case Design::HighPassFirstOrder:
+      for( size_t i = 0; i < Sections; ++i ) {
+        filter.setCoefficients( i, BiquadCoefficients::highPassFirstOrder( cutoff, sampleRate ) );
+      }
+
+      break;
+  }
+}
+
+// the settled filter is started from another value, so a wrong reset() can't hide behind a zero state
+template<size_t Sections, size_t Channels>
+static void testReset( const char* name, Design type, float cutoff, float sampleRate ) {
+  const float gain = ( type == Design::LowPass || type == Design::LowPassFirstOrder ) ? 1 : 0;
+
+  for( float value : { 0.f, 1.f, -37.5f, 1000.f } ) {
+    BiquadCascade<Sections, Channels> resetFilter, settledFilter;
+    design( resetFilter, type, cutoff, sampleRate );
+    design( settledFilter, type, cutoff, sampleRate );
+
+    resetFilter.reset( value );
+
+    // the channels share the value of reset(), the settled filter gets it on all of them too
+    settledFilter.reset( -value - 10 );
+
+    for( uint32_t i = 0; i < 200000; ++i ) {
+      float settled[Channels];
+
+      for( size_t channel = 0; channel < Channels; ++channel ) {
+        settled[channel] = value;
+      }
+
+      settledFilter.step( settled );
+    }
+
+    // the steady state itself: a constant input gives a constant output from the first step on
+    BiquadCascade<Sections, Channels> constantFilter = resetFilter;
+
+    for( uint32_t i = 0; i < 100; ++i ) {
+      float constant[Channels];
+
+      for( size_t channel = 0; channel < Channels; ++channel ) {
+        constant[channel] = value;
+      }
+
+      constantFilter.step( constant );
+
+      for( size_t channel = 0; channel < Channels; ++channel ) {
+        TEST_CHECK( fabsf( constant[channel] - gain * value ) <= 1e-4f * ( fabsf( value ) + 1 ) );
+      }
+    }
+
+    // any input after it gives the same output as from the settled filter
+    for( uint32_t i = 0; i < 1000; ++i ) {
+      float input = ( nextRandom() - 0.5f ) * 2 * ( fabsf( value ) + 1 );
+      float fromReset[Channels];
+      float fromSettled[Channels];
+
+      for( size_t channel = 0; channel < Channels; ++channel ) {
+        fromReset[channel] = fromSettled[channel] = input + channel;
+      }
+
+      resetFilter.step( fromReset );
+      settledFilter.step( fromSettled );
+
+      for( size_t channel = 0; channel < Channels; ++channel ) {
+        TEST_CHECK( fabsf( fromReset[channel] - fromSettled[channel] ) <= 1e-3f * ( fabsf( value ) + 1 ) );
+      }
+    }
+  }
+
+  printf( "reset(): %s, %u sections, %u channels\n", name, ( unsigned )Sections, ( unsigned )Channels );
+}
+
+// without coefficients, the values pass unchanged, also after reset()
+static void testPassThrough() {
+  BiquadCascade<2, 3> filter;
+  filter.reset( 5 );
+
+  for( uint32_t i = 0; i < 100; ++i ) {
+    float x = nextRandom(), y = nextRandom(), z = nextRandom();
+    float fx = x, fy = y, fz = z;
+    filter.step( fx, fy, fz );
+    TEST_CHECK( fx == x && fy == y && fz == z );
+  }
+
+  printf( "pass through without coefficients\n" );
+}
+
+int main() {
+  testPassThrough();
+
+  testReset<1, 1>( "low pass", Design::LowPass, 5, 100 );
+  testReset<2, 1>( "low pass", Design::LowPass, 5, 100 );
+  testReset<3, 3>( "low pass", Design::LowPass, 2, 100 );
+  testReset<2, 1>( "high pass", Design::HighPass, 1, 100 );
+  testReset<1, 3>( "first order low pass", Design::LowPassFirstOrder, 10, 100 );
+  testReset<2, 1>( "first order high pass", Design::HighPassFirstOrder, 1, 100 );
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Tests for CborWriter on the host: the maps of the QOG transmissions have to be identical to the ones
+// json::to_cbor() writes, for all sizes of the channel id and for special floating point values.
+//
+//   g++ -std=c++11 -O2 -Isrc test/test_cborWriter.cpp -o test_cborWriter && ./test_cborWriter
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "cborWriter.hpp"
+
+#include "../lib/json/json.hpp"
+using json = nlohmann::json;
+
+#define TEST_CHECK( condition ) \
+  if( !( condition ) ) { \
+    fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+    abort(); \
+  }
+
+static const uint16_t channelIds[] = { 0, 1, 0x17, 0x18, 0xFF, 0x100, 0xFFFF };
+static const double numbers[] = { 0, -0.0, 1, -1.5, 0.1, 1e300, -4.9e-324,
+                                  std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN()
+                                };
+
+static bool equals( const uint8_t* buffer, size_t size, const json& j ) {
+  std::vector<uint8_t> cbor = json::to_cbor( j );
+  return cbor.size() == size && std::equal( cbor.begin(), cbor.end(), buffer );
+}
+
+static void testState() {
+  for( uint16_t channelId : channelIds ) {
+    for( bool state : { false, true } ) {
+      uint8_t buffer[24];
+      CborWriter cbor( buffer );
+      cbor.map( 2 );
+      cbor.key( "channelId" );
+      cbor.unsignedInteger( channelId );
+      cbor.key( "state" );
+      cbor.boolean( state );
+
+      json j;
+      j["channelId"] = channelId;
+      j["state"] = state;
+      TEST_CHECK( equals( buffer, cbor.size(), j ) );
+    }
+  }
+
+  printf( "state transmission\n" );
+}
+
+static void testNumber() {
+  for( uint16_t channelId : channelIds ) {
+    for( double number : numbers ) {
+      uint8_t buffer[32];
+      CborWriter cbor( buffer );
+      cbor.map( 2 );
+      cbor.key( "channelId" );
+      cbor.unsignedInteger( channelId );
+      cbor.key( "number" );
+      cbor.number( number );
+
+      json j;
+      j["channelId"] = channelId;
+      j["number"] = number;
+      TEST_CHECK( equals( buffer, cbor.size(), j ) );
+    }
+  }
+
+  printf( "number transmission\n" );
+}
+
+static void testQuaternion() {
+  for( uint16_t channelId : channelIds ) {
+    for( double number : numbers ) {
+      uint8_t buffer[64];
+      CborWriter cbor( buffer );
+      cbor.map( 5 );
+      cbor.key( "channelId" );
+      cbor.unsignedInteger( channelId );
+      cbor.key( "w" );
+      cbor.number( number );
+      cbor.key( "x" );
+      cbor.number( -number );
+      cbor.key( "y" );
+      cbor.number( number / 3 );
+      cbor.key( "z" );
+      cbor.number( 0.5 );
+
+      json j;
+      j["channelId"] = channelId;
+      j["x"] = -number;
+      j["y"] = number / 3;
+      j["z"] = 0.5;
+      j["w"] = number;
+      TEST_CHECK( equals( buffer, cbor.size(), j ) );
+    }
+  }
+
+  printf( "quaternion transmission\n" );
+}
+
+int main() {
+  testState();
+  testNumber();
+  testQuaternion();
+
+  return 0;
+}
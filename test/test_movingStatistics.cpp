@@ -0,0 +1,241 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Tests for MovingStatistics on the host: mean, variance, minimum and maximum are compared with a
+// brute-force calculation over the same window, for random values, across many wrap-arounds of the
+// buffer and after flush() in the middle of a window.
+//
+//   g++ -std=c++11 -O2 -Isrc test/test_movingStatistics.cpp -o test_movingStatistics && ./test_movingStatistics
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+#include "average.hpp"
+
+#define TEST_CHECK( condition ) \
+  if( !( condition ) ) { \
+    fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+    abort(); \
+  }
+
+static uint32_t randomState = 1;
+
+static uint32_t nextRandom() {
+  randomState = randomState * 1103515245 + 12345;
+  return randomState >> 8;
+}
+
+// the window of the last Size values since the last flush, calculated like MovingStatistics does, but
+// from scratch every time
+template <class T, class Tcalc, size_t Size>
+struct BruteForce {
+  std::deque<T> window;
+  // the values since the last flush, up to two windows: the sums are recalculated when the buffer wraps,
+  // so their rounding errors come from these
+  std::deque<T> history;
+
+  void add( T value ) {
+    window.push_back( value );
+    history.push_back( value );
+
+    if( window.size() > Size ) {
+      window.pop_front();
+    }
+
+    if( history.size() > 2 * Size ) {
+      history.pop_front();
+    }
+  }
+
+  void flush() {
+    window.clear();
+    history.clear();
+  }
+
+  Tcalc mean() const {
+    Tcalc sum = 0;
+
+    for( T value : window ) {
+      sum += value;
+    }
+
+    return window.empty() ? 0 : sum / ( Tcalc )window.size();
+  }
+
+  Tcalc meanOfSquares() const {
+    Tcalc sum = 0;
+
+    for( T value : window ) {
+      sum += ( Tcalc )value * ( Tcalc )value;
+    }
+
+    return window.empty() ? 0 : sum / ( Tcalc )window.size();
+  }
+
+  T min() const {
+    return window.empty() ? 0 : *std::min_element( window.begin(), window.end() );
+  }
+
+  T max() const {
+    return window.empty() ? 0 : *std::max_element( window.begin(), window.end() );
+  }
+};
+
+// integers: everything is exact, the variance uses the same truncating divisions
+template <class T, class Tcalc, size_t Size>
+static void check( const MovingStatistics<T, Tcalc, Size>& statistics, const BruteForce<T, Tcalc, Size>& bruteForce, std::true_type ) {
+  Tcalc mean = bruteForce.mean();
+
+  TEST_CHECK( statistics.mean() == mean );
+  TEST_CHECK( statistics.variance() == ( bruteForce.window.empty() ? 0 : bruteForce.meanOfSquares() - mean * mean ) );
+}
+
+// floating point: the sums are updated incrementally, so allow for their rounding errors. Up to 2 * Size
+// additions and subtractions, each off by the precision of a sum of Size values; the sums of values
+// already dropped out of the window count too. The variance is the difference of two big numbers, so
+// it isn't any more accurate than the mean of the squares.
+template <class T, class Tcalc, size_t Size>
+static void check( const MovingStatistics<T, Tcalc, Size>& statistics, const BruteForce<T, Tcalc, Size>& bruteForce, std::false_type ) {
+  double maxAbs = 0;
+
+  for( T value : bruteForce.history ) {
+    maxAbs = std::max( maxAbs, fabs( ( double )value ) );
+  }
+
+  double error = 4. * Size * Size * std::numeric_limits<Tcalc>::epsilon() / std::max( bruteForce.window.size(), ( size_t )1 );
+  double mean = 0;
+  double variance = 0;
+
+  for( T value : bruteForce.window ) {
+    mean += value;
+  }
+
+  if( !bruteForce.window.empty() ) {
+    mean /= bruteForce.window.size();
+
+    for( T value : bruteForce.window ) {
+      variance += ( value - mean ) * ( value - mean );
+    }
+
+    variance /= bruteForce.window.size();
+  }
+
+  TEST_CHECK( fabs( statistics.mean() - mean ) <= error * ( maxAbs + 1 ) );
+  TEST_CHECK( statistics.variance() >= 0 );
+  TEST_CHECK( fabs( statistics.variance() - variance ) <= error * ( maxAbs * maxAbs + 1 ) );
+}
+
+template <class T, class Tcalc, size_t Size>
+static void check( const MovingStatistics<T, Tcalc, Size>& statistics, const BruteForce<T, Tcalc, Size>& bruteForce ) {
+  TEST_CHECK( statistics.size() == bruteForce.window.size() );
+  TEST_CHECK( statistics.isEmpty() == bruteForce.window.empty() );
+  TEST_CHECK( statistics.min() == bruteForce.min() );
+  TEST_CHECK( statistics.max() == bruteForce.max() );
+
+  check( statistics, bruteForce, std::integral_constant<bool, std::is_integral<Tcalc>::value>() );
+}
+
+// generate() returns the next value; runs of equal values and monotonic stretches fill the queues of
+// the minimum and maximum completely
+template <class T, class Tcalc, size_t Size, class Generator>
+static void testRandom( const char* name, Generator generate ) {
+  static MovingStatistics<T, Tcalc, Size> statistics;
+  BruteForce<T, Tcalc, Size> bruteForce;
+  statistics.flush();
+
+  check( statistics, bruteForce );
+
+  for( uint32_t i = 0; i < 200 * Size; ++i ) {
+    T value;
+
+    switch( ( nextRandom() >> 4 ) % 8 ) {
+      case 0:
+        value = bruteForce.window.empty() ? generate() : bruteForce.window.back();
+        break;
+
+      case 1:
+        value = bruteForce.window.empty() ? generate() : std::max( bruteForce.window.back(), generate() );
+        break;
+
+      default:
+        value = generate();
+        break;
+    }
+
+    statistics += value;
+    bruteForce.add( value );
+    check( statistics, bruteForce );
+
+    // now and then in the middle of a window, with the queues and the index at random positions
+    if( nextRandom() % ( 7 * Size ) == 0 ) {
+      statistics.flush();
+      bruteForce.flush();
+      check( statistics, bruteForce );
+    }
+  }
+
+  // a long increasing and decreasing run, every value is a candidate for one of the queues
+  for( uint32_t i = 0; i < 3 * Size; ++i ) {
+    statistics += ( T )i;
+    bruteForce.add( ( T )i );
+    check( statistics, bruteForce );
+  }
+
+  for( uint32_t i = 3 * Size; i > 0; --i ) {
+    statistics += ( T )i;
+    bruteForce.add( ( T )i );
+    check( statistics, bruteForce );
+  }
+
+  printf( "random values: %s, size %u\n", name, ( unsigned )Size );
+}
+
+int main() {
+  // like the age of the corrections in rtk.cpp; the squares of the values have to fit into Tcalc
+  testRandom<uint16_t, uint32_t, 60>( "uint16_t/uint32_t", []() {
+    return ( uint16_t )( nextRandom() % 5000 );
+  } );
+  testRandom<int16_t, int32_t, 7>( "int16_t/int32_t", []() {
+    return ( int16_t )( ( int32_t )( nextRandom() % 2001 ) - 1000 );
+  } );
+  testRandom<uint8_t, uint32_t, 1>( "uint8_t/uint32_t", []() {
+    return ( uint8_t )nextRandom();
+  } );
+  testRandom<float, float, 20>( "float/float", []() {
+    return ( float )( nextRandom() % 200001 ) / 100 - 1000;
+  } );
+  // a big offset: the variance is the difference of two nearly equal numbers and gets clamped to 0
+  testRandom<float, float, 16>( "float/float, offset", []() {
+    return 5000 + ( float )( nextRandom() % 3 ) / 1000;
+  } );
+  testRandom<double, double, 33>( "double/double", []() {
+    return ( double )( nextRandom() % 2000001 ) / 1000 - 1000;
+  } );
+
+  return 0;
+}
@@ -0,0 +1,314 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Tests for RingBuffer on the host: the boundaries, the wrap-around of the contiguous accessors and
+// a producer/consumer pair of threads.
+//
+//   g++ -std=c++11 -O2 -pthread -Isrc test/test_ringbuffer.cpp -o test_ringbuffer && ./test_ringbuffer
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+
+#include "ringbuffer.hpp"
+
+#define TEST_CHECK( condition ) \
+  if( !( condition ) ) { \
+    fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+    abort(); \
+  }
+
+// moves head and tail forward, so the next access starts at offset in the buffer
+template <class T, size_t Size>
+static void advance( RingBuffer<T, Size>& ringBuffer, size_t offset ) {
+  for( size_t i = 0; i < offset; ++i ) {
+    T value;
+    TEST_CHECK( ringBuffer.push( T() ) );
+    TEST_CHECK( ringBuffer.pop( value ) );
+  }
+}
+
+// full and empty, starting at every offset in the buffer
+template <size_t Size>
+static void testFullEmpty() {
+  for( size_t offset = 0; offset < Size; ++offset ) {
+    RingBuffer<uint32_t, Size> ringBuffer;
+    advance( ringBuffer, offset );
+
+    uint32_t value;
+    TEST_CHECK( ringBuffer.isEmpty() );
+    TEST_CHECK( ringBuffer.space() == Size );
+    TEST_CHECK( !ringBuffer.pop( value ) );
+
+    for( uint32_t i = 0; i < Size; ++i ) {
+      TEST_CHECK( ringBuffer.push( i ) );
+    }
+
+    TEST_CHECK( ringBuffer.available() == Size );
+    TEST_CHECK( ringBuffer.space() == 0 );
+    TEST_CHECK( !ringBuffer.push( Size ) );
+
+    for( uint32_t i = 0; i < Size; ++i ) {
+      TEST_CHECK( ringBuffer.pop( value ) );
+      TEST_CHECK( value == i );
+    }
+
+    TEST_CHECK( ringBuffer.isEmpty() );
+    TEST_CHECK( !ringBuffer.pop( value ) );
+
+    // the bulk push is all or nothing
+    uint32_t data[Size + 1];
+
+    for( uint32_t i = 0; i <= Size; ++i ) {
+      data[i] = i;
+    }
+
+    TEST_CHECK( !ringBuffer.push( data, Size + 1 ) );
+    TEST_CHECK( ringBuffer.isEmpty() );
+    TEST_CHECK( ringBuffer.push( data, Size ) );
+    TEST_CHECK( !ringBuffer.push( data, 1 ) );
+
+    uint32_t result[Size + 1] = {};
+    TEST_CHECK( ringBuffer.pop( result, Size + 1 ) == Size );
+
+    for( uint32_t i = 0; i < Size; ++i ) {
+      TEST_CHECK( result[i] == i );
+    }
+
+    TEST_CHECK( ringBuffer.pop( result, Size ) == 0 );
+
+    // flush
+    TEST_CHECK( ringBuffer.push( data, Size / 2 + 1 ) );
+    ringBuffer.flush();
+    TEST_CHECK( ringBuffer.isEmpty() );
+    TEST_CHECK( ringBuffer.space() == Size );
+  }
+
+  printf( "full/empty: size %u\n", ( unsigned )Size );
+}
+
+static void testWrapPeekConsume() {
+  RingBuffer<uint8_t, 16> ringBuffer;
+  advance( ringBuffer, 10 );
+
+  uint8_t data[12];
+
+  for( uint8_t i = 0; i < sizeof( data ); ++i ) {
+    data[i] = i + 1;
+  }
+
+  TEST_CHECK( ringBuffer.push( data, sizeof( data ) ) );
+
+  // the first part up to the end of the buffer
+  const uint8_t* peeked;
+  TEST_CHECK( ringBuffer.peekContiguous( peeked ) == 6 );
+
+  for( uint8_t i = 0; i < 6; ++i ) {
+    TEST_CHECK( peeked[i] == i + 1 );
+  }
+
+  // a partial consume leaves the rest of the first part
+  ringBuffer.consume( 2 );
+  TEST_CHECK( ringBuffer.peekContiguous( peeked ) == 4 );
+  TEST_CHECK( peeked[0] == 3 );
+  ringBuffer.consume( 4 );
+
+  // the wrapped part at the start of the buffer
+  TEST_CHECK( ringBuffer.peekContiguous( peeked ) == 6 );
+
+  for( uint8_t i = 0; i < 6; ++i ) {
+    TEST_CHECK( peeked[i] == i + 7 );
+  }
+
+  ringBuffer.consume( 6 );
+  TEST_CHECK( ringBuffer.isEmpty() );
+  TEST_CHECK( ringBuffer.peekContiguous( peeked ) == 0 );
+
+  printf( "wrap-around with peekContiguous()/consume()\n" );
+}
+
+static void testWrapReserveCommit() {
+  RingBuffer<uint8_t, 16> ringBuffer;
+  advance( ringBuffer, 10 );
+
+  // two elements stored: the space up to the end of the buffer is 4
+  TEST_CHECK( ringBuffer.push( 1 ) );
+  TEST_CHECK( ringBuffer.push( 2 ) );
+
+  uint8_t* reserved;
+  TEST_CHECK( ringBuffer.reserveContiguous( reserved ) == 4 );
+
+  for( uint8_t i = 0; i < 4; ++i ) {
+    reserved[i] = i + 3;
+  }
+
+  ringBuffer.commit( 4 );
+
+  // the rest of the space, at the start of the buffer
+  TEST_CHECK( ringBuffer.reserveContiguous( reserved ) == 10 );
+
+  for( uint8_t i = 0; i < 10; ++i ) {
+    reserved[i] = i + 7;
+  }
+
+  ringBuffer.commit( 10 );
+  TEST_CHECK( ringBuffer.space() == 0 );
+  TEST_CHECK( ringBuffer.reserveContiguous( reserved ) == 0 );
+
+  uint8_t value;
+
+  for( uint8_t i = 1; i <= 16; ++i ) {
+    TEST_CHECK( ringBuffer.pop( value ) );
+    TEST_CHECK( value == i );
+  }
+
+  TEST_CHECK( ringBuffer.isEmpty() );
+
+  printf( "wrap-around with reserveContiguous()/commit()\n" );
+}
+
+// the producer and the consumer alternate between all their accessors, the bytes have to arrive in order
+static void testProducerConsumer() {
+  static RingBuffer<uint8_t, 256> ringBuffer;
+  constexpr size_t Bytes = 16 * 1024 * 1024;
+
+  std::thread producer( []() {
+    size_t written = 0;
+    uint32_t random = 1;
+
+    while( written < Bytes ) {
+      random = random * 1103515245 + 12345;
+      size_t len = std::min( ( size_t )( random >> 16 ) % 300, Bytes - written );
+
+      switch( ( random >> 8 ) % 3 ) {
+        case 0:
+          if( len && ringBuffer.push( ( uint8_t )written ) ) {
+            ++written;
+          }
+
+          break;
+
+        case 1: {
+          uint8_t data[300];
+
+          for( size_t i = 0; i < len; ++i ) {
+            data[i] = written + i;
+          }
+
+          if( ringBuffer.push( data, len ) ) {
+            written += len;
+          }
+        }
+        break;
+
+        case 2: {
+          uint8_t* reserved;
+          len = std::min( len, ringBuffer.reserveContiguous( reserved ) );
+
+          for( size_t i = 0; i < len; ++i ) {
+            reserved[i] = written + i;
+          }
+
+          ringBuffer.commit( len );
+          written += len;
+        }
+        break;
+      }
+
+      // let the consumer run, if there is only one core
+      if( ringBuffer.space() == 0 ) {
+        std::this_thread::yield();
+      }
+    }
+  } );
+
+  std::thread consumer( []() {
+    size_t read = 0;
+    uint32_t random = 2;
+
+    while( read < Bytes ) {
+      random = random * 1103515245 + 12345;
+      size_t len = ( random >> 16 ) % 300;
+
+      switch( ( random >> 8 ) % 3 ) {
+        case 0: {
+          uint8_t value;
+
+          if( ringBuffer.pop( value ) ) {
+            TEST_CHECK( value == ( uint8_t )read );
+            ++read;
+          }
+        }
+        break;
+
+        case 1: {
+          uint8_t data[300];
+          size_t popped = ringBuffer.pop( data, len );
+
+          for( size_t i = 0; i < popped; ++i ) {
+            TEST_CHECK( data[i] == ( uint8_t )( read + i ) );
+          }
+
+          read += popped;
+        }
+        break;
+
+        case 2: {
+          const uint8_t* peeked;
+          len = std::min( len, ringBuffer.peekContiguous( peeked ) );
+
+          for( size_t i = 0; i < len; ++i ) {
+            TEST_CHECK( peeked[i] == ( uint8_t )( read + i ) );
+          }
+
+          ringBuffer.consume( len );
+          read += len;
+        }
+        break;
+      }
+
+      if( ringBuffer.isEmpty() ) {
+        std::this_thread::yield();
+      }
+    }
+  } );
+
+  producer.join();
+  consumer.join();
+
+  TEST_CHECK( ringBuffer.isEmpty() );
+  printf( "producer/consumer: %u bytes in order\n", ( unsigned )Bytes );
+}
+
+int main() {
+  testFullEmpty<1>();
+  testFullEmpty<2>();
+  testFullEmpty<4>();
+  testFullEmpty<64>();
+  testFullEmpty<1024>();
+  testWrapPeekConsume();
+  testWrapReserveCommit();
+  testProducerConsumer();
+  return 0;
+}
@@ -0,0 +1,143 @@
+// MIT License
+//
+// Copyright (c) 2020 Christian Riggenbach
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Stress test for SeqLock on the host: a writer stores structs where every field equals the sequence
+// number, the readers check that they never see a torn snapshot.
+//
+//   g++ -std=c++11 -O2 -pthread -Isrc test/test_seqlock.cpp -o test_seqlock && ./test_seqlock
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+
+#include "seqlock.hpp"
+
+#define TEST_CHECK( condition ) \
+  if( !( condition ) ) { \
+    fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+    abort(); \
+  }
+
+// bigger than a cache line, so a torn copy is likely if the locking is wrong
+struct Snapshot {
+  uint32_t values[24];
+  double number;
+};
+
+constexpr uint32_t Writes = 2000000;
+
+static bool isConsistent( const Snapshot& snapshot ) {
+  for( uint32_t value : snapshot.values ) {
+    if( value != snapshot.values[0] ) {
+      return false;
+    }
+  }
+
+  return snapshot.number == snapshot.values[0];
+}
+
+static void testNoTornReads() {
+  SeqLock<Snapshot> seqLock;
+  std::atomic<bool> done( false );
+  uint32_t reads = 0;
+
+  std::thread reader( [&]() {
+    uint32_t last = 0;
+
+    while( !done.load() ) {
+      Snapshot snapshot = seqLock.read();
+      TEST_CHECK( isConsistent( snapshot ) );
+
+      // a reader never sees an older write than before
+      TEST_CHECK( snapshot.values[0] >= last );
+      last = snapshot.values[0];
+      ++reads;
+    }
+  } );
+
+  std::thread writer( [&]() {
+    for( uint32_t i = 1; i <= Writes; ++i ) {
+      if( i & 1 ) {
+        Snapshot snapshot;
+
+        for( uint32_t& value : snapshot.values ) {
+          value = i;
+        }
+
+        snapshot.number = i;
+        seqLock.write( snapshot );
+      } else {
+        seqLock.update( [i]( Snapshot & snapshot ) {
+          for( uint32_t& value : snapshot.values ) {
+            value = i;
+          }
+
+          snapshot.number = i;
+        } );
+      }
+    }
+
+    done.store( true );
+  } );
+
+  writer.join();
+  reader.join();
+
+  TEST_CHECK( seqLock.read().values[0] == Writes );
+  printf( "no torn reads: %u writes, %u reads\n", Writes, reads );
+}
+
+// two writers doing read-modify-write with update() don't lose increments
+static void testConcurrentUpdates() {
+  SeqLock<Snapshot> seqLock;
+
+  auto increment = [&seqLock]() {
+    for( uint32_t i = 0; i < Writes / 2; ++i ) {
+      seqLock.update( []( Snapshot & snapshot ) {
+        for( uint32_t& value : snapshot.values ) {
+          ++value;
+        }
+
+        snapshot.number += 1;
+      } );
+    }
+  };
+
+  std::thread writer1( increment );
+  std::thread writer2( increment );
+  writer1.join();
+  writer2.join();
+
+  Snapshot snapshot = seqLock.read();
+  TEST_CHECK( isConsistent( snapshot ) );
+  TEST_CHECK( snapshot.values[0] == Writes );
+  printf( "concurrent updates: %u increments\n", snapshot.values[0] );
+}
+
+int main() {
+  testNoTornReads();
+  testConcurrentUpdates();
+  return 0;
+}
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+#
+# Checks the ISOBUS Guidance System Command sent by esp32-aog: PGN 44288 (0xAD00), priority 3, the configured
+# source address, global destination, the reserved bits and the period of 100ms. Frames with the
+# Guidance Machine Info (PGN 44032, 0xAC00) from the same source address are reported too, as only the
+# tractor sends them.
+#
+# usage: tools/check-guidance-command.py [-a 28] [-n 100] <can0 | vcan0 | candump.log>
+#
+# Reads either directly from a SocketCAN-interface (a USB-CAN adapter on the bus of the ESP32) or a
+# log written by "candump -L". Without hardware, a virtual bus can be used to check the checker:
+#   sudo modprobe vcan
+#   sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+#   tools/check-guidance-command.py --simulate vcan0 &
+#   tools/check-guidance-command.py vcan0
+# Only the Python standard library is needed. Exits with 1 if a check failed.
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import time
+
+PGN_GUIDANCE_MACHINE_INFO = 0xAC00
+PGN_GUIDANCE_SYSTEM_COMMAND = 0xAD00
+PRIORITY = 3
+DESTINATION_GLOBAL = 0xFF
+
+CAN_EFF_FLAG = 0x80000000
+CAN_RTR_FLAG = 0x40000000
+CAN_EFF_MASK = 0x1FFFFFFF
+CAN_FRAME = struct.Struct("=IB3x8s")
+
+# written by hand from ISO 11783-7, independent of the constants above: priority 3, PGN 0xAD00 to the
+# global address 0xFF from 28 (0x1C); curvature 0 1/km (raw 32128 = 0x7D80), intended to steer
+REFERENCE_FRAME = "0CADFF1C#807DFDFFFFFFFFFF"
+
+parser = argparse.ArgumentParser(description="Checks the Guidance System Command of esp32-aog")
+parser.add_argument("-a", "--source-address", type=int, default=28,
+                    help="configured source address of the ESP32 (default: %(default)s)")
+parser.add_argument("-n", "--count", type=int, default=100,
+                    help="number of frames to check (default: %(default)s)")
+parser.add_argument("-p", "--period", type=float, default=100,
+                    help="expected period in ms (default: %(default)s)")
+parser.add_argument("-j", "--jitter", type=float, default=15,
+                    help="allowed deviation of a single period in ms (default: %(default)s)")
+parser.add_argument("-t", "--timeout", type=float, default=5,
+                    help="seconds without a frame until giving up (default: %(default)s)")
+parser.add_argument("--simulate", action="store_true",
+                    help="send the reference frame (source address 28) every period instead of checking")
+parser.add_argument("source", help="SocketCAN-interface or a log of candump -L")
+args = parser.parse_args()
+
+
+def frames_from_interface(interface):
+    sock = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+    sock.bind((interface,))
+    sock.settimeout(args.timeout)
+
+    while True:
+        try:
+            data = sock.recv(CAN_FRAME.size)
+        except socket.timeout:
+            return
+
+        can_id, dlc, payload = CAN_FRAME.unpack(data)
+        yield time.monotonic(), can_id, payload[:dlc]
+
+
+def frames_from_log(path):
+    # (1436.250153) can0 0CADFF1C#807DFDFFFFFFFFFF
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+
+            if len(fields) < 3 or "#" not in fields[2]:
+                continue
+
+            identifier, data = fields[2].split("#", 1)
+            can_id = int(identifier, 16)
+
+            if len(identifier) > 3:
+                can_id |= CAN_EFF_FLAG
+
+            if data.startswith("R"):
+                can_id |= CAN_RTR_FLAG
+                data = ""
+
+            yield float(fields[0].strip("()")), can_id, bytes.fromhex(data)
+
+
+# sends the reference frame, so the checker is tested against a frame not built from its own constants
+def simulate(interface):
+    sock = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+    sock.bind((interface,))
+    identifier, data = REFERENCE_FRAME.split("#")
+    frame = CAN_FRAME.pack(CAN_EFF_FLAG | int(identifier, 16), 8, bytes.fromhex(data))
+    next_send = time.monotonic()
+
+    while True:
+        sock.send(frame)
+        next_send += args.period / 1000
+        time.sleep(max(0, next_send - time.monotonic()))
+
+
+if args.simulate:
+    simulate(args.source)
+
+if os.path.isfile(args.source):
+    frames = frames_from_log(args.source)
+else:
+    frames = frames_from_interface(args.source)
+
+errors = []
+timestamps = []
+
+for timestamp, can_id, data in frames:
+    if not can_id & CAN_EFF_FLAG or can_id & CAN_RTR_FLAG:
+        continue
+
+    can_id &= CAN_EFF_MASK
+    pdu_format = (can_id >> 16) & 0xFF
+    pgn = (can_id >> 8) & 0x3FFFF
+
+    # PDU1: the PDU specific field is the destination
+    destination = DESTINATION_GLOBAL
+
+    if pdu_format < 0xF0:
+        destination = pgn & 0xFF
+        pgn &= 0x3FF00
+
+    if pgn == PGN_GUIDANCE_MACHINE_INFO and (can_id & 0xFF) == args.source_address:
+        errors.append("Guidance Machine Info (%08X#%s) sent from the own source address" % (can_id, data.hex().upper()))
+
+    if pgn != PGN_GUIDANCE_SYSTEM_COMMAND:
+        continue
+
+    priority = can_id >> 26
+    source = can_id & 0xFF
+    where = "frame %d (%08X#%s)" % (len(timestamps) + 1, can_id, data.hex().upper())
+
+    if priority != PRIORITY:
+        errors.append("%s: priority %d instead of %d" % (where, priority, PRIORITY))
+
+    if source != args.source_address:
+        errors.append("%s: source address %d instead of %d" % (where, source, args.source_address))
+
+    if destination != DESTINATION_GLOBAL:
+        errors.append("%s: destination %d instead of global" % (where, destination))
+
+    if len(data) != 8:
+        errors.append("%s: %d bytes instead of 8" % (where, len(data)))
+    else:
+        curvature = data[0] | (data[1] << 8)
+
+        if curvature > 0xFAFF:
+            errors.append("%s: curvature 0x%04X in the reserved range" % (where, curvature))
+
+        if data[2] & 0xFC != 0xFC or data[3:] != b"\xff" * 5:
+            errors.append("%s: reserved bits not set" % where)
+
+    timestamps.append(timestamp)
+
+    if len(timestamps) >= args.count:
+        break
+
+if len(timestamps) < 2:
+    errors.append("only %d Guidance System Command frames received" % len(timestamps))
+else:
+    periods = [(b - a) * 1000 for a, b in zip(timestamps, timestamps[1:])]
+    mean = sum(periods) / len(periods)
+
+    for i, period in enumerate(periods):
+        if abs(period - args.period) > args.jitter:
+            errors.append("frame %d: period %.1fms instead of %.0fms" % (i + 2, period, args.period))
+
+    if abs(mean - args.period) > 1:
+        errors.append("mean period %.2fms instead of %.0fms" % (mean, args.period))
+
+    print("%d frames, period %.1f/%.2f/%.1fms (min/mean/max)" % (len(timestamps), min(periods), mean, max(periods)))
+
+for error in errors[:20]:
+    print(error)
+
+if len(errors) > 20:
+    print("... %d more" % (len(errors) - 20))
+
+sys.exit(1 if errors else 0)
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+#
+# Stand-in NTRIP caster to test the NTRIP client of esp32-aog without a real caster.
+#
+# usage: tools/ntrip-caster.py [-p 2101] [-m TEST] [-u user:password]
+#
+# NTRIP 1.0 requests get "ICY 200 OK" and a raw stream, NTRIP 2.0 ones a chunked stream: the chunks have
+# random sizes, upper- and lowercase hex sizes and extensions, and are written in pieces, so the chunk
+# decoder sees every boundary split over the reads. Wrong credentials get a 401, other mountpoints the
+# sourcetable. The payload is a counter, so gaps show up on the receiver; the received GGA-sentences are printed.
+
+import argparse
+import base64
+import random
+import select
+import socketserver
+import time
+
+parser = argparse.ArgumentParser(description="Stand-in NTRIP caster")
+parser.add_argument("-p", "--port", type=int, default=2101, help="port to listen on (default: %(default)s)")
+parser.add_argument("-m", "--mountpoint", default="TEST", help="the mountpoint served (default: %(default)s)")
+parser.add_argument("-u", "--credentials", help="user:password required for the mountpoint")
+args = parser.parse_args()
+
+SOURCETABLE = "STR;%s;Test;RTCM 3.2;1005(10),1077(1);2;GPS;SNIP;CHE;47.00;8.00;1;0;sNTRIP;none;%s;N;0;\r\nENDSOURCETABLE\r\n" % (
+    args.mountpoint, "B" if args.credentials else "N")
+
+
+class NtripHandler(socketserver.StreamRequestHandler):
+    # unbuffered, so a GGA-sentence sent right after the request is seen by select()
+    rbufsize = 0
+
+    def send(self, data):
+        # in pieces, with a pause in between, so they arrive in separate segments
+        for piece in [data[:1], data[1:]] if len(data) > 1 and random.random() < 0.5 else [data]:
+            self.wfile.write(piece)
+            self.wfile.flush()
+            time.sleep(0.005)
+
+    def handle(self):
+        request = self.rfile.readline().decode(errors="replace").split()
+        headers = {}
+        for line in iter(lambda: self.rfile.readline().decode(errors="replace").strip(), ""):
+            name, _, value = line.partition(":")
+            headers[name.strip().lower()] = value.strip()
+        v2 = "ntrip/2.0" in headers.get("ntrip-version", "").lower()
+        mountpoint = request[1].lstrip("/") if len(request) > 1 else ""
+        print("%s: %s, NTRIP %s, GGA in header: %s" % (self.client_address[0], " ".join(request), "2.0" if v2 else "1.0", headers.get("ntrip-gga")))
+
+        if mountpoint != args.mountpoint:
+            header = "HTTP/1.1 200 OK\r\nContent-Type: gnss/sourcetable\r\nConnection: close\r\n\r\n" if v2 else "SOURCETABLE 200 OK\r\n\r\n"
+            self.wfile.write((header + SOURCETABLE).encode())
+        elif args.credentials and headers.get("authorization") != "Basic " + base64.b64encode(args.credentials.encode()).decode():
+            self.wfile.write(b"HTTP/1.1 401 Unauthorized\r\nWWW-Authenticate: Basic realm=\"/%s\"\r\n\r\n" % args.mountpoint.encode())
+        else:
+            self.wfile.write(b"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n" if v2 else b"ICY 200 OK\r\n")
+            try:
+                self.stream(v2)
+            except (BrokenPipeError, ConnectionResetError):
+                pass
+        print("%s: disconnected" % self.client_address[0])
+
+    def stream(self, v2):
+        counter = 0
+        while True:
+            payload = bytes((counter + i) & 0xFF for i in range(random.randint(1, 600)))
+            counter += len(payload)
+            if v2:
+                size = random.choice(["%x", "%X"]) % len(payload) + random.choice(["", ";ext=1"])
+                for part in [size.encode(), b"\r", b"\n", payload[:len(payload) // 2], payload[len(payload) // 2:], b"\r\n"]:
+                    self.send(part)
+            else:
+                self.send(payload)
+            if select.select([self.connection], [], [], 0.2)[0]:
+                received = self.connection.recv(256)
+                if not received:
+                    return
+                print("GGA: " + received.decode(errors="replace").strip())
+
+
+class Caster(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+print("Listening on port %d, mountpoint %s" % (args.port, args.mountpoint))
+Caster(("", args.port), NtripHandler).serve_forever()
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+#
+# Symbolizes the crash report of esp32-aog, as served on /crash.json after a crash.
+#
+# usage: tools/symbolize-crash.py [-e firmware.elf] [-t toolchain] <crash.json | http://esp32-ip>
+#
+# The ELF has to be the one of the build running on the device; compare the "build"-field of the
+# report with the time of the build.
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import urllib.request
+
+EXCEPTION_CAUSES = {
+    0: "IllegalInstruction",
+    2: "InstructionFetchError",
+    3: "LoadStoreError",
+    4: "Level1Interrupt",
+    5: "Alloca",
+    6: "IntegerDivideByZero",
+    8: "Privileged",
+    9: "LoadStoreAlignment",
+    12: "InstrPIFDataError",
+    13: "LoadStorePIFDataError",
+    14: "InstrPIFAddrError",
+    15: "LoadStorePIFAddrError",
+    16: "InstTLBMiss",
+    17: "InstTLBMultiHit",
+    18: "InstFetchPrivilege",
+    20: "InstFetchProhibited",
+    24: "LoadStoreTLBMiss",
+    25: "LoadStoreTLBMultiHit",
+    26: "LoadStorePrivilege",
+    28: "LoadProhibited",
+    29: "StoreProhibited",
+}
+
+base = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+parser = argparse.ArgumentParser(description="Symbolizes /crash.json of esp32-aog")
+parser.add_argument("-e", "--elf", default=os.path.join(base, ".pio", "build", "featheresp32", "firmware.elf"),
+                    help="ELF of the running firmware (default: %(default)s)")
+parser.add_argument("-t", "--toolchain", default=os.path.expanduser("~/.platformio/packages/toolchain-xtensa32"),
+                    help="path to the xtensa-esp32-elf toolchain (default: %(default)s)")
+parser.add_argument("report", help="crash.json or the address of the ESP32")
+args = parser.parse_args()
+
+if args.report.startswith("http://") or args.report.startswith("https://"):
+    url = args.report if args.report.endswith(".json") else args.report.rstrip("/") + "/crash.json"
+    with urllib.request.urlopen(url) as response:
+        report = json.load(response)
+else:
+    with open(args.report) as f:
+        report = json.load(f)
+
+cause = report["exception"]["cause"]
+
+print("Build:       %s" % report.get("build", "?"))
+print("Reset:       %s" % report.get("resetReason", "?"))
+print("Uptime:      %.1fs" % (report["uptime"] / 1000))
+print("Task:        %s on core %d" % (report["task"], report["core"]))
+print("Exception:   %s (%d), address %s" % (EXCEPTION_CAUSES.get(cause, "?"), cause, report["exception"]["address"]))
+print("Heap:        %d bytes free, %d lowest, %d largest block (sampled up to 1s before the crash)" %
+      (report["heap"]["free"], report["heap"]["minimumFree"], report["heap"]["largestFreeBlock"]))
+
+print("\nBacktrace:")
+addresses = [frame[0] for frame in report.get("backtrace", [])]
+
+if addresses:
+    addr2line = os.path.join(args.toolchain, "bin", "xtensa-esp32-elf-addr2line")
+    output = subprocess.run([addr2line, "-pfiaC", "-e", args.elf] + addresses,
+                            stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+    print(output.rstrip())
+
+print("\nTasks (time since the start of the last loop):")
+for task in report.get("tasks", []):
+    print("  %-26s %10.1fms %10d loops" % (task["name"], task["lastLoop"] / 1000, task["loops"]))